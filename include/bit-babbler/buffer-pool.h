@@ -0,0 +1,353 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_BUFFER_POOL_H
+#define _BB_BUFFER_POOL_H
+
+#include <bit-babbler/log.h>
+
+#include <string.h>
+
+#if !EM_PLATFORM_MSW
+ #include <sys/mman.h>
+#endif
+
+
+namespace BitB
+{
+    // Zero len bytes at p, in a way which the compiler can't optimise away
+    // because it can prove the memory isn't read again before it is freed.
+    static inline void SecureZero( void *p, size_t len )
+    {
+        static void *(* const volatile memset_v)( void*, int, size_t ) = memset;
+
+        memset_v( p, 0, len );
+    }
+
+
+    // A process-wide allocator of aligned, recyclable, data buffers.
+    //{{{
+    // Every buffer that entropy passes through on its way from a source to
+    // an output is allocated from here, rather than each user rolling its own
+    // with new[], a VLA, or a large array on the stack.  All of them are
+    // aligned to at least a cache line (which is also enough for any of the
+    // SIMD vector sizes we might use), so two threads never share a line of
+    // a buffer, and the QA and mixing code can rely on that alignment.
+    //
+    // Requests are rounded up to a power of 2 size class, and buffers of up
+    // to MAX_CACHED_SIZE which are released are kept on a free list for the
+    // next request of the same class, so a thread which needs a temporary
+    // buffer for each block it handles won't hit the system allocator for
+    // it after the first time.  Larger buffers are allocated and freed at
+    // their (aligned) requested size, since they are rare and long lived.
+    // Every buffer is zeroed when it is released, before it is either cached
+    // or returned to the system, so whatever key or entropy material it held
+    // can't be seen by whoever is handed that memory next.
+    //
+    // All of this is serialised by a single mutex, so it should not be used
+    // for a new buffer for every block in a hot path.  Anything which needs
+    // scratch space that often should keep a buffer of its own for it.
+    //
+    // If UseHugePages() is enabled, buffers of at least HUGE_PAGE_SIZE are
+    // aligned to that, and the kernel is asked to back them with transparent
+    // huge pages (on platforms where that is supported).
+    //
+    // The number of buffers in use and cached for each size class can be
+    // obtained as JSON with GetStats().
+    //}}}
+    class BufferPool
+    { //{{{
+    public:
+
+        static const size_t     ALIGNMENT       = 64;
+        static const size_t     HUGE_PAGE_SIZE  = 2 * 1024 * 1024;
+        static const size_t     MAX_CACHED_SIZE = 4 * 1024 * 1024;
+        static const unsigned   MAX_CACHED      = 8;
+
+
+    private:
+
+        static const unsigned   MIN_SHIFT       = 6;    // ALIGNMENT
+        static const unsigned   CLASS_COUNT     = 64;
+
+        struct FreeBuffer
+        {
+            FreeBuffer *next;
+        };
+
+        struct SizeClass
+        { //{{{
+
+            FreeBuffer         *free;
+            unsigned            free_count;
+
+            unsigned long long  requests;
+            unsigned long long  recycled;
+            unsigned long       in_use;
+            unsigned long       peak_in_use;
+
+        }; //}}}
+
+
+        static SizeClass        ms_class[CLASS_COUNT];
+        static pthread_mutex_t  ms_mutex;
+        static bool             ms_hugepages;
+        static size_t           ms_bytes_in_use;
+        static size_t           ms_bytes_cached;
+
+
+        BB_CONST
+        static unsigned class_of( size_t size )
+        {
+            unsigned    shift = MIN_SHIFT;
+
+            while( (size_t(1) << shift) < size )
+                ++shift;
+
+            return shift;
+        }
+
+        // The size that will actually be allocated for a request of size.
+        static size_t alloc_size( size_t size, unsigned shift )
+        {
+            size_t  class_size = size_t(1) << shift;
+
+            if( class_size <= MAX_CACHED_SIZE )
+                return class_size;
+
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+
+
+        static uint8_t *sys_alloc( size_t size, bool hugepages )
+        { //{{{
+
+            size_t  align = ALIGNMENT;
+            void   *p;
+
+            if( hugepages && size >= HUGE_PAGE_SIZE )
+                align = HUGE_PAGE_SIZE;
+
+          #if EM_PLATFORM_MSW
+
+            p = _aligned_malloc( size, align );
+
+            if( ! p )
+                throw SystemError( ENOMEM, _("BufferPool: failed to allocate %zu bytes"), size );
+
+          #else
+
+            int ret = posix_memalign( &p, align, size );
+
+            if( ret )
+                throw SystemError( ret, _("BufferPool: failed to allocate %zu bytes"), size );
+
+           #ifdef MADV_HUGEPAGE
+            if( align == HUGE_PAGE_SIZE && madvise( p, size, MADV_HUGEPAGE ) )
+                LogErr<3>( "BufferPool: madvise( %zu, MADV_HUGEPAGE ) failed", size );
+           #endif
+
+          #endif
+
+            return static_cast<uint8_t*>( p );
+
+        } //}}}
+
+        static void sys_free( void *p )
+        {
+          #if EM_PLATFORM_MSW
+            _aligned_free( p );
+          #else
+            free( p );
+          #endif
+        }
+
+
+        // You cannot create instances of this class
+        BufferPool();
+
+
+    public:
+
+        // Allocate a buffer of at least size bytes, aligned to ALIGNMENT.
+        // It must be returned with Release(), using the same size.
+        static uint8_t *Alloc( size_t size )
+        { //{{{
+
+            unsigned    shift = class_of( size );
+            size_t      n     = alloc_size( size, shift );
+            SizeClass  &c     = ms_class[shift];
+            bool        hugepages;
+
+            {
+                ScopedMutex     lock( &ms_mutex );
+
+                ++c.requests;
+                hugepages = ms_hugepages;
+
+                if( c.free )
+                {
+                    FreeBuffer *b = c.free;
+
+                    c.free = b->next;
+                    --c.free_count;
+                    ++c.recycled;
+
+                    if( ++c.in_use > c.peak_in_use )
+                        c.peak_in_use = c.in_use;
+
+                    ms_bytes_cached -= n;
+                    ms_bytes_in_use += n;
+
+                    return reinterpret_cast<uint8_t*>( b );
+                }
+            }
+
+            uint8_t    *p = sys_alloc( n, hugepages );
+            ScopedMutex lock( &ms_mutex );
+
+            if( ++c.in_use > c.peak_in_use )
+                c.peak_in_use = c.in_use;
+
+            ms_bytes_in_use += n;
+
+            return p;
+
+        } //}}}
+
+        static void Release( uint8_t *p, size_t size )
+        { //{{{
+
+            if( ! p )
+                return;
+
+            unsigned    shift = class_of( size );
+            size_t      n     = alloc_size( size, shift );
+            SizeClass  &c     = ms_class[shift];
+
+            SecureZero( p, n );
+
+            {
+                ScopedMutex     lock( &ms_mutex );
+
+                --c.in_use;
+                ms_bytes_in_use -= n;
+
+                if( n <= MAX_CACHED_SIZE && c.free_count < MAX_CACHED )
+                {
+                    FreeBuffer *b = reinterpret_cast<FreeBuffer*>( p );
+
+                    b->next = c.free;
+                    c.free  = b;
+                    ++c.free_count;
+                    ms_bytes_cached += n;
+
+                    return;
+                }
+            }
+
+            sys_free( p );
+
+        } //}}}
+
+
+        // Enable or disable huge page backing for large buffers.  This only
+        // affects buffers allocated after it is changed.
+        static void UseHugePages( bool enable )
+        {
+            ScopedMutex     lock( &ms_mutex );
+            ms_hugepages = enable;
+        }
+
+        static std::string GetStats()
+        { //{{{
+
+            ScopedMutex     lock( &ms_mutex );
+            std::string     classes;
+
+            for( unsigned i = MIN_SHIFT; i < CLASS_COUNT; ++i )
+            {
+                const SizeClass &c = ms_class[i];
+
+                if( c.requests == 0 )
+                    continue;
+
+                if( ! classes.empty() )
+                    classes += ',';
+
+                classes += stringprintf( "{\"Size\":%zu,\"Requests\":%llu,\"Recycled\":%llu,"
+                                         "\"InUse\":%lu,\"PeakInUse\":%lu,\"Free\":%u}",
+                                         size_t(1) << i, c.requests, c.recycled,
+                                         c.in_use, c.peak_in_use, c.free_count );
+            }
+
+            return stringprintf( "{\"Alignment\":%zu,\"HugePages\":%s,"
+                                 "\"InUseBytes\":%zu,\"FreeBytes\":%zu,\"Classes\":[",
+                                 size_t(ALIGNMENT), ms_hugepages ? "true" : "false",
+                                 ms_bytes_in_use, ms_bytes_cached )
+                   + classes + "]}";
+
+        } //}}}
+
+
+        // A buffer which is returned to the pool when it is destroyed.
+        class Buffer
+        { //{{{
+        private:
+
+            uint8_t    *m_buf;
+            size_t      m_size;
+
+
+            // You cannot copy this class
+            Buffer( const Buffer& );
+            Buffer &operator=( const Buffer& );
+
+
+        public:
+
+            Buffer( size_t size = 0 )
+                : m_buf( size ? Alloc( size ) : NULL )
+                , m_size( size )
+            {}
+
+            ~Buffer()
+            {
+                Release( m_buf, m_size );
+            }
+
+
+            // Replace this with a new buffer of size bytes.  The content
+            // of the old buffer is not preserved.
+            void Reset( size_t size )
+            {
+                uint8_t    *b = size ? Alloc( size ) : NULL;
+
+                Release( m_buf, m_size );
+
+                m_buf  = b;
+                m_size = size;
+            }
+
+            void swap( Buffer &other )
+            {
+                std::swap( m_buf,  other.m_buf );
+                std::swap( m_size, other.m_size );
+            }
+
+
+            uint8_t *Raw() const  { return m_buf; }
+            size_t   Size() const { return m_size; }
+
+            operator uint8_t*() const { return m_buf; }
+
+        }; //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_BUFFER_POOL_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
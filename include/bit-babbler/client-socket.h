@@ -256,6 +256,93 @@ namespace BitB
             return json;
         }
 
+
+        typedef std::list< std::string >            RequestList;
+        typedef std::vector< Json::Data::Handle >   ReplyList;
+
+        // Send all of the requests before reading any of the replies, and
+        // return the replies in the same order as the requests.  This costs
+        // only one round trip for all of them, instead of one for each.
+        ReplyList Pipeline( const RequestList &reqs )
+        { //{{{
+
+            std::string     buf;
+            ReplyList       replies;
+
+            for( RequestList::const_iterator i = reqs.begin(), e = reqs.end(); i != e; ++i )
+            {
+                Log<3>( _("ClientSock::Pipeline: '%s'\n"), i->c_str() );
+                buf.append( i->c_str(), i->size() + 1 );
+            }
+
+            for( size_t n = buf.size(), c = n; c; )
+            {
+                ssize_t w = send( m_fd, buf.data() + n - c, c, 0 );
+
+                if( w < 0 )
+                    throw SocketError( _("ClientSock::Pipeline: write failed") );
+
+                if( w == 0 )
+                    throw Error( _("ClientSock::Pipeline: write EOF") );
+
+                c -= size_t(w);
+            }
+
+            for( size_t i = 0, n = reqs.size(); i < n; ++i )
+                replies.push_back( Read()->GetRoot() );
+
+            return replies;
+
+        } //}}}
+
+        // Send all of the requests in a single Batch request, and return the
+        // reply to each of them in the same order as the requests.  If the
+        // server doesn't support Batch requests, they will be pipelined.  A
+        // request which fails gets a BadRequest reply in its place, with the
+        // error that the server reported for it.  The server won't accept a
+        // Batch request larger than 64kB, or with more than 64 requests in it,
+        // or any Batch nested inside another one.
+        ReplyList Batch( const RequestList &reqs, size_t token = 0 )
+        { //{{{
+
+            std::string     req = stringprintf( "[\"Batch\",%zu,[", token );
+            ReplyList       replies;
+
+            for( RequestList::const_iterator i = reqs.begin(), e = reqs.end(); i != e; ++i )
+            {
+                if( i != reqs.begin() )
+                    req += ',';
+
+                req += *i;
+            }
+
+            SendRequest( req + "]]" );
+
+            Json::Handle    json = Read();
+            std::string     cmd  = json[0]->String();
+
+            if( cmd == "UnknownRequest" )
+            {
+                Log<2>( _("ClientSock::Batch: not supported by the server, pipelining\n") );
+                return Pipeline( reqs );
+            }
+
+            if( cmd != "Batch" )
+                throw Error( _("ClientSock::Batch: unexpected reply '%s'"),
+                                                        json->JSONStr().c_str() );
+
+            Json::Data::Handle  r = json[2];
+
+            for( size_t i = 0, n = r->GetArraySize(); i < n; ++i )
+                replies.push_back( r[i] );
+
+            if( replies.size() != reqs.size() )
+                throw Error( _("ClientSock::Batch: %zu replies for %zu requests"),
+                                                        replies.size(), reqs.size() );
+            return replies;
+
+        } //}}}
+
     }; //}}}
 
 }   // BitB namespace
@@ -0,0 +1,329 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_CONDITIONER_H
+#define _BB_CONDITIONER_H
+
+#include <bit-babbler/exceptions.h>
+#include <bit-babbler/log.h>
+
+#include <string.h>
+
+
+namespace BitB
+{
+    // The SHA-256 hash function, as specified by FIPS 180-4.
+    class SHA256
+    { //{{{
+    public:
+
+        static const size_t BLOCK_BYTES  = 64;
+        static const size_t DIGEST_BYTES = 32;
+
+
+    private:
+
+        uint32_t    m_h[8];
+        uint8_t     m_block[BLOCK_BYTES];
+        size_t      m_fill;
+        uint64_t    m_len;
+
+
+        static uint32_t rotr( uint32_t v, int n )
+        {
+            return v >> n | v << (32 - n);
+        }
+
+        void transform( const uint8_t *p )
+        { //{{{
+
+            static const uint32_t K[64] =
+            {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+                0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+                0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+                0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+                0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+                0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+                0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+                0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+                0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+            };
+
+            uint32_t    w[64];
+
+            for( size_t i = 0; i < 16; ++i, p += 4 )
+                w[i] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16
+                     | uint32_t(p[2]) << 8  | uint32_t(p[3]);
+
+            for( size_t i = 16; i < 64; ++i )
+            {
+                uint32_t    s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+                uint32_t    s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19)  ^ (w[i-2] >> 10);
+
+                w[i] = w[i-16] + s0 + w[i-7] + s1;
+            }
+
+            uint32_t    a = m_h[0], b = m_h[1], c = m_h[2], d = m_h[3],
+                        e = m_h[4], f = m_h[5], g = m_h[6], h = m_h[7];
+
+            for( size_t i = 0; i < 64; ++i )
+            {
+                uint32_t    t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25))
+                                   + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                uint32_t    t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22))
+                               + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+
+            m_h[0] += a; m_h[1] += b; m_h[2] += c; m_h[3] += d;
+            m_h[4] += e; m_h[5] += f; m_h[6] += g; m_h[7] += h;
+
+        } //}}}
+
+
+    public:
+
+        SHA256()
+        {
+            Init();
+        }
+
+        ~SHA256()
+        {
+            memset( m_h, 0, sizeof(m_h) );
+            memset( m_block, 0, sizeof(m_block) );
+        }
+
+
+        void Init()
+        { //{{{
+
+            m_h[0] = 0x6a09e667;
+            m_h[1] = 0xbb67ae85;
+            m_h[2] = 0x3c6ef372;
+            m_h[3] = 0xa54ff53a;
+            m_h[4] = 0x510e527f;
+            m_h[5] = 0x9b05688c;
+            m_h[6] = 0x1f83d9ab;
+            m_h[7] = 0x5be0cd19;
+
+            m_fill = 0;
+            m_len  = 0;
+
+        } //}}}
+
+        void Update( const uint8_t *buf, size_t len )
+        { //{{{
+
+            m_len += len;
+
+            if( m_fill )
+            {
+                size_t  n = std::min( BLOCK_BYTES - m_fill, len );
+
+                memcpy( m_block + m_fill, buf, n );
+
+                m_fill += n;
+                buf    += n;
+                len    -= n;
+
+                if( m_fill < BLOCK_BYTES )
+                    return;
+
+                transform( m_block );
+                m_fill = 0;
+            }
+
+            for( ; len >= BLOCK_BYTES; buf += BLOCK_BYTES, len -= BLOCK_BYTES )
+                transform( buf );
+
+            if( len )
+            {
+                memcpy( m_block, buf, len );
+                m_fill = len;
+            }
+
+        } //}}}
+
+        // Output the digest of everything passed to Update() since Init(),
+        // and Init() again ready to hash some new message.
+        void Final( uint8_t *digest )
+        { //{{{
+
+            uint64_t    bits = m_len * 8;
+
+            m_block[m_fill++] = 0x80;
+
+            if( m_fill > BLOCK_BYTES - 8 )
+            {
+                memset( m_block + m_fill, 0, BLOCK_BYTES - m_fill );
+                transform( m_block );
+                m_fill = 0;
+            }
+
+            memset( m_block + m_fill, 0, BLOCK_BYTES - 8 - m_fill );
+
+            for( size_t i = 0; i < 8; ++i )
+                m_block[BLOCK_BYTES - 1 - i] = uint8_t(bits >> (i * 8));
+
+            transform( m_block );
+
+            for( size_t i = 0; i < 8; ++i )
+            {
+                digest[i * 4]     = uint8_t(m_h[i] >> 24);
+                digest[i * 4 + 1] = uint8_t(m_h[i] >> 16);
+                digest[i * 4 + 2] = uint8_t(m_h[i] >> 8);
+                digest[i * 4 + 3] = uint8_t(m_h[i]);
+            }
+
+            Init();
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Condition raw entropy with SHA-256, as an alternative to folding it.
+    //{{{
+    // Folding halves the number of bits output with each fold, so a source
+    // with only a small entropy deficit still loses half its output to fix
+    // it.  With a vetted conditioning function (SP 800-90B section 3.1.5.1.1)
+    // the amount of compression can be chosen to suit how much entropy each
+    // raw bit is actually measured to have.  The Ratio is the number of raw
+    // input bytes to the number of output bytes, so a ratio of 3:2 will hash
+    // each 48 bytes of input down to a 32 byte digest.  Each block of output
+    // is the digest of just the next block of input, so that a burst of bad
+    // input can't influence any output beyond the block which contained it.
+    //
+    // Note that the output of the hash will pass the statistical QA checks
+    // regardless of how little entropy its input actually had, so they must
+    // be applied to the raw input before it is conditioned, not to this.  The
+    // ratio should be chosen from the measured min-entropy of the source,
+    // with a good safety margin, not by what just passes the QA tests.
+    //}}}
+    class Conditioner
+    { //{{{
+    public:
+
+        static const size_t OUTPUT_BYTES = SHA256::DIGEST_BYTES;
+
+
+        struct Ratio
+        { //{{{
+
+            unsigned    in;
+            unsigned    out;
+
+
+            Ratio()
+                : in( 0 )
+                , out( 0 )
+            {}
+
+            Ratio( const std::string &arg )
+            { //{{{
+
+                size_t  n = arg.find(':');
+
+                if( n == std::string::npos )
+                    throw Error( _("Conditioner: invalid ratio '%s', expected in:out"),
+                                                                        arg.c_str() );
+                in  = StrToU( arg.substr(0, n), 10 );
+                out = StrToU( arg.substr(n + 1), 10 );
+
+                if( out < 1 || in < out )
+                    throw Error( _("Conditioner: invalid ratio '%s', in must be >= out >= 1"),
+                                                                                arg.c_str() );
+                if( OUTPUT_BYTES * in % out )
+                    throw Error( _("Conditioner: invalid ratio '%s', %zu * in must be a "
+                                   "multiple of out"), arg.c_str(), size_t(OUTPUT_BYTES) );
+            } //}}}
+
+
+            bool IsSet() const
+            {
+                return in != 0;
+            }
+
+            // The number of bytes to hash for each OUTPUT_BYTES of output,
+            // or 0 if no ratio is set.
+            size_t InputBlockSize() const
+            {
+                return out ? OUTPUT_BYTES * in / out : 0;
+            }
+
+            std::string AsString() const
+            {
+                return stringprintf( "%u:%u", in, out );
+            }
+
+        }; //}}}
+
+
+    private:
+
+        SHA256      m_hash;
+        size_t      m_blocksize;
+
+
+    public:
+
+        Conditioner( const Ratio &ratio )
+            : m_blocksize( ratio.InputBlockSize() )
+        {}
+
+
+        // Return the number of bytes of input needed to output len bytes.
+        // The len must be a multiple of OUTPUT_BYTES.
+        size_t InputSize( size_t len ) const
+        {
+            return len / OUTPUT_BYTES * m_blocksize;
+        }
+
+        // Condition len bytes of buf in place, returning the number of bytes of
+        // output that it now contains.  Any trailing partial block is discarded.
+        size_t Condition( uint8_t *buf, size_t len )
+        { //{{{
+
+            if( m_blocksize == 0 )
+                throw Error( _("Conditioner: no conditioning ratio is set") );
+
+            uint8_t    *start = buf;
+            uint8_t    *out   = buf;
+
+            // The output never overtakes the input still to be read, since
+            // each block of input is at least as big as the digest of it.
+            for( ; len >= m_blocksize; buf += m_blocksize, len -= m_blocksize,
+                                                           out += OUTPUT_BYTES )
+            {
+                m_hash.Update( buf, m_blocksize );
+                m_hash.Final( out );
+            }
+
+            return size_t(out - start);
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_CONDITIONER_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
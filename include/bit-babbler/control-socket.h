@@ -6,6 +6,7 @@
 
 #include <bit-babbler/users.h>
 #include <bit-babbler/health-monitor.h>
+#include <bit-babbler/secret-source.h>
 #include <bit-babbler/json.h>
 #include <bit-babbler/socket.h>
 
@@ -21,27 +22,64 @@ namespace BitB
 
     class ControlSock : public RefCounted
     { //{{{
+    public:
+
+        // A function which can be registered to handle Reload requests.  It
+        // should return a JSON object describing what was changed, and throw
+        // if the new configuration could not be applied.
+        typedef std::string (*ReloadHandler)( void *user_data );
+
+
     private:
 
         class Connection : public RefCounted
         { //{{{
         private:
 
+            // The largest single request we accept.  Only a Batch request may
+            // be larger than MAX_REQUEST_SIZE, up to MAX_BATCH_SIZE, and it may
+            // contain no more than MAX_BATCH_REQUESTS.  No request may nest
+            // arrays or objects more deeply than MAX_REQUEST_DEPTH, which we
+            // check before parsing it, so that neither the parser nor the
+            // dispatch of a Batch can be made to recurse without bound.
+            static const size_t     MAX_REQUEST_SIZE    = 1024;
+            static const size_t     MAX_BATCH_SIZE      = 64 * 1024;
+            static const size_t     MAX_BATCH_REQUESTS  = 64;
+            static const unsigned   MAX_REQUEST_DEPTH   = 8;
+
             ControlSock    *m_server;
             int             m_fd;
             pthread_t       m_connectionthread;
+            std::string     m_responses;
 
 
+            // Responses are queued until flush_responses() is called, so that
+            // the responses to all of the requests which arrived together are
+            // sent together.  A client which pipelines its requests then gets
+            // the replies in as few packets as possible, instead of one small
+            // write for each, which could also be held back by Nagle's algorithm
+            // waiting for an ACK that the client is delaying.
             void send_response( const std::string &msg )
+            {
+                m_responses.append( msg.c_str(), msg.size() + 1 );
+            }
+
+            void flush_responses()
             { //{{{
 
-                size_t  n = msg.size() + 1;
+                std::string     msg;
+                size_t          n = m_responses.size();
+
+                if( n == 0 )
+                    return;
 
                 Log<3>( "ControlSock::Connection( %d )::send_response: %zu bytes\n", m_fd, n );
 
+                msg.swap( m_responses );
+
                 for( size_t c = n; c; )
                 {
-                    ssize_t w = send( m_fd, msg.c_str() + n - c, c, 0 );
+                    ssize_t w = send( m_fd, msg.data() + n - c, c, 0 );
 
                     if( w < 0 )
                         throw SocketError( _("ControlSock::Connection( %d ): write failed"),
@@ -54,19 +92,99 @@ namespace BitB
 
             } //}}}
 
-            void process_request( const std::string    &req,
-                                  const std::string    &cmd,
-                                  size_t                token = 0,
-                                  const Json::Handle   &json  = Json::Handle() )
+            static std::string bad_request( const std::string &error, const std::string &req )
+            {
+                return "[\"BadRequest\",0,{\"Error\":\"" + Json::Escape(error) + "\""
+                                        ",\"Request\":\"" + Json::Escape(req)   + "\"}]";
+            }
+
+            // Return true if req nests arrays or objects more than max deep.
+            BB_PURE
+            static bool too_deep( const std::string &req, unsigned max )
             { //{{{
 
-                if( cmd == "GetIDs" )
+                unsigned    depth     = 0;
+                bool        in_string = false;
+
+                for( size_t i = 0, n = req.size(); i < n; ++i )
                 {
-                    send_response( "[\"GetIDs\"," + stringprintf("%zu,", token)
-                                                  + Monitor::GetIDs() + ']' );
-                    return;
+                    char    c = req[i];
+
+                    if( in_string )
+                    {
+                        if( c == '\\' )
+                            ++i;
+                        else if( c == '"' )
+                            in_string = false;
+
+                        continue;
+                    }
+
+                    switch( c )
+                    {
+                        case '"':
+                            in_string = true;
+                            break;
+
+                        case '[':
+                        case '{':
+                            if( ++depth > max )
+                                return true;
+                            break;
+
+                        case ']':
+                        case '}':
+                            if( depth )
+                                --depth;
+                            break;
+                    }
                 }
 
+                return false;
+
+            } //}}}
+
+            // Return true if the (possibly incomplete) req is a Batch request.
+            static bool is_batch( const char *req, size_t len )
+            { //{{{
+
+                static const char   batch[] = "\"Batch\"";
+                size_t              i       = 0;
+
+                while( i < len && isspace( (unsigned char)req[i] ) )
+                    ++i;
+
+                if( i == len || req[i] != '[' )
+                    return false;
+
+                for( ++i; i < len && isspace( (unsigned char)req[i] ); )
+                    ++i;
+
+                return len - i >= sizeof(batch) - 1
+                    && memcmp( req + i, batch, sizeof(batch) - 1 ) == 0;
+
+            } //}}}
+
+            static bool is_batch( const Json::Data::Handle &json )
+            { //{{{
+
+                if( json->Type() == Json::StringType )
+                    return json->String() == "Batch";
+
+                return json->Type() == Json::ArrayType && json->GetArraySize() > 0
+                    && json[0]->Type() == Json::StringType && json[0]->String() == "Batch";
+
+            } //}}}
+
+            std::string process_request( const std::string        &req,
+                                         const std::string        &cmd,
+                                         size_t                    token = 0,
+                                         const Json::Data::Handle &json  = Json::Data::Handle() )
+            { //{{{
+
+                if( cmd == "GetIDs" )
+                    return "[\"GetIDs\"," + stringprintf("%zu,", token) + Monitor::GetIDs() + ']';
+
                 if( cmd == "ReportStats" )
                 {
                     std::string     id;
@@ -74,9 +192,8 @@ namespace BitB
                     if( json.IsNotNULL() )
                         id = json->Get<std::string>(2);
 
-                    send_response( "[\"ReportStats\"," + stringprintf("%zu,", token)
-                                                       + Monitor::GetStats(id) + ']' );
-                    return;
+                    return "[\"ReportStats\"," + stringprintf("%zu,", token)
+                                                + Monitor::GetStats(id) + ']';
                 }
 
                 if( cmd == "GetRawData" )
@@ -86,11 +203,55 @@ namespace BitB
                     if( json.IsNotNULL() )
                         id = json->Get<std::string>(2);
 
-                    send_response( "[\"GetRawData\"," + stringprintf("%zu,", token)
-                                                      + Monitor::GetRawData(id) + ']' );
-                    return;
+                    return "[\"GetRawData\"," + stringprintf("%zu,", token)
+                                               + Monitor::GetRawData(id) + ']';
+                }
+
+                if( cmd == "GetProfile" )
+                {
+                    std::string     id;
+
+                    if( json.IsNotNULL() )
+                        id = json->Get<std::string>(2);
+
+                    return "[\"GetProfile\"," + stringprintf("%zu,", token)
+                                               + StageProfile::GetProfile(id) + ']';
+                }
+
+                if( cmd == "GetContributions" )
+                {
+                    std::string     name;
+                    bool            only_named = false;
+
+                    if( json.IsNotNULL() )
+                    {
+                        name       = json->Get<std::string>(2);
+                        only_named = true;
+                    }
+
+                    return "[\"GetContributions\"," + stringprintf("%zu,", token)
+                                        + Pool::GetAllContributions( name, only_named ) + ']';
+                }
+
+                if( cmd == "GetCorrelation" )
+                {
+                    std::string     name;
+                    bool            only_named = false;
+
+                    if( json.IsNotNULL() )
+                    {
+                        name       = json->Get<std::string>(2);
+                        only_named = true;
+                    }
+
+                    return "[\"GetCorrelation\"," + stringprintf("%zu,", token)
+                                        + Pool::GetAllCorrelation( name, only_named ) + ']';
                 }
 
+                if( cmd == "GetBufferStats" )
+                    return "[\"GetBufferStats\"," + stringprintf("%zu,", token)
+                                                   + BufferPool::GetStats() + ']';
+
                 if( cmd == "SetLogVerbosity" )
                 {
                     if( json.IsNotNULL() )
@@ -98,62 +259,111 @@ namespace BitB
 
                     Log<0>( "Log verbosity is now %d\n", opt_verbose );
 
-                    send_response( stringprintf( "[\"SetLogVerbosity\",%zu,%d]",
-                                                            token, opt_verbose ) );
-                    return;
+                    return stringprintf( "[\"SetLogVerbosity\",%zu,%d]", token, opt_verbose );
+                }
+
+                if( cmd == "Reload" )
+                    return "[\"Reload\"," + stringprintf("%zu,", token) + m_server->reload() + ']';
+
+                if( cmd == "Batch" )
+                {
+                    // Each element of the array is a request in any form that
+                    // could be sent alone, and the response to each of them is
+                    // returned in an array, in the same order.
+                    std::string     r;
+
+                    if( json.IsNotNULL() )
+                    {
+                        Json::Data::Handle  reqs = json[2];
+                        size_t              n    = reqs->GetArraySize();
+
+                        if( n > MAX_BATCH_REQUESTS )
+                            throw Error( _("Batch of %zu requests, the limit is %zu"),
+                                                        n, size_t(MAX_BATCH_REQUESTS) );
+
+                        for( size_t i = 0; i < n; ++i )
+                        {
+                            if( i )
+                                r += ',';
+
+                            if( is_batch( reqs[i] ) )
+                                r += bad_request( "Batch requests cannot be nested",
+                                                  reqs[i]->JSONStr() );
+                            else
+                                r += dispatch_request( reqs[i]->JSONStr(), reqs[i] );
+                        }
+                    }
+
+                    return "[\"Batch\"," + stringprintf("%zu,[", token) + r + "]]";
                 }
 
-                send_response( "[\"UnknownRequest\"," + stringprintf("%zu,\"", token)
-                                                      + Json::Escape(req) + "\"]" );
+                return "[\"UnknownRequest\"," + stringprintf("%zu,\"", token)
+                                               + Json::Escape(req) + "\"]";
 
             } //}}}
 
-            void parse_request( const std::string &req )
+            std::string dispatch_request( const std::string &req, const Json::Data::Handle &json )
             { //{{{
 
-                std::string     error;
-                Json            json( req, error );
+                if( json->Type() == Json::StringType )
+                    return process_request( req, json->String() );
 
-                if( ! error.empty() )
+                if( json->Type() == Json::ArrayType )
                 {
-                    Log<0>( "ControlSock::Connection( %d )::parse_request: "
-                            "bad request: '%s' -> '%s'\n", m_fd, req.c_str(), error.c_str() );
+                    std::string     error;
 
-                    send_response( "[\"BadRequest\",0,"
-                                    "{\"Error\":\""   + Json::Escape(error) + "\""
-                                    ",\"Request\":\"" + Json::Escape(req)   + "\"}]" );
-                    return;
+                    try {
+                        return process_request( req, json[0]->String(),
+                                                     json[1]->As<size_t>(), json );
+                    }
+                    catch( const abi::__forced_unwind& ) { throw; }
+                    catch( const std::exception &e )     { error = e.what(); }
+                    catch( ... )                         { error = "Unknown exception"; }
+
+                    return bad_request( error, req );
                 }
 
-                Log<4>( "ControlSock::Connection( %d )::parse_request: '%s' -> '%s'\n",
-                                            m_fd, req.c_str(), json.JSONStr().c_str() );
+                return bad_request( "Invalid request, not an array or string", req );
 
+            } //}}}
+
+            void parse_request( const std::string &req )
+            { //{{{
 
-                if( json.RootType() == Json::StringType )
+                if( req.size() >= MAX_REQUEST_SIZE && ! is_batch( req.data(), req.size() ) )
                 {
-                    process_request( req, json );
+                    send_response( bad_request( "Request too large", req.substr( 0, 64 ) ) );
                     return;
                 }
 
-                if( json.RootType() == Json::ArrayType )
+                if( too_deep( req, MAX_REQUEST_DEPTH ) )
                 {
-                    try {
-                        process_request( req, json[0], json[1]->As<size_t>(), json );
-                        return;
-                    }
-                    catch( const abi::__forced_unwind& ) { throw; }
-                    catch( const std::exception &e )     { error = e.what(); }
-                    catch( ... )                         { error = "Unknown exception"; }
+                    Log<0>( "ControlSock::Connection( %d )::parse_request: "
+                            "bad request: nested more than %u deep\n",
+                            m_fd, MAX_REQUEST_DEPTH );
+
+                    send_response( bad_request( "Request nested too deeply",
+                                                req.substr( 0, 64 ) ) );
+                    return;
+                }
+
+                std::string     error;
+                Json            json( req, error );
+
+                if( ! error.empty() )
+                {
+                    Log<0>( "ControlSock::Connection( %d )::parse_request: "
+                            "bad request: '%s' -> '%s'\n", m_fd, req.c_str(), error.c_str() );
 
-                    send_response( "[\"BadRequest\",0,"
-                                    "{\"Error\":\""   + Json::Escape(error) + "\""
-                                    ",\"Request\":\"" + Json::Escape(req)   + "\"}]" );
+                    send_response( bad_request( error, req ) );
                     return;
                 }
 
-                send_response( "[\"BadRequest\",0,"
-                                "{\"Error\":\"Invalid request, not an array or string\""
-                                ",\"Request\":\"" + Json::Escape(req) + "\"}]" );
+                Log<4>( "ControlSock::Connection( %d )::parse_request: '%s' -> '%s'\n",
+                                            m_fd, req.c_str(), json.JSONStr().c_str() );
+
+                send_response( dispatch_request( req, json.GetRoot() ) );
+
             } //}}}
 
 
@@ -166,12 +376,14 @@ namespace BitB
 
                 Log<3>( "ControlSock::Connection( %d ): begin connection_thread\n", m_fd );
 
-                char        buf[1024];
-                size_t      f = 0;
+                // Most requests are small, but a Batch of them may not be,
+                // so the buffer is grown as needed for one, up to MAX_BATCH_SIZE.
+                std::vector<char>   buf( MAX_REQUEST_SIZE );
+                size_t              f = 0;
 
                 for(;;)
                 {
-                    ssize_t n = recv( m_fd, buf + f, sizeof(buf) - f, 0 );
+                    ssize_t n = recv( m_fd, &buf[f], buf.size() - f, 0 );
 
                     if( n < 0 )
                         throw SocketError( _("ControlSock::Connection( %d ): read failed"),
@@ -190,12 +402,12 @@ namespace BitB
 
                     for(;;)
                     {
-                        size_t  len = strnlen( buf + b, f - b );
+                        size_t  len = strnlen( &buf[b], f - b );
 
                         if( len < f - b )
                         {
                             // We have a null terminated request
-                            parse_request( string( buf + b, len ) );
+                            parse_request( string( &buf[b], len ) );
 
                             if( len == f - b - 1 )
                             {
@@ -215,19 +427,23 @@ namespace BitB
                                 // clear out the previous request(s) to make as
                                 // much room as we can to read the rest of it
                                 f -= b;
-                                memmove( buf, buf + b, f );
+                                memmove( &buf[0], &buf[b], f );
                             }
-                            else if( f == sizeof(buf) )
+                            else if( f == buf.size() )
                             {
                                 // we have a whole buffer full of data now,
                                 // but there was no request terminator seen,
-                                // so whatever is in there must be invalid.
-
-                                send_response( "[\"BadRequest\",0,"
-                                                "{\"Error\":\"Request too large\""
-                                                ",\"Request\":\"" + Json::Escape( string(buf,f) )
-                                              + "\"}]" );
-                                f = 0;
+                                // so make room for more of it if it is a
+                                // Batch that we can still accept, or else
+                                // whatever is in there must be invalid.
+                                if( buf.size() < MAX_BATCH_SIZE && is_batch( &buf[0], f ) )
+                                    buf.resize( buf.size() * 2 );
+                                else
+                                {
+                                    send_response( bad_request( "Request too large",
+                                                                string( &buf[0], f ) ) );
+                                    f = 0;
+                                }
                             }
                             // else
                                 // we haven't filled the whole buffer yet,
@@ -237,6 +453,8 @@ namespace BitB
                             break;
                         }
                     }
+
+                    flush_responses();
                 }
 
             } //}}}
@@ -335,6 +553,39 @@ namespace BitB
         pthread_mutex_t         m_servermutex;
         Connection::List        m_connections;
 
+        ReloadHandler           m_reload_handler;
+        void                   *m_reload_data;
+
+
+        std::string reload()
+        { //{{{
+
+            ReloadHandler   handler;
+            void           *data;
+            {
+                ScopedMutex     lock( &m_servermutex );
+
+                handler = m_reload_handler;
+                data    = m_reload_data;
+            }
+
+            if( ! handler )
+                return "{\"Error\":\"Reload is not supported\"}";
+
+            // Don't let this be cancelled part way through applying changes.
+            ScopedCancelState   cancelstate;
+
+            try {
+                return handler( data );
+            }
+            catch( const abi::__forced_unwind& ) { throw; }
+            catch( const std::exception &e )
+            {
+                Log<0>( "ControlSock( %s ): Reload failed: %s\n", m_id.c_str(), e.what() );
+                return "{\"Error\":\"" + Json::Escape( e.what() ) + "\"}";
+            }
+
+        } //}}}
 
         void detach_connection( const Connection::Handle &c )
         { //{{{
@@ -491,6 +742,8 @@ namespace BitB
             : m_id( id )
             , m_fd( -1 )
             , m_serverthread_err( ESRCH )
+            , m_reload_handler( NULL )
+            , m_reload_data( NULL )
         {
             pthread_mutex_init( &m_servermutex, NULL );
         }
@@ -537,6 +790,18 @@ namespace BitB
 
         } //}}}
 
+
+        // Register a handler for Reload requests, or pass NULL to remove it.
+        void SetReloadHandler( ReloadHandler handler, void *user_data = NULL )
+        { //{{{
+
+            ScopedMutex     lock( &m_servermutex );
+
+            m_reload_handler = handler;
+            m_reload_data    = user_data;
+
+        } //}}}
+
     }; //}}}
 
 
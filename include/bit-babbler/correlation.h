@@ -0,0 +1,460 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_CORRELATION_H
+#define _BB_CORRELATION_H
+
+#include <bit-babbler/qa.h>
+#include <bit-babbler/buffer-pool.h>
+#include <bit-babbler/refptr.h>
+
+
+namespace BitB
+{
+  namespace QA
+  {
+
+    // Tests whether the members of a pool group are independent of each other.
+    //{{{
+    // A group mixes its members together with XOR, which can only add to the
+    // entropy of its output if what each of them contributes is independent
+    // of the others.  Two sources which are dependent (because they share a
+    // noisy power rail, or are somehow the same source twice) will cancel out
+    // some part of each other's entropy instead.
+    //
+    // The first block that each member adds to a round of mixing is compared
+    // with the first block from each other member in that round, counting the
+    // bits where they agree, and the ones in each of them.  For independent
+    // sources, each bit should agree half the time, and the correlation of
+    // the two blocks should tend to zero.  Those are tested over a window of
+    // Limits.window_bits for each pair, and once a pair has been compared for
+    // long enough, the long term correlation between them is also tested.
+    // It can only see dependence that shows up in the bits that are at the
+    // same place in those blocks, since sources do not sample in lockstep,
+    // but that is where it would matter for what the group outputs.
+    //
+    // When every pair has been compared for long enough to be tested against
+    // the long term limit, and none of them were found to be dependent, the
+    // FoldReductionHint is how much their own folding might be reduced, since
+    // the XOR of N truly independent members reduces any bias that each of
+    // them has by as much as folding one of them log2(N) times would.  This
+    // is only advisory, passing these tests doesn't prove independence, so
+    // any reduction still needs to be checked against the QA of the output.
+    // A member which is dependent on another adds nothing to the group that
+    // the other one doesn't already provide.
+    //
+    // This is not thread safe, the group must serialise calls to it.
+    //}}}
+    class Correlation : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< Correlation >   Handle;
+
+        static const unsigned   MAX_MEMBERS = 32;       // Bits in a Pool::Group::Mask
+
+
+        struct Limits
+        { //{{{
+
+            uint64_t    window_bits;
+            double      window_chisq;
+
+            uint64_t    long_minbits;
+            double      long_corr;
+
+        }; //}}}
+
+        struct Counts
+        { //{{{
+
+            uint64_t    bits;       // Compared
+            uint64_t    diff;       // That were different
+            uint64_t    ones_a;     // Set in the lower numbered member
+            uint64_t    ones_b;     // Set in the higher numbered member
+
+
+            Counts()
+                : bits( 0 )
+                , diff( 0 )
+                , ones_a( 0 )
+                , ones_b( 0 )
+            {}
+
+
+            Counts &operator+=( const Counts &c )
+            {
+                bits   += c.bits;
+                diff   += c.diff;
+                ones_a += c.ones_a;
+                ones_b += c.ones_b;
+
+                return *this;
+            }
+
+
+            // The proportion of bits which were the same in both.
+            double Agreement() const
+            {
+                return bits ? 1.0 - double(diff) / double(bits) : 0.0;
+            }
+
+            // The Chi^2 of the agreement, with 1 degree of freedom.
+            double Chisq() const
+            { //{{{
+
+                if( ! bits )
+                    return 0.0;
+
+                double  d = double(bits) - 2.0 * double(diff);
+
+                return d * d / double(bits);
+
+            } //}}}
+
+            // The (phi) correlation coefficient of the two sets of bits.
+            double Corr() const
+            { //{{{
+
+                if( ! bits )
+                    return 0.0;
+
+                double  n    = double(bits);
+                double  a    = double(ones_a);
+                double  b    = double(ones_b);
+                double  both = (a + b - double(diff)) / 2.0;
+                double  v    = a * (n - a) * b * (n - b);
+
+                return v > 0.0 ? (n * both - a * b) / sqrt(v) : 0.0;
+
+            } //}}}
+
+
+            std::string AsJSON() const
+            {
+                return stringprintf( "{\"Bits\":%llu,\"Agreement\":%f,\"Chisq\":%f,"
+                                     "\"Chisq-p\":%f,\"Corr\":%f}",
+                                     (unsigned long long)bits, Agreement(),
+                                     Chisq(), pochisq( Chisq(), 1 ), Corr() );
+            }
+
+        }; //}}}
+
+        struct Pair
+        { //{{{
+
+            Counts      window;     // Accumulating now
+            Counts      previous;   // The last complete window
+            Counts      total;      // Since the pair was first compared
+
+            size_t      tested;     // Number of complete windows
+            size_t      failed;     // Number of those that were dependent
+            bool        dependent;
+
+
+            Pair()
+                : tested( 0 )
+                , failed( 0 )
+                , dependent( false )
+            {}
+
+
+            bool LongTested( const Limits &lim ) const
+            {
+                return total.bits + window.bits >= lim.long_minbits;
+            }
+
+            std::string AsJSON() const
+            { //{{{
+
+                Counts  all = total;
+
+                all += window;
+
+                return stringprintf( "{\"Dependent\":%s,\"Tested\":%zu,\"Failed\":%zu,",
+                                     dependent ? "true" : "false", tested, failed )
+                     + "\"Short\":" + previous.AsJSON()
+                     + ",\"Long\":" + all.AsJSON() + '}';
+            } //}}}
+
+        }; //}}}
+
+
+    private:
+
+        uint32_t            m_members;          // Mask of the current members
+        uint32_t            m_round;            // Members with a block in this round
+        size_t              m_size;
+        BufferPool::Buffer  m_block[ MAX_MEMBERS ];
+        uint64_t            m_ones[ MAX_MEMBERS ];
+        Pair                m_pair[ MAX_MEMBERS ][ MAX_MEMBERS ];   // [a][b], a < b
+
+
+        static const Limits &GetLimits();
+
+
+        // Sum the 8 bytes of v into one value.  Each byte must be less than 249.
+        static unsigned sum_bytes( uint64_t v )
+        {
+            v = (v & 0x00FF00FF00FF00FFULL) + (v >> 8 & 0x00FF00FF00FF00FFULL);
+            return unsigned( (v * 0x0001000100010001ULL) >> 48 );
+        }
+
+        // The number of bits set in each byte of v.
+        static uint64_t popcount_bytes( uint64_t v )
+        {
+            v = v - ((v >> 1) & 0x5555555555555555ULL);
+            v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+            return (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        }
+
+        // Count the bits which are set in a, or in a XOR b if b is not NULL.
+        // The per byte counts for up to 31 words are accumulated in one word
+        // before they need to be summed, so there is no dependency between
+        // iterations of the inner loop except for the accumulator add, which
+        // leaves the compiler free to vectorise it where it is able to.
+        // The length must be a multiple of 8 bytes, which a group size is.
+        BB_PURE
+        static uint64_t count_bits( const uint8_t *a, const uint8_t *b, size_t len )
+        { //{{{
+
+            uint64_t    total = 0;
+            size_t      words = len / sizeof(uint64_t);
+
+            while( words )
+            {
+                size_t      n   = std::min( words, size_t(31) );
+                uint64_t    acc = 0;
+
+                for( size_t i = 0; i < n; ++i )
+                {
+                    uint64_t    wa, wb = 0;
+
+                    memcpy( &wa, a, sizeof(wa) );
+                    a += sizeof(wa);
+
+                    if( b )
+                    {
+                        memcpy( &wb, b, sizeof(wb) );
+                        b += sizeof(wb);
+                    }
+
+                    acc += popcount_bytes( wa ^ wb );
+                }
+
+                total += sum_bytes( acc );
+                words -= n;
+            }
+
+            return total;
+
+        } //}}}
+
+
+        // Add c to the counts for pair p, and test it when a window is complete.
+        void add_counts( Pair &p, const Counts &c, unsigned a, unsigned b )
+        { //{{{
+
+            const Limits   &lim = GetLimits();
+
+            p.window += c;
+
+            if( p.window.bits < lim.window_bits )
+                return;
+
+            bool    dependent = p.window.Chisq() > lim.window_chisq;
+
+            p.total   += p.window;
+            p.previous = p.window;
+            p.window   = Counts();
+
+            if( p.total.bits >= lim.long_minbits && fabs( p.total.Corr() ) > lim.long_corr )
+                dependent = true;
+
+            ++p.tested;
+
+            if( dependent )
+                ++p.failed;
+
+            if( dependent != p.dependent )
+                Log<1>( "Correlation: members %u and %u are %s, χ² %f, corr %f\n", a, b,
+                        dependent ? "NOT independent" : "independent again",
+                        p.previous.Chisq(), p.total.Corr() );
+
+            p.dependent = dependent;
+
+        } //}}}
+
+
+    public:
+
+        Correlation( size_t size )
+            : m_members( 0 )
+            , m_round( 0 )
+            , m_size( size )
+        {
+            Log<2>( "+ Correlation( %zu )\n", m_size );
+
+            memset( m_ones, 0, sizeof(m_ones) );
+        }
+
+        ~Correlation()
+        {
+            Log<2>( "- Correlation( %zu )\n", m_size );
+        }
+
+
+        // Start tracking member m, forgetting any earlier member with that number.
+        void AddMember( unsigned m )
+        { //{{{
+
+            for( unsigned i = 0; i < MAX_MEMBERS; ++i )
+                m_pair[ std::min(i, m) ][ std::max(i, m) ] = Pair();
+
+            m_members |= 1u << m;
+            m_round   &= ~(1u << m);
+
+        } //}}}
+
+        void RemoveMember( unsigned m )
+        {
+            m_members &= ~(1u << m);
+            m_round   &= ~(1u << m);
+            m_block[m].Reset( 0 );
+        }
+
+
+        // Compare the block b from member m with the blocks from every other
+        // member in this round, if it is the first one from m in this round.
+        void AddBlock( unsigned m, const uint8_t *b, size_t len )
+        { //{{{
+
+            uint32_t    bit = 1u << m;
+
+            if( (m_members & bit) == 0 || (m_round & bit) || len != m_size )
+                return;
+
+            m_ones[m] = count_bits( b, NULL, len );
+
+            for( uint32_t r = m_round; r; r &= r - 1 )
+            {
+                unsigned    o = unsigned(__builtin_ctz(r));
+                unsigned    a = std::min( m, o );
+                Counts      c;
+
+                c.bits   = uint64_t(len) * 8;
+                c.diff   = count_bits( b, m_block[o], len );
+                c.ones_a = m_ones[a];
+                c.ones_b = m_ones[ std::max(m, o) ];
+
+                add_counts( m_pair[a][ std::max(m, o) ], c, a, std::max(m, o) );
+            }
+
+            if( ! m_block[m] )
+                m_block[m].Reset( m_size );
+
+            memcpy( m_block[m], b, len );
+            m_round |= bit;
+
+        } //}}}
+
+        // Begin a new round of mixing.
+        void EndRound()
+        {
+            m_round = 0;
+        }
+
+
+        // Return a JSON object with the state of every pair of current members,
+        // keyed by the member numbers of the pair, and whether we have seen enough
+        // to be confident that all of them are independent.  Members are named as
+        // the bit number of their Pool::Group::Mask.
+        std::string AsJSON() const
+        { //{{{
+
+            const Limits   &lim         = GetLimits();
+            std::string     pairs;
+            std::string     redundant;
+            unsigned        members     = unsigned(popcount( m_members ));
+            bool            independent = members > 1;
+
+            for( unsigned a = 0; a < MAX_MEMBERS; ++a )
+            {
+                if( (m_members & 1u << a) == 0 )
+                    continue;
+
+                bool    dep = false;
+
+                for( unsigned b = 0; b < MAX_MEMBERS; ++b )
+                {
+                    if( b == a || (m_members & 1u << b) == 0 )
+                        continue;
+
+                    const Pair &p = m_pair[ std::min(a, b) ][ std::max(a, b) ];
+
+                    if( p.dependent )
+                        dep = true;
+
+                    if( b < a )
+                        continue;
+
+                    if( ! p.LongTested( lim ) || p.dependent )
+                        independent = false;
+
+                    if( ! pairs.empty() )
+                        pairs += ',';
+
+                    pairs += stringprintf( "\"%u:%u\":", a, b ) + p.AsJSON();
+                }
+
+                if( dep )
+                {
+                    if( ! redundant.empty() )
+                        redundant += ',';
+
+                    redundant += stringprintf( "%u", a );
+                }
+            }
+
+            return stringprintf( "{\"Members\":%u,\"Independent\":%s,\"FoldReductionHint\":%u,",
+                                 members, independent ? "true" : "false",
+                                 independent ? fls(members) - 1 : 0u )
+                 + "\"Dependent\":[" + redundant + "],\"Pairs\":{" + pairs + "}}";
+
+        } //}}}
+
+    }; //}}}
+
+
+    EM_TRY_PUSH_DIAGNOSTIC_IGNORE("-Wgnu-designator")
+
+    inline const Correlation::Limits &Correlation::GetLimits()
+    { //{{{
+
+        // A window of 16Mbit is 32 blocks from each of a pair with the default
+        // group size of 64kB.  Random expected outside of the window limit less
+        // than once in 100 million trials.  The long term limit is more than 9
+        // times the standard deviation of the correlation of independent random
+        // bits once long_minbits have been compared.
+        static const Limits lim = {
+
+            window_bits:    16 * 1024 * 1024,
+            window_chisq:   32.841,
+
+            long_minbits:   uint64_t(8) * 1024 * 1024 * 1024,
+            long_corr:      0.0001,
+        };
+
+        return lim;
+
+    } //}}}
+
+    EM_POP_DIAGNOSTIC
+
+  }     // QA namespace
+}   // BitB namespace
+
+
+#endif  // _BB_CORRELATION_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
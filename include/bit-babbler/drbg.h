@@ -0,0 +1,510 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_DRBG_H
+#define _BB_DRBG_H
+
+#include <bit-babbler/secret-source.h>
+#include <bit-babbler/conditioner.h>
+
+
+namespace BitB
+{
+    // The ChaCha20 stream cipher, as specified by RFC 7539, used here only
+    // for its keystream.
+    //{{{
+    // The block function is written to compute LANES consecutive blocks at
+    // once with every operation applied across all of them in an inner loop
+    // over the lanes.  That is trivially vectorisable, and a compiler which
+    // does so (gcc does at -O2 since gcc 12) will turn each quarter round into
+    // a handful of SIMD instructions for whatever vector unit the target has,
+    // without us needing to maintain separate intrinsic implementations for
+    // each of them.  With SSE2 that is about 3 times faster than the scalar
+    // code, and with AVX2 about 5 times.
+    //}}}
+    class ChaCha20
+    { //{{{
+    public:
+
+        static const size_t KEY_BYTES   = 32;
+        static const size_t NONCE_BYTES = 12;
+        static const size_t BLOCK_BYTES = 64;
+        static const size_t LANES       = 8;
+        static const size_t STRIDE      = BLOCK_BYTES * LANES;
+
+
+    private:
+
+        uint32_t    m_state[16];
+
+
+        static uint32_t load32le( const uint8_t *p )
+        {
+            return uint32_t(p[0])       | uint32_t(p[1]) << 8
+                 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+        }
+
+        static void store32le( uint8_t *p, uint32_t v )
+        {
+            p[0] = uint8_t(v);
+            p[1] = uint8_t(v >> 8);
+            p[2] = uint8_t(v >> 16);
+            p[3] = uint8_t(v >> 24);
+        }
+
+        static void QR( uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d )
+        { //{{{
+
+            for( size_t i = 0; i < LANES; ++i )
+            {
+                a[i] += b[i]; d[i] ^= a[i]; d[i] = d[i] << 16 | d[i] >> 16;
+                c[i] += d[i]; b[i] ^= c[i]; b[i] = b[i] << 12 | b[i] >> 20;
+                a[i] += b[i]; d[i] ^= a[i]; d[i] = d[i] << 8  | d[i] >> 24;
+                c[i] += d[i]; b[i] ^= c[i]; b[i] = b[i] << 7  | b[i] >> 25;
+            }
+
+        } //}}}
+
+        // Output the next LANES blocks of keystream to out.
+        void blocks( uint8_t *out )
+        { //{{{
+
+            uint32_t    x[16][LANES];
+
+            for( size_t w = 0; w < 16; ++w )
+                for( size_t i = 0; i < LANES; ++i )
+                    x[w][i] = m_state[w];
+
+            for( size_t i = 0; i < LANES; ++i )
+                x[12][i] += uint32_t(i);
+
+            for( int r = 0; r < 10; ++r )
+            {
+                QR( x[0], x[4], x[8],  x[12] );
+                QR( x[1], x[5], x[9],  x[13] );
+                QR( x[2], x[6], x[10], x[14] );
+                QR( x[3], x[7], x[11], x[15] );
+
+                QR( x[0], x[5], x[10], x[15] );
+                QR( x[1], x[6], x[11], x[12] );
+                QR( x[2], x[7], x[8],  x[13] );
+                QR( x[3], x[4], x[9],  x[14] );
+            }
+
+            for( size_t w = 0; w < 16; ++w )
+                for( size_t i = 0; i < LANES; ++i )
+                    x[w][i] += m_state[w];
+
+            for( size_t i = 0; i < LANES; ++i )
+            {
+                x[12][i] += uint32_t(i);
+
+                for( size_t w = 0; w < 16; ++w )
+                    store32le( out + i * BLOCK_BYTES + w * 4, x[w][i] );
+            }
+
+            m_state[12] += uint32_t(LANES);
+
+        } //}}}
+
+
+    public:
+
+        ChaCha20()
+        {
+            memset( m_state, 0, sizeof(m_state) );
+        }
+
+        ~ChaCha20()
+        {
+            memset( m_state, 0, sizeof(m_state) );
+        }
+
+
+        // Set a new key and nonce, and reset the block counter to 0.
+        void SetKey( const uint8_t *key, const uint8_t *nonce )
+        { //{{{
+
+            m_state[0] = 0x61707865;
+            m_state[1] = 0x3320646e;
+            m_state[2] = 0x79622d32;
+            m_state[3] = 0x6b206574;
+
+            for( size_t i = 0; i < 8; ++i )
+                m_state[4 + i] = load32le( key + i * 4 );
+
+            m_state[12] = 0;
+
+            for( size_t i = 0; i < 3; ++i )
+                m_state[13 + i] = load32le( nonce + i * 4 );
+
+        } //}}}
+
+        // Fill buf with len bytes of keystream.  Output is always generated
+        // in whole strides, so any unused keystream from the last of them is
+        // discarded, and the next call will begin at the following stride.
+        // The block counter is not checked for wrapping, it's up to the caller
+        // to rekey well before 2^32 blocks have been generated with one key.
+        void Keystream( uint8_t *buf, size_t len )
+        { //{{{
+
+            while( len >= STRIDE )
+            {
+                blocks( buf );
+
+                buf += STRIDE;
+                len -= STRIDE;
+            }
+
+            if( len )
+            {
+                uint8_t     tmp[STRIDE];
+
+                blocks( tmp );
+                memcpy( buf, tmp, len );
+                memset( tmp, 0, sizeof(tmp) );
+            }
+
+        } //}}}
+
+    }; //}}}
+
+
+    // A deterministic random bit generator, seeded from the Pool.
+    //{{{
+    // This is for consumers who need random bytes at a rate far beyond what
+    // the hardware can provide, and who would otherwise just be falling back
+    // to some userspace PRNG of their own when we can't keep up with them.
+    // Output is generated from the ChaCha20 keystream, and it is rekeyed from
+    // that keystream again after every request (so that a later compromise of
+    // its state doesn't reveal anything about what it has output previously),
+    // and reseeded with fresh entropy from the Pool after reseed_bytes have
+    // been output, or reseed_time seconds have passed, whichever comes first.
+    //
+    // Each reseed draws at least one whole FIPS block from the Pool, and the
+    // first one draws enough for the FIPS tests to be able to declare it ok,
+    // which they won't do until they've seen 20 consecutive blocks pass.  All
+    // of that draw is passed through our own HealthMonitor, and the key and
+    // nonce are derived from the SHA-256 digest of exactly the data which was
+    // checked, so no output will ever be generated from a seed that was not
+    // seen to pass QA checks.  If the QA is failing, we back off from asking
+    // the Pool for more until it has had some time to recover.  A DRBG has no
+    // internal locking, so it should not be shared between threads.  Each
+    // output endpoint should have its own one.
+    //}}}
+    class DRBG : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< DRBG >      Handle;
+
+        static const size_t SEED_BYTES = ChaCha20::KEY_BYTES + ChaCha20::NONCE_BYTES;
+
+        // The number of bytes drawn from the Pool for each reseed, and for
+        // the first of them, before the FIPS tests can have passed.
+        static const size_t SEED_DRAW       = QA::FIPS::BUFFER_SIZE;
+        static const size_t FIRST_SEED_DRAW = SEED_DRAW * 20;
+
+        // The limit on how long we'll wait between retries while QA fails.
+        static const unsigned MAX_BACKOFF_MS = 10000;
+
+        // Requests larger than this are broken up internally, so that the
+        // key is changed before the block counter could ever wrap.
+        static const size_t MAX_REQUEST = 1024 * 1024 * 1024;
+
+
+        struct Options
+        { //{{{
+
+            size_t      reseed_bytes;   // Max bytes output between reseeding
+            unsigned    reseed_time;    // Max seconds between reseeding
+
+            Options()
+                : reseed_bytes( 1024 * 1024 * 1024 )
+                , reseed_time( 60 )
+            {}
+
+        }; //}}}
+
+
+    private:
+
+        Pool::Handle        m_pool;
+        const Options       m_opt;
+        const std::string   m_id;
+
+        HealthMonitor       m_qa;
+        ChaCha20            m_cipher;
+
+        bool                m_seeded;
+        size_t              m_generated;
+        uint64_t            m_reseed_due;
+        unsigned long long  m_reseeds;
+        unsigned long long  m_bytes;
+
+
+        void rekey( const uint8_t *seed = NULL )
+        { //{{{
+
+            uint8_t     k[ChaCha20::BLOCK_BYTES];
+
+            m_cipher.Keystream( k, sizeof(k) );
+
+            if( seed )
+                for( size_t i = 0; i < SEED_BYTES; ++i )
+                    k[i] ^= seed[i];
+
+            m_cipher.SetKey( k, k + ChaCha20::KEY_BYTES );
+            memset( k, 0, sizeof(k) );
+
+        } //}}}
+
+
+    public:
+
+        DRBG( const Pool::Handle &pool, const std::string &id,
+                                        const Options &options = Options() )
+            : m_pool( pool )
+            , m_opt( options )
+            , m_id( id )
+            , m_qa( "DRBG seed (" + id + ')' )
+            , m_seeded( false )
+            , m_generated( 0 )
+            , m_reseed_due( 0 )
+            , m_reseeds( 0 )
+            , m_bytes( 0 )
+        {
+            Log<2>( "+ DRBG( %s ): reseed every %zu bytes or %us\n",
+                    id.c_str(), m_opt.reseed_bytes, m_opt.reseed_time );
+        }
+
+        ~DRBG()
+        {
+            Log<2>( "- DRBG( %s ): %llu bytes output, %llu reseeds\n",
+                                    m_id.c_str(), m_bytes, m_reseeds );
+        }
+
+
+        const std::string &GetID() const
+        {
+            return m_id;
+        }
+
+        unsigned long long GetReseeds() const
+        {
+            return m_reseeds;
+        }
+
+        unsigned long long GetBytesOutput() const
+        {
+            return m_bytes;
+        }
+
+
+        // Mix fresh entropy from the Pool into the generator state.
+        // This will block until the pool can provide a seed which passes QA.
+        void Reseed()
+        { //{{{
+
+            BufferPool::Buffer  draw( FIRST_SEED_DRAW );
+            size_t              len     = m_seeded ? SEED_DRAW : FIRST_SEED_DRAW;
+            unsigned            backoff = 0;
+
+            for(;;)
+            {
+                for( size_t n = 0; n < len; )
+                    n += m_pool->read( draw + n, len - n );
+
+                if( m_qa.Check( draw, len ) )
+                    break;
+
+                // If it failed, then after the first time keep drawing single
+                // FIPS blocks, since the QA state is cumulative and we only
+                // need to see the next one pass.  But don't hammer the Pool
+                // for more while it's not producing good output, and leave
+                // what there is for anything else which may be using it.
+                len     = SEED_DRAW;
+                backoff = backoff ? std::min( backoff * 2, MAX_BACKOFF_MS ) : 10;
+
+                Log<4>( "DRBG( %s ): seed failed QA, retrying in %ums\n",
+                                                    m_id.c_str(), backoff );
+                usleep( useconds_t(backoff) * 1000 );
+            }
+
+            // Derive the seed from all of the draw which was checked, with
+            // each digest prefixed by its index so they are independent.
+            uint8_t     seed[SHA256::DIGEST_BYTES * 2];
+            SHA256      sha;
+
+            for( uint8_t i = 0; i < 2; ++i )
+            {
+                sha.Update( &i, 1 );
+                sha.Update( draw, len );
+                sha.Final( seed + i * SHA256::DIGEST_BYTES );
+            }
+
+            rekey( seed );
+            memset( seed, 0, sizeof(seed) );
+            memset( draw, 0, draw.Size() );
+
+            m_seeded     = true;
+            m_generated  = 0;
+            m_reseed_due = GetMonotonicUS() + uint64_t(m_opt.reseed_time) * 1000000;
+            ++m_reseeds;
+
+            Log<4>( "DRBG( %s ): reseeded (%llu)\n", m_id.c_str(), m_reseeds );
+
+        } //}}}
+
+        // Fill buf with len bytes of DRBG output.
+        void Generate( uint8_t *buf, size_t len )
+        { //{{{
+
+            while( len )
+            {
+                size_t  n = std::min( len, size_t(MAX_REQUEST) );
+
+                if( ! m_seeded || m_generated >= m_opt.reseed_bytes
+                               || GetMonotonicUS() >= m_reseed_due )
+                    Reseed();
+
+                m_cipher.Keystream( buf, n );
+                rekey();
+
+                m_generated += n;
+                m_bytes     += n;
+                buf         += n;
+                len         -= n;
+            }
+
+        } //}}}
+
+        // Write len bytes of DRBG output to fd, or stream it there
+        // indefinitely if len is 0.
+        void WriteToFD( int fd, size_t len = 0 )
+        { //{{{
+
+            BufferPool::Buffer  buf( 65536 );
+
+            for(;;)
+            {
+                size_t  n = len ? std::min( len, buf.Size() ) : buf.Size();
+
+                Generate( buf, n );
+
+                for( size_t c = n; c; )
+                {
+                    ssize_t w = write( fd, buf + n - c, c );
+
+                    if( w < 0 )
+                        throw SystemError( _("DRBG( %s ): write to fd %d failed"),
+                                                                m_id.c_str(), fd );
+                    if( w == 0 )
+                        throw Error( _("DRBG( %s ): write to fd %d EOF"), m_id.c_str(), fd );
+
+                    c -= size_t(w);
+                }
+
+                if( len && (len -= n) == 0 )
+                    break;
+            }
+
+            memset( buf, 0, buf.Size() );
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Stream DRBG output to a file descriptor from its own thread.
+    class DRBGWriter : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< DRBGWriter >    Handle;
+        typedef void (*Completion)(void *user_data);
+
+
+    private:
+
+        DRBG::Handle        m_drbg;
+        int                 m_fd;
+        size_t              m_len;
+        Completion          m_completion_handler;
+        void               *m_user_data;
+        pthread_t           m_thread;
+
+
+        static void *writer_thread( void *p )
+        { //{{{
+
+            DRBGWriter  *w = static_cast<DRBGWriter*>( p );
+
+            SetThreadName( "DRBG out" );
+
+            try {
+                try {
+                    w->m_drbg->WriteToFD( w->m_fd, w->m_len );
+
+                    Log<3>( "DRBGWriter( %d ): completed\n", w->m_fd );
+                }
+                catch( const abi::__forced_unwind& )
+                {
+                    Log<3>( "DRBGWriter( %d ): cancelled\n", w->m_fd );
+                    throw;
+                }
+                BB_CATCH_STD( 0, _("uncaught DRBGWriter::writer_thread exception") )
+
+                if( w->m_completion_handler )
+                    w->m_completion_handler( w->m_user_data );
+            }
+            catch( const abi::__forced_unwind& )
+            {
+                Log<3>( "DRBGWriter( %d ): cancelled\n", w->m_fd );
+                throw;
+            }
+            BB_CATCH_STD( 0, _("uncaught DRBGWriter::writer_thread completion exception") )
+
+            return NULL;
+
+        } //}}}
+
+
+    public:
+
+        DRBGWriter( const Pool::Handle &pool, const DRBG::Options &options,
+                    int fd, size_t len = 0, Completion handler = NULL,
+                                            void *user_data = NULL )
+            : m_drbg( new DRBG( pool, stringprintf("fd %d", fd), options ) )
+            , m_fd( fd )
+            , m_len( len )
+            , m_completion_handler( handler )
+            , m_user_data( user_data )
+        { //{{{
+
+            Log<2>( "+ DRBGWriter( %d, %zu )\n", fd, len );
+
+            int ret = pthread_create( &m_thread, GetDefaultThreadAttr(), writer_thread, this );
+            if( ret )
+                throw SystemError( ret, _("DRBGWriter( %d ): failed to create thread"), fd );
+
+        } //}}}
+
+        ~DRBGWriter()
+        { //{{{
+
+            Log<2>( "- DRBGWriter( %d )\n", m_fd );
+
+            pthread_cancel( m_thread );
+            pthread_join( m_thread, NULL );
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_DRBG_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
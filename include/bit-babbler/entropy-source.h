@@ -0,0 +1,185 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_ENTROPY_SOURCE_H
+#define _BB_ENTROPY_SOURCE_H
+
+#include <bit-babbler/usbcontext.h>
+#include <bit-babbler/conditioner.h>
+
+
+namespace BitB
+{
+    // The interface to something that the Pool can read entropy from.
+    //{{{
+    // Each source added to the Pool gets its own thread, which will read blocks
+    // of raw bits from it, fold them, pass them through its QA checks, and mix
+    // those which pass into the pool group it was assigned to.  While the pool
+    // is full, that thread will back off reading it according to the idle-sleep
+    // parameters, and may release the source for a time if it wants to allow
+    // it to be suspended.  Things other than a BitBabbler which can provide us
+    // with random bits can implement this to be fed through that same process.
+    //}}}
+    class EntropySource : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< EntropySource >     Handle;
+
+
+        // How many failed reads were recovered from, by each method.
+        struct RecoveryCounts
+        { //{{{
+
+            unsigned    resync;     // By resynchronising the data stream
+            unsigned    reinit;     // By reinitialising the source
+            unsigned    reset;      // By resetting the device
+            unsigned    failed;     // Attempts which failed to recover it
+
+            RecoveryCounts()
+                : resync( 0 )
+                , reinit( 0 )
+                , reset( 0 )
+                , failed( 0 )
+            {}
+
+        }; //}}}
+
+
+        EntropySource() {}
+        virtual ~EntropySource() {}
+
+
+        // An identifier for this source, used in log messages and QA reports.
+        virtual const std::string &GetID() const = 0;
+
+        // Prepare the source for reading.  This will be called before read()
+        // when the source thread is first started, and again before resuming
+        // if it was released while idle or to recover from an error.
+        virtual bool Claim() { return true; }
+
+        // Allow the source to enter a low power state.  This will only be
+        // called when the thread expects to be idle for at least the time
+        // that was returned by GetSuspendAfter().
+        virtual void Release() {}
+
+        // Return true if Claim() was called and the source was not yet released.
+        virtual bool IsClaimed() const { return true; }
+
+        // The preferred number of bytes to request from read() in one call.
+        virtual size_t GetChunkSize() const = 0;
+
+        // The number of times that output should be folded before QA checking.
+        virtual unsigned GetFolding() const { return 0; }
+
+        // The bounds within which folding may be adjusted automatically from
+        // the measured min-entropy.  If they are equal, it will never change.
+        virtual unsigned GetMinFolding() const { return GetFolding(); }
+        virtual unsigned GetMaxFolding() const { return GetFolding(); }
+
+        // The rate in bits per second that a source is currently clocked at,
+        // and the bounds within which it may be adjusted automatically from
+        // the measured min-entropy, using SetBitrate().  As with folding, if
+        // the bounds are equal, it will never be changed.
+        virtual unsigned GetBitrate() const    { return 0; }
+        virtual unsigned GetMinBitrate() const { return GetBitrate(); }
+        virtual unsigned GetMaxBitrate() const { return GetBitrate(); }
+        virtual void SetBitrate( unsigned bitrate ) { (void)bitrate; }
+
+        // If set, output will be conditioned at this ratio instead of folded.
+        virtual Conditioner::Ratio GetConditioning() const { return Conditioner::Ratio(); }
+
+        // The initial and maximum time (in ms) to sleep when the pool is full,
+        // with the special meanings for 0 described for the idle-sleep option.
+        virtual unsigned GetIdleSleepInit() const { return 100; }
+        virtual unsigned GetIdleSleepMax() const  { return 60000; }
+
+        // The minimum idle time (in ms) that we should Release() the source for.
+        // If this is 0, then the source will never be released while idle.
+        virtual unsigned GetSuspendAfter() const { return 0; }
+
+        // Return true if blocks which fail QA should be passed to the pool.
+        virtual bool NoQA() const { return false; }
+
+        // Return true if this source should only contribute to its group while
+        // some other (non-standby) source in the same group is not providing
+        // good entropy.  Otherwise it will be held released until it's needed.
+        virtual bool IsStandby() const { return false; }
+
+        // Return true if the source can be considered good without waiting
+        // for the first Ent8 test results to become available.
+        virtual bool AssumeEnt8OK() const { return true; }
+
+        // An identifier for the USB bus which this source is read through.
+        // Reads from sources on the same bus will be scheduled so that they
+        // don't oversubscribe it.  If empty, reads are never held back.
+        virtual std::string GetBusID() const { return std::string(); }
+
+        // Return true if this source is provided by USB device d.
+        virtual bool IsDevice( const USBContext::Device::Handle &d ) const
+        {
+            (void)d;
+            return false;
+        }
+
+
+        // Read exactly len bytes into buf, or throw if that isn't possible.
+        virtual size_t read( uint8_t *buf, size_t len ) = 0;
+
+        // Called when read() throws, to try to bring the source back into
+        // a usable state.  If this returns false, the exception will not be
+        // considered recoverable and the source thread will be terminated.
+        // If it returns true, delay may be set to the time in milliseconds
+        // that the pool should wait before trying to Claim() it again.
+        virtual bool Recover( const std::exception &e, unsigned &delay )
+        {
+            (void)e;
+            (void)delay;
+            return false;
+        }
+
+        // Return the number of times that read() failures were recovered from.
+        virtual RecoveryCounts GetRecoveryCounts() const { return RecoveryCounts(); }
+
+
+        template< int N >
+        BB_PRINTF_FORMAT(2,3)
+        void LogMsg( const char *format, ... ) const
+        { //{{{
+
+            va_list         arglist;
+            std::string     msg( GetID() );
+
+            va_start( arglist, format );
+            msg.append( ": " )
+               .append( vstringprintf( format, arglist ) );
+            va_end( arglist );
+
+            Log<N>( "%s\n", msg.c_str() );
+
+        } //}}}
+
+        BB_PRINTF_FORMAT(2,3)
+        std::string MsgStr( const char *format, ... ) const
+        { //{{{
+
+            va_list         arglist;
+            std::string     msg( GetID() );
+
+            va_start( arglist, format );
+            msg.append( ": " )
+               .append( vstringprintf( format, arglist ) );
+            va_end( arglist );
+
+            return msg;
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_ENTROPY_SOURCE_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -5,6 +5,8 @@
 #define _BB_FTDI_DEVICE_H
 
 #include <bit-babbler/usbcontext.h>
+#include <bit-babbler/stage-profile.h>
+#include <bit-babbler/buffer-pool.h>
 
 
 #define FTDI_VENDOR_ID      0x0403
@@ -193,6 +195,7 @@ namespace BitB
         USBContext::Device::Open::Handle    m_dh;
 
         unsigned                            m_timeout;
+        unsigned                            m_xfer_timeout;     // For bulk transfers
         unsigned                            m_latency;
         unsigned                            m_maxpacket;
 
@@ -208,7 +211,9 @@ namespace BitB
         size_t                              m_chunksize;
         size_t                              m_chunkhead;
         size_t                              m_chunklen;
-        uint8_t                            *m_chunkbuf;
+        uint8_t                            *m_chunkbuf;     // Either m_heapbuf or m_devmem
+        BufferPool::Buffer                  m_heapbuf;
+        uint8_t                            *m_devmem;
 
         uint8_t                             m_expect_modemstatus;
 
@@ -369,9 +374,11 @@ namespace BitB
                 pthread_testcancel();
                 pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &oldstate );
 
+                StageProfile::Timer t( StageProfile::USB );
+
                 int xfer;
                 int n   = int(std::min( len, m_chunksize ));
-                int ret = libusb_bulk_transfer( *m_dh, m_epout, b, n, &xfer, m_timeout );
+                int ret = libusb_bulk_transfer( *m_dh, m_epout, b, n, &xfer, m_xfer_timeout );
 
                 pthread_setcancelstate( oldstate, NULL );
 
@@ -384,6 +391,11 @@ namespace BitB
                         if( __builtin_expect(xfer < 0 || size_t(xfer) > len,0) )
                             ThrowError( _("FTDI: OOPS write of %d returned %d ..."), n, xfer );
 
+                        // If the device isn't accepting anything at all, waiting
+                        // longer isn't going to help, let the caller recover it.
+                        if( __builtin_expect(xfer == 0 && ret == LIBUSB_ERROR_TIMEOUT, 0) )
+                            ThrowUSBError( ret, _("FTDI: write of %d/%zu bytes timed out"), n, len );
+
                         len -= unsigned(xfer);
                         b   += xfer;
                         break;
@@ -420,7 +432,11 @@ namespace BitB
             pthread_testcancel();
             pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &oldstate );
 
-            int ret = libusb_bulk_transfer( *m_dh, m_epin, buf, n, &xfer, m_timeout );
+            int ret;
+            {
+                StageProfile::Timer t( StageProfile::USB );
+                ret = libusb_bulk_transfer( *m_dh, m_epin, buf, n, &xfer, m_xfer_timeout );
+            }
 
             pthread_setcancelstate( oldstate, NULL );
 
@@ -452,7 +468,8 @@ namespace BitB
         size_t ftdi_read( uint8_t *buf, size_t len )
         { //{{{
 
-            size_t  r = 0;
+            StageProfile::Timer t( StageProfile::DEFRAME );
+            size_t              r = 0;
 
             while( len )
             {
@@ -646,6 +663,63 @@ namespace BitB
 
     private:
 
+        // Read chunks into memory mapped from the kernel, if we can.
+        //{{{
+        // With usbfs on Linux 4.6 or later, libusb can allocate buffers for
+        // transfers which are mapped from the kernel's own memory, so that the
+        // data read from the device no longer needs to be copied out from a
+        // kernel buffer into ours for every transfer, leaving stripping the
+        // modem status bytes in ftdi_read() as the only copy of it we make.
+        // That memory belongs to the open device handle, so it must be freed
+        // before the handle is released.  If it can't be allocated, chunks are
+        // just read into our own heap buffer instead.
+        //}}}
+        void alloc_devmem()
+        { //{{{
+
+           #if HAVE_LIBUSB_DEV_MEM_ALLOC
+
+            if( m_devmem || m_dh == NULL || m_chunksize == 0 )
+                return;
+
+            m_devmem = libusb_dev_mem_alloc( *m_dh, m_chunksize );
+
+            if( m_devmem )
+            {
+                LogMsg<3>( "FTDI: using %zu bytes of device memory for transfers", m_chunksize );
+
+                m_chunkbuf  = m_devmem;
+                m_chunkhead = 0;
+                m_chunklen  = 0;
+            }
+            else
+                LogMsg<3>( "FTDI: device memory is not available for transfers" );
+
+           #endif
+
+        } //}}}
+
+        // This must be called while m_dh is still valid, before releasing it.
+        void free_devmem()
+        { //{{{
+
+           #if HAVE_LIBUSB_DEV_MEM_ALLOC
+
+            if( ! m_devmem )
+                return;
+
+            libusb_dev_mem_free( *m_dh, m_devmem, m_chunksize );
+
+            m_devmem    = NULL;
+            m_chunkbuf  = m_heapbuf;
+            m_chunkhead = 0;
+            m_chunklen  = 0;
+
+           #endif
+
+        } //}}}
+
+
         // Returns true if initial FTDI communication is successful
         bool check_sync( uint8_t cmd )
         { //{{{
@@ -770,16 +844,16 @@ namespace BitB
 
             if( chunksize != m_chunksize )
             {
-                if( m_chunkbuf )
-                {
-                    delete [] m_chunkbuf;
-                    m_chunkbuf = NULL;      // Just in case new throws ...
-                }
+                free_devmem();
 
-                m_chunkbuf  = new uint8_t[chunksize];
+                m_chunkbuf  = NULL;     // Just in case Reset throws ...
+                m_heapbuf.Reset( chunksize );
+                m_chunkbuf  = m_heapbuf;
                 m_chunksize = chunksize;
                 m_chunkhead = 0;
                 m_chunklen  = 0;
+
+                alloc_devmem();
             }
 
             return m_chunksize;
@@ -815,6 +889,68 @@ namespace BitB
         } //}}}
 
 
+        // Set the timeout in milliseconds for bulk data transfers.
+        //{{{
+        // This should be long enough for the largest chunk that will be read
+        // to be transferred at the rate it is being clocked out of the device,
+        // with some margin for the latency timer and the scheduling of the bus,
+        // but shorter than that just means that we won't wait as long before
+        // deciding that a device which has stopped responding has a problem.
+        //}}}
+        void SetTransferTimeout( unsigned ms )
+        {
+            m_xfer_timeout = ms;
+        }
+
+        unsigned GetTransferTimeout() const
+        {
+            return m_xfer_timeout;
+        }
+
+        // Check quickly that we are still in sync with the MPSSE command processor.
+        //{{{
+        // This discards anything which is still waiting to be read (both in our
+        // own buffer and on the chip), then checks that bad commands are echoed
+        // as expected, without resetting the chip or changing any of its state,
+        // so it only takes as long as a few packets do to arrive.  Bulk transfers
+        // will time out after timeout milliseconds while this is running.  If it
+        // returns false, the chip needs to be reinitialised.
+        //}}}
+        bool Resync( unsigned timeout )
+        { //{{{
+
+            if( ! m_dh )
+                return false;
+
+            struct RestoreTimeout
+            {
+                unsigned   &t;
+                unsigned    old;
+
+                RestoreTimeout( unsigned &timeout, unsigned ms )
+                    : t( timeout )
+                    , old( timeout )
+                {
+                    t = ms;
+                }
+
+                ~RestoreTimeout()
+                {
+                    t = old;
+                }
+
+            } restore( m_xfer_timeout, std::min( timeout, m_xfer_timeout ) );
+
+            m_chunkhead = 0;
+            m_chunklen  = 0;
+
+            purge_read();
+
+            return check_sync(0xAA) && check_sync(0xAB);
+
+        } //}}}
+
+
         // Put the chip into MPSSE mode
         bool InitMPSSE()
         { //{{{
@@ -872,6 +1008,7 @@ namespace BitB
         FTDI( const USBContext::Device::Handle &dev, bool claim_now = true )
             : m_dev( dev )
             , m_timeout( 5000 )         // milliseconds
+            , m_xfer_timeout( 5000 )
             , m_latency( 1 )
             , m_index( FTDI_INTERFACE_A )
             , m_configuration( 1 )      // bConfigurationValue
@@ -882,6 +1019,7 @@ namespace BitB
             , m_chunkhead( 0 )
             , m_chunklen( 0 )
             , m_chunkbuf( NULL )
+            , m_devmem( NULL )
         { //{{{
 
             LogMsg<2>( "+ FTDI" );
@@ -941,9 +1079,6 @@ namespace BitB
 
             Release();
 
-            if( m_chunkbuf )
-                delete [] m_chunkbuf;
-
         } //}}}
 
 
@@ -974,6 +1109,7 @@ namespace BitB
             }
             catch( ... )
             {
+                free_devmem();
                 m_dh = NULL;
                 throw;
             }
@@ -1009,6 +1145,7 @@ namespace BitB
                 if( m_altsetting )
                     m_dh->SetAltInterface( m_interface, m_altsetting );
 
+                alloc_devmem();
                 return true;
             }
             catch( ... )
@@ -1027,6 +1164,7 @@ namespace BitB
         //}}}
         virtual void Release()
         {
+            free_devmem();
             m_dh = NULL;
         }
 
@@ -1083,6 +1221,11 @@ namespace BitB
             return m_dev->GetSerial();
         }
 
+        unsigned GetBusNumber() const
+        {
+            return m_dev->GetBusNumber();
+        }
+
 
         std::string ProductStr() const
         {
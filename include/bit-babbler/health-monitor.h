@@ -8,6 +8,7 @@
 #define _BB_HEALTH_MONITOR_H
 
 #include <bit-babbler/qa.h>
+#include <bit-babbler/stage-profile.h>
 
 #include <list>
 
@@ -17,6 +18,30 @@ namespace BitB
 
     class Monitor
     { //{{{
+    public:
+
+        // A copy of the current state of a monitor, which can be published
+        // without holding any lock on the monitor itself.
+        struct Snapshot
+        { //{{{
+
+            typedef std::list< Snapshot >   List;
+
+            std::string         id;
+            unsigned long long  bytes_analysed;
+            unsigned long long  bytes_passed;
+            bool                fips_ok;
+            bool                ent8_ok;
+            bool                ent16_ok;
+            bool                bias_ok;
+            bool                have_ent8;      // The ent8 result is valid
+            bool                have_ent16;     // The ent16 result is valid
+            QA::Ent8::Result    ent8;           // The current short term result
+            QA::Ent16::Result   ent16;          // The current short term result
+
+        }; //}}}
+
+
     private:
 
         typedef std::list< Monitor* >   List;
@@ -34,6 +59,7 @@ namespace BitB
 
         virtual std::string ReportJSON() const = 0;
         virtual std::string RawDataJSON() const = 0;
+        virtual void GetSnapshot( Snapshot &s ) const = 0;
 
 
     public:
@@ -140,6 +166,24 @@ namespace BitB
 
         } //}}}
 
+        static Snapshot::List GetSnapshots()
+        { //{{{
+
+            ScopedMutex     lock( &ms_mutex );
+            Snapshot::List  l;
+
+            for( Monitor::List::iterator i = ms_list.begin(),
+                                         e = ms_list.end(); i != e; ++i )
+            {
+                l.push_back( Snapshot() );
+                l.back().id = (*i)->m_id;
+                (*i)->GetSnapshot( l.back() );
+            }
+
+            return l;
+
+        } //}}}
+
     }; //}}}
 
 
@@ -158,10 +202,12 @@ namespace BitB
         QA::FIPS                    m_fips;
         QA::Ent8                    m_ent;
         QA::Ent16                   m_ent16;
+        QA::BitBias                 m_bias;
 
         bool                        m_fips_ok;
         bool                        m_ent_ok;
         bool                        m_ent16_ok;
+        bool                        m_bias_ok;
 
 
         // You must hold m_mutex when calling this
@@ -186,6 +232,7 @@ namespace BitB
             , m_fips_ok( false )
             , m_ent_ok( assume_ent8_ok )
             , m_ent16_ok( true )
+            , m_bias_ok( true )
         { //{{{
 
             // We assume the results are not ok until we have some positive
@@ -210,6 +257,10 @@ namespace BitB
             // passes (by the more restrictive recovery margin), and we let
             // the Ent16 test just be a sanity check for long term abnormal
             // behaviour that may be evident in the larger sample space.
+            //
+            // The BitBias test gets its first result after 128kB, so it is
+            // also assumed to be ok until it shows otherwise, but will catch
+            // a failure in a single bit lane sooner than the Ent8 test can.
 
             Log<2>( "+ HealthMonitor( %s )\n", GetID().c_str() );
 
@@ -235,8 +286,18 @@ namespace BitB
             ScopedMutex     lock( &m_mutex );
             size_t          b = len;
 
-            m_ent.Analyse( buf, len );
-            m_ent16.Analyse( buf, len );
+            {
+                StageProfile::Timer t( StageProfile::QA_ENT8 );
+                m_ent.Analyse( buf, len );
+            }
+            {
+                StageProfile::Timer t( StageProfile::QA_ENT16 );
+                m_ent16.Analyse( buf, len );
+            }
+            {
+                StageProfile::Timer t( StageProfile::QA_BIAS );
+                m_bias.Analyse( buf, len );
+            }
 
             if( m_ent.HaveResults() )
                 m_ent_ok = m_ent.IsOk( m_ent_ok );
@@ -244,6 +305,11 @@ namespace BitB
             if( m_ent16.HaveResults() )
                 m_ent16_ok = m_ent16.IsOk( m_ent16_ok );
 
+            if( m_bias.HaveResults() )
+                m_bias_ok = m_bias.IsOk( m_bias_ok );
+
+
+            StageProfile::Timer t( StageProfile::QA_FIPS );
 
             if( m_fipsextra )
             {
@@ -283,7 +349,13 @@ namespace BitB
 
             m_bytes_analysed += b;
 
-            if( m_ent_ok && m_ent16_ok && m_fips_ok )
+            bool    ok = m_ent_ok && m_ent16_ok && m_bias_ok && m_fips_ok;
+
+            BB_TRACE4( qa__check, GetID().c_str(), b, ok,
+                       (m_fips_ok ? 0 : 1) | (m_ent_ok ? 0 : 2) | (m_ent16_ok ? 0 : 4) |
+                       (m_bias_ok ? 0 : 8) );
+
+            if( ok )
             {
                 m_bytes_passed += b;
                 return true;
@@ -294,6 +366,33 @@ namespace BitB
         } //}}}
 
 
+        // A snapshot of the min-entropy measured by the Ent tests.
+        struct MinEntropy
+        { //{{{
+
+            unsigned long long  results;    // Number of Ent8 results seen so far
+            bool                ent8_ok;
+            bool                ent16_ok;
+            double              ent8_short; // Bits per 8-bit sample
+
+        }; //}}}
+
+        MinEntropy GetMinEntropy() const
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+            MinEntropy      m;
+
+            m.results    = m_ent.HaveResults() ? m_ent.LongTermData().fail.tested : 0;
+            m.ent8_ok    = m_ent_ok;
+            m.ent16_ok   = m_ent16_ok;
+            m.ent8_short = m_ent.ShortTermData().result[QA::Ent8::CURRENT].minentropy;
+
+            return m;
+
+        } //}}}
+
+
         virtual std::string ReportJSON() const
         { //{{{
 
@@ -308,6 +407,9 @@ namespace BitB
             if( m_ent16.HaveResults() )
                 report += ',' + m_ent16.ResultsAsJSON();
 
+            if( m_bias.HaveResults() )
+                report += ',' + m_bias.ResultsAsJSON();
+
             return report + '}';
 
         } //}}}
@@ -330,6 +432,28 @@ namespace BitB
 
         } //}}}
 
+        virtual void GetSnapshot( Snapshot &s ) const
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+
+            s.bytes_analysed = m_bytes_analysed;
+            s.bytes_passed   = m_bytes_passed;
+            s.fips_ok        = m_fips_ok;
+            s.ent8_ok        = m_ent_ok;
+            s.ent16_ok       = m_ent16_ok;
+            s.bias_ok        = m_bias_ok;
+            s.have_ent8      = m_ent.HaveResults();
+            s.have_ent16     = m_ent16.HaveResults();
+
+            if( s.have_ent8 )
+                s.ent8 = m_ent.ShortTermData().result[QA::Ent8::CURRENT];
+
+            if( s.have_ent16 )
+                s.ent16 = m_ent16.ShortTermData().result[QA::Ent16::CURRENT];
+
+        } //}}}
+
     }; //}}}
 
 }   // BitB namespace
@@ -0,0 +1,24 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+//
+// This file provides the implementation detail for bit-babbler/buffer-pool.h
+// which must be defined only once in an application.
+
+#ifdef _BBIMPL_BUFFER_POOL_H
+#error bit-babbler/impl/buffer-pool.h must be included only once.
+#endif
+
+#define _BBIMPL_BUFFER_POOL_H
+
+#include <bit-babbler/buffer-pool.h>
+
+namespace BitB
+{
+    BufferPool::SizeClass   BufferPool::ms_class[BufferPool::CLASS_COUNT];
+    pthread_mutex_t         BufferPool::ms_mutex = PTHREAD_MUTEX_INITIALIZER;
+    bool                    BufferPool::ms_hugepages = false;
+    size_t                  BufferPool::ms_bytes_in_use = 0;
+    size_t                  BufferPool::ms_bytes_cached = 0;
+}
+
+// vi:sts=4:sw=4:et:foldmethod=marker
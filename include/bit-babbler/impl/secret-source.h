@@ -0,0 +1,21 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+//
+// This file provides the implementation detail for bit-babbler/secret-source.h
+// which must be defined only once in an application.
+
+#ifdef _BBIMPL_SECRET_SOURCE_H
+#error bit-babbler/impl/secret-source.h must be included only once.
+#endif
+
+#define _BBIMPL_SECRET_SOURCE_H
+
+#include <bit-babbler/secret-source.h>
+
+namespace BitB
+{
+    Pool::List          Pool::ms_pools;
+    pthread_mutex_t     Pool::ms_pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+}
+
+// vi:sts=4:sw=4:et:foldmethod=marker
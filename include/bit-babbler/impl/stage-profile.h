@@ -0,0 +1,23 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+//
+// This file provides the implementation detail for bit-babbler/stage-profile.h
+// which must be defined only once in an application.
+
+#ifdef _BBIMPL_STAGE_PROFILE_H
+#error bit-babbler/impl/stage-profile.h must be included only once.
+#endif
+
+#define _BBIMPL_STAGE_PROFILE_H
+
+#include <bit-babbler/stage-profile.h>
+
+namespace BitB
+{
+    StageProfile::List      StageProfile::ms_list;
+    pthread_mutex_t         StageProfile::ms_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_key_t           StageProfile::ms_key;
+    pthread_once_t          StageProfile::ms_once = PTHREAD_ONCE_INIT;
+}
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -52,6 +52,7 @@
 
 
 #include <sys/time.h>
+#include <time.h>
 #include <stdint.h>
 
 
@@ -305,6 +306,30 @@ namespace BitB
 
     } //}}}
 
+    // Return a time in microseconds, relative to some arbitrary fixed point.
+    // This is only useful for measuring intervals, it is not a wall time.
+    static inline uint64_t GetMonotonicUS()
+    { //{{{
+
+      #if HAVE_CLOCK_GETTIME
+
+        timespec    t;
+
+        if( clock_gettime( CLOCK_MONOTONIC, &t ) == -1 )
+            throw Error( _("clock_gettime() failed") );
+
+        return uint64_t(t.tv_sec) * 1000000 + uint64_t(t.tv_nsec) / 1000;
+
+      #else
+
+        timeval     t = GetWallTimeval();
+
+        return uint64_t(t.tv_sec) * 1000000 + uint64_t(t.tv_usec);
+
+      #endif
+
+    } //}}}
+
     // And we use the gnu_strftime checking here because otherwise it will warn
     // about using %T and %F (which we do use, and which the msvcrt.dll does not
     // implement), but timeprintf will convert them to equivalents it is ok with
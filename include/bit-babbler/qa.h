@@ -14,6 +14,7 @@
 #include <bit-babbler/chisq.h>
 #include <bit-babbler/math.h>
 #include <bit-babbler/aligned_recast.h>
+#include <bit-babbler/tracepoints.h>
 
 #include <vector>
 #include <algorithm>
@@ -32,6 +33,8 @@ namespace BitB
         if( len & ((1u << folds) - 1) )
             throw Error( _("FoldBytes: length %zu cannot fold %u times"), len, folds );
 
+        BB_TRACE3( fold__start, buf, len, folds );
+
         for( ; folds; --folds )
         {
             len >>= 1;
@@ -40,6 +43,8 @@ namespace BitB
                 buf[i] ^= buf[len + i];
         }
 
+        BB_TRACE2( fold__done, buf, len );
+
         return len;
 
     } //}}}
@@ -1392,6 +1397,504 @@ namespace BitB
     typedef Ent<uint16_t>   Ent16;
 
 
+    // Counts the number of ones seen in each bit position of 16-bit samples.
+    // A source which is failing in a way that biases one bit position (such
+    // as one stage of a generator stuck or sampled on the wrong edge) will
+    // show up here as a large error in that lane long before it has moved the
+    // Ent8 mean or Chi^2 results enough to fail them, and the lane which is
+    // failing points to where the fault is.  Bit b of each byte is counted in
+    // lane b of one byte of the sample and lane b + 8 of the other, so the
+    // bias of each bit position in a byte is also reported, independently of
+    // the byte order of the machine.  The short term results are tested for
+    // both the Chi^2 of each lane and the sum over all lanes.  The long term
+    // result is tested for the absolute bias of the worst lane, once enough
+    // samples have been seen for it to be measured with sufficient precision.
+    class BitBias
+    { //{{{
+    public:
+
+        static const unsigned   LANES = 16;
+
+
+        struct Limits
+        { //{{{
+
+            size_t      long_minsamples;
+            double      long_bias;
+
+            double      short_lane_chisq;
+            double      short_chisq_min;
+            double      short_chisq_max;
+
+            unsigned    recovery_blocks;
+
+        }; //}}}
+
+        struct Result
+        { //{{{
+
+            size_t  samples;
+            size_t  ones[LANES];
+
+
+            Result()
+                : samples( 0 )
+            {
+                memset( ones, 0, sizeof(ones) );
+            }
+
+            Result( const Json::Data::Handle &result )
+                : samples( result["Samples"]->As<size_t>() )
+            { //{{{
+
+                Json::Data::Handle  lanes = result["Ones"];
+
+                if( lanes->GetArraySize() != LANES )
+                    throw Error( _("BitBias::Result: invalid json with %zu lanes"),
+                                                                lanes->GetArraySize() );
+
+                for( unsigned i = 0; i < LANES; ++i )
+                    ones[i] = lanes[i]->As<size_t>();
+
+            } //}}}
+
+
+            void clear()
+            {
+                samples = 0;
+                memset( ones, 0, sizeof(ones) );
+            }
+
+            Result &operator+=( const Result &r )
+            {
+                samples += r.samples;
+
+                for( unsigned i = 0; i < LANES; ++i )
+                    ones[i] += r.ones[i];
+
+                return *this;
+            }
+
+
+            // The proportion of ones in lane l, less the 0.5 that is expected.
+            double LaneBias( unsigned l ) const
+            {
+                return samples ? double(ones[l]) / double(samples) - 0.5 : 0.0;
+            }
+
+            // The Chi^2 of lane l, with 1 degree of freedom.
+            double LaneChisq( unsigned l ) const
+            { //{{{
+
+                if( ! samples )
+                    return 0.0;
+
+                double  d = 2.0 * double(ones[l]) - double(samples);
+
+                return d * d / double(samples);
+
+            } //}}}
+
+            // The proportion of ones in bit b of each byte, less 0.5.
+            double ByteBias( unsigned b ) const
+            {
+                return samples ? double(ones[b] + ones[b + 8]) / double(2 * samples) - 0.5
+                               : 0.0;
+            }
+
+            // The sum of the Chi^2 for every lane, with LANES degrees of freedom.
+            double Chisq() const
+            { //{{{
+
+                double  c = 0.0;
+
+                for( unsigned i = 0; i < LANES; ++i )
+                    c += LaneChisq( i );
+
+                return c;
+
+            } //}}}
+
+            double ChisqProb() const
+            {
+                return pochisq( Chisq(), LANES );
+            }
+
+            // The lane with the largest absolute bias.
+            unsigned WorstLane() const
+            { //{{{
+
+                unsigned    w = 0;
+
+                for( unsigned i = 1; i < LANES; ++i )
+                    if( fabs(LaneBias(i)) > fabs(LaneBias(w)) )
+                        w = i;
+
+                return w;
+
+            } //}}}
+
+
+            std::string Report() const
+            { //{{{
+
+                unsigned        w = WorstLane();
+                std::string     s = stringprintf( "χ² %f (%.2f), worst lane %u (% .6f),"
+                                                  " bits 0-7:",
+                                                  Chisq(), ChisqProb(), w, LaneBias(w) );
+                for( unsigned b = 0; b < 8; ++b )
+                    s += stringprintf( " % .6f", ByteBias(b) );
+
+                return s;
+
+            } //}}}
+
+            std::string AsJSON() const
+            { //{{{
+
+                unsigned        w = WorstLane();
+                std::string     s = stringprintf( "{\"Samples\":%zu,\"Ones\":[", samples );
+
+                for( unsigned i = 0; i < LANES; ++i )
+                {
+                    if( i )
+                        s += ',';
+
+                    s += stringprintf( "%zu", ones[i] );
+                }
+
+                s += stringprintf( "],\"Chisq\":%f"
+                                    ",\"Chisq-p\":%f"
+                                    ",\"WorstLane\":%u"
+                                    ",\"WorstBias\":%f"
+                                   "}",
+                                   Chisq(), ChisqProb(), w, LaneBias(w) );
+                return s;
+
+            } //}}}
+
+        }; //}}}
+
+        struct Fail
+        { //{{{
+
+            size_t  tested;
+
+            size_t  lane;
+            size_t  chisq;
+            size_t  bias;
+
+
+            Fail()
+                : tested( 0 )
+                , lane( 0 )
+                , chisq( 0 )
+                , bias( 0 )
+            {}
+
+            Fail( const Json::Data::Handle &fail )
+                : tested( fail["Tested"]->As<size_t>() )
+                , lane(   fail["Lane"]->As<size_t>() )
+                , chisq(  fail["Chisq"]->As<size_t>() )
+                , bias(   fail["Bias"]->As<size_t>() )
+            {}
+
+
+            std::string Report() const
+            {
+                return stringprintf( "Tested %zu, Lane %zu, χ² %zu, Bias %zu",
+                                     tested, lane, chisq, bias );
+            }
+
+            std::string AsJSON() const
+            {
+                return stringprintf( "{\"Tested\":%zu,\"Lane\":%zu,\"Chisq\":%zu,\"Bias\":%zu}",
+                                     tested, lane, chisq, bias );
+            }
+
+        }; //}}}
+
+        struct Data
+        { //{{{
+
+            Result  result;
+            Fail    fail;
+
+
+            Data() {}
+
+            Data( const Json::Data::Handle &data )
+                : result( data["Result"] )
+                , fail( data["Failed"] )
+            {}
+
+
+            std::string Report() const
+            {
+                return stringprintf( "Samples: %zu, ", result.samples ) + result.Report()
+                     + "\nFailure: " + fail.Report();
+            }
+
+            std::string AsJSON() const
+            {
+                return "{\"Result\":" + result.AsJSON() + ",\"Failed\":" + fail.AsJSON() + '}';
+            }
+
+        }; //}}}
+
+
+    private:
+
+        // The most words that can be counted before a 16-bit field of the
+        // vertical accumulators in count() could overflow.
+        static const size_t     ACCUMULATE_MAX = 65535;
+
+        size_t      m_short_len;
+
+        Data        m_short;
+        Data        m_previous_short;
+        Data        m_long;
+
+        bool        m_have_results;
+        bool        m_have_unchecked_results;
+        size_t      m_ok_wait;
+
+
+        // Count the ones in each lane of the 16-bit samples in buf, which must
+        // be an even number of bytes.  This uses vertical counters, with each
+        // 64-bit word holding four samples, and each lane having a 64-bit
+        // accumulator with four 16-bit fields.  Bit l of every sample in the
+        // word is added to its own field of acc[l] with one shift, mask, and
+        // add, and none of the lanes depend on each other, so the compiler can
+        // vectorise the inner loop into wide SIMD adds where it is able to.
+        // The fields are summed into the result before they can overflow.
+        void count( const uint8_t *buf, size_t len )
+        { //{{{
+
+            Result     &r = m_short.result;
+            size_t      words = len / sizeof(uint64_t);
+
+            while( words )
+            {
+                size_t      n = std::min( words, ACCUMULATE_MAX );
+                uint64_t    acc[LANES];
+
+                memset( acc, 0, sizeof(acc) );
+
+                for( size_t i = 0; i < n; ++i, buf += sizeof(uint64_t) )
+                {
+                    uint64_t    w;
+
+                    memcpy( &w, buf, sizeof(w) );
+
+                    for( unsigned l = 0; l < LANES; ++l )
+                        acc[l] += (w >> l) & 0x0001000100010001ULL;
+                }
+
+                for( unsigned l = 0; l < LANES; ++l )
+                    r.ones[l] += size_t( (acc[l]       & 0xffff) + (acc[l] >> 16 & 0xffff)
+                                       + (acc[l] >> 32 & 0xffff) + (acc[l] >> 48) );
+                words -= n;
+            }
+
+            for( len &= sizeof(uint64_t) - 1; len; len -= sizeof(uint16_t) )
+            {
+                uint16_t    s;
+
+                memcpy( &s, buf, sizeof(s) );
+                buf += sizeof(s);
+
+                for( unsigned l = 0; l < LANES; ++l )
+                    r.ones[l] += s >> l & 1u;
+            }
+
+        } //}}}
+
+        static const Limits &GetLimits();
+
+
+    public:
+
+        BitBias( size_t short_len = 0 )
+            : m_short_len( short_len ? short_len : 65536 )
+            , m_have_results( false )
+            , m_have_unchecked_results( false )
+            , m_ok_wait( 1 )
+        {
+            Log<2>( "+ BitBias( %zu )\n", m_short_len );
+        }
+
+        ~BitBias()
+        {
+            Log<2>( "- BitBias( %zu )\n", m_short_len );
+        }
+
+
+        void clear()
+        {
+            m_short.result.clear();
+            m_long.result.clear();
+        }
+
+        // You don't usually want to call this, except to flush a final block
+        // of samples when the input may not be a multiple of the short block
+        // length, as for Ent::flush().
+        void flush()
+        { //{{{
+
+            if( m_short.result.samples == 0 )
+                return;
+
+            m_long.result += m_short.result;
+            m_previous_short = m_short;
+            m_short.result.clear();
+
+            m_have_results              = true;
+            m_have_unchecked_results    = true;
+
+        } //}}}
+
+
+        // A trailing odd byte is ignored, as it is for Ent16.
+        void Analyse( const uint8_t *buf, size_t len )
+        { //{{{
+
+            while( len >= sizeof(uint16_t) )
+            {
+                size_t  n = std::min( len / sizeof(uint16_t),
+                                      m_short_len - m_short.result.samples );
+
+                count( buf, n * sizeof(uint16_t) );
+
+                m_short.result.samples += n;
+                buf                    += n * sizeof(uint16_t);
+                len                    -= n * sizeof(uint16_t);
+
+                if( m_short.result.samples == m_short_len )
+                    flush();
+            }
+
+        } //}}}
+
+        bool IsOk( bool was_ok = true )
+        { //{{{
+
+            if( ! m_have_results )
+                return false;
+
+            if( ! m_have_unchecked_results )
+                return m_ok_wait == 1;
+
+            m_have_unchecked_results = false;
+
+            m_short.fail.tested++;
+            m_long.fail.tested++;
+
+
+            const Limits   &lim     = GetLimits();
+            const Result   &sr      = m_previous_short.result;
+            const Result   &lr      = m_long.result;
+            double          chisq   = sr.Chisq();
+            bool            passed  = true;
+
+            for( unsigned i = 0; i < LANES; ++i )
+            {
+                if( sr.LaneChisq(i) > lim.short_lane_chisq )
+                {
+                    m_short.fail.lane++;
+                    passed = false;
+                    break;
+                }
+            }
+
+            if( chisq < lim.short_chisq_min || chisq > lim.short_chisq_max )
+            {
+                m_short.fail.chisq++;
+                passed = false;
+            }
+
+            if( lr.samples > lim.long_minsamples
+             && fabs( lr.LaneBias( lr.WorstLane() ) ) > lim.long_bias )
+            {
+                m_long.fail.bias++;
+                passed = false;
+            }
+
+
+            // With the same recovery hysteresis as Ent::IsOk().
+            if( passed )
+            {
+                if( ! was_ok && m_ok_wait != 1
+                 && lr.samples - m_ok_wait < lim.recovery_blocks * m_short_len )
+                {
+                    passed = false;
+
+                } else {
+
+                    m_ok_wait = 1;
+                }
+
+            } else {
+
+                m_ok_wait = lr.samples;
+            }
+
+            m_previous_short.fail = m_short.fail;
+
+            return passed;
+
+        } //}}}
+
+
+        bool HaveResults() const            { return m_have_results; }
+
+        const Data &ShortTermData() const   { return m_previous_short; }
+
+        const Data &LongTermData() const    { return m_long; }
+
+
+        std::string ResultsAsJSON() const
+        { //{{{
+
+            return "\"BitBias\":{\"Short\":" + m_previous_short.AsJSON()
+                             + ",\"Long\":" + m_long.AsJSON()
+                             + '}';
+        } //}}}
+
+    }; //}}}
+
+    EM_TRY_PUSH_DIAGNOSTIC_IGNORE("-Wgnu-designator")
+
+    inline const BitBias::Limits &BitBias::GetLimits()
+    { //{{{
+
+        // At 1Mbps a short block takes about a second to collect, and the long
+        // term bias can be measured to within about 5e-5 (1 sigma) by the time
+        // that long_minsamples have been seen.  That is 1.6 billion bits, so
+        // a generator running at 1Mbps will take about 27 minutes to reach it.
+        // A bias of 0.00025 in a single lane costs less than 1e-6 bits of
+        // entropy per bit, but it is also well outside what a good source
+        // should ever show, so we fail on it rather than let it persist.
+        static const Limits lim = {
+
+            long_minsamples:    100000000,
+            long_bias:          0.00025,
+
+            // Random expected outside than this less than once in 100 million trials
+            short_lane_chisq:   32.841,
+            short_chisq_min:    0.786,
+            short_chisq_max:    69.995,
+
+            recovery_blocks:    10,
+        };
+
+        return lim;
+
+    } //}}}
+
+    EM_POP_DIAGNOSTIC
+
+
 
     // Tracks the length of runs of consecutive 0 or 1 bits, and the number of
     // runs of each length.  This turns out to also be the "General Runs Test"
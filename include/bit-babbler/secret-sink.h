@@ -5,6 +5,8 @@
 #define _BB_SECRET_SINK_H
 
 #include <bit-babbler/health-monitor.h>
+#include <bit-babbler/socket-reader.h>
+#include <bit-babbler/buffer-pool.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -12,6 +14,12 @@
 namespace BitB
 {
 
+    // Monitor the quality of entropy from an external source.
+    //{{{
+    // The devpath may be a filesystem path to a device or FIFO, or it may be
+    // a socket address of the form 'udp:host:port', to request blocks from a
+    // remote SocketSource, or 'tcp:host:port' to read a stream from it.
+    //}}}
     class SecretSink : public RefCounted
     { //{{{
     public:
@@ -92,10 +100,11 @@ namespace BitB
 
     private:
 
-        Options             m_options;
-        HealthMonitor       m_qa;
-        int                 m_fd;
-        pthread_t           m_thread;
+        Options                 m_options;
+        HealthMonitor           m_qa;
+        int                     m_fd;
+        SocketReader::Handle    m_sock;
+        pthread_t               m_thread;
 
 
         void do_read_thread()
@@ -105,12 +114,15 @@ namespace BitB
 
             Log<3>( "SecretSink( %s ): begin read_thread\n", m_options.devpath.c_str() );
 
-            uint8_t     buf[ m_options.block_size ];
-            size_t      bytes = 0;
-            size_t      n     = 0;
+            BufferPool::Buffer  buf( m_options.block_size );
+            size_t              bytes = 0;
+            size_t              n     = 0;
 
             for(;;)
             {
+                if( m_sock != NULL )
+                    n = m_sock->read( buf, m_options.block_size );
+
                 while( n < m_options.block_size )
                 {
                     ssize_t r = read( m_fd, buf + n, m_options.block_size - n );
@@ -173,17 +185,31 @@ namespace BitB
 
             Log<2>( "+ SecretSink( '%s' )\n", m_options.devpath.c_str() );
 
-            m_fd = open( m_options.devpath.c_str(), O_RDONLY );
+            if( SocketReader::IsSocketAddr( m_options.devpath ) )
+            {
+                SocketReader::Options   so( m_options.devpath );
 
-            if( m_fd < 0 )
-                throw SystemError( _("SecretSink: failed to open '%s'"),
-                                            m_options.devpath.c_str() );
+                // Don't ask for more than one block at a time.
+                so.request_size = std::min( so.request_size, m_options.block_size );
+                m_sock = new SocketReader( so );
+                m_fd   = -1;
+            }
+            else
+            {
+                m_fd = open( m_options.devpath.c_str(), O_RDONLY );
+
+                if( m_fd < 0 )
+                    throw SystemError( _("SecretSink: failed to open '%s'"),
+                                                m_options.devpath.c_str() );
+            }
 
             int ret = pthread_create( &m_thread, GetDefaultThreadAttr(), read_thread, this );
 
             if( ret )
             {
-                close( m_fd );
+                if( m_fd != -1 )
+                    close( m_fd );
+
                 throw SystemError( ret, _("SecretSink( %s ) failed to create thread"),
                                                             m_options.devpath.c_str() );
             }
@@ -203,7 +229,8 @@ namespace BitB
                                                     m_options.devpath.c_str() );
             pthread_join( m_thread, NULL );
 
-            close( m_fd );
+            if( m_fd != -1 )
+                close( m_fd );
 
         } //}}}
 
@@ -5,7 +5,15 @@
 #define _BB_SECRET_SOURCE_H
 
 #include <bit-babbler/health-monitor.h>
+#include <bit-babbler/entropy-source.h>
 #include <bit-babbler/ftdi-device.h>
+#include <bit-babbler/buffer-pool.h>
+#include <bit-babbler/correlation.h>
+#include <bit-babbler/socket-reader.h>
+#include <bit-babbler/virtual-clock.h>
+#include <bit-babbler/tracepoints.h>
+
+#include <map>
 
 #if EM_PLATFORM_LINUX
  #include <linux/random.h>
@@ -70,22 +78,56 @@ namespace BitB
 
         static const unsigned   FTDI_INIT_RETRIES = 20;
 
+        // The stages of recovery from a failed read, in order of escalation.
+        enum RecoveryStage
+        { //{{{
+
+            RECOVER_RESYNC,     // Discard any pending data and check MPSSE sync
+            RECOVER_REINIT,     // Reinitialise MPSSE mode and the bitrate clock
+            RECOVER_RESET,      // Reset the device on the bus, in Recover()
+            RECOVER_STAGES
+
+        }; //}}}
+
+        // All times here are in milliseconds.
+        // - RESYNC_TIMEOUT is the bulk transfer timeout while resyncing.
+        // - REINIT_RETRIES is the number of attempts to reinitialise it.
+        // - RESET_BACKOFF_* bound the wait before claiming the device again,
+        //   after the second and subsequent resets without a good read.
+        static const unsigned   RESYNC_TIMEOUT      = 50;
+        static const unsigned   REINIT_RETRIES      = 2;
+        static const unsigned   RESET_BACKOFF_MIN   = 10;
+        static const unsigned   RESET_BACKOFF_MAX   = 5000;
+
         unsigned        m_enable_mask;
         unsigned        m_disable_pol;
         unsigned        m_bitrate;
+        unsigned        m_bitrate_min;
+        unsigned        m_bitrate_max;
+        unsigned        m_chunksize_opt;    // 0 to choose it from the bitrate
+        unsigned        m_latency_opt;      // -1 to choose it from the bitrate
         unsigned        m_fold;
+        unsigned        m_fold_min;
+        unsigned        m_fold_max;
+        Conditioner::Ratio  m_condition;
         unsigned        m_sleep_init;   // in milliseconds
         unsigned        m_sleep_max;
         unsigned        m_suspend_after;
         bool            m_no_qa;
+        bool            m_standby;
+
+        unsigned        m_recovered[RECOVER_STAGES];
+        unsigned        m_recover_failed;
+        unsigned        m_resets;           // Since the last good read
+        uint64_t        m_reset_start;      // in microseconds
 
 
-        void init_device()
+        void init_device( unsigned attempts = FTDI_INIT_RETRIES )
         { //{{{
 
-            for( unsigned retries = FTDI_INIT_RETRIES; retries; --retries )
+            for( unsigned retries = attempts; retries; --retries )
             {
-                if( retries < FTDI_INIT_RETRIES )
+                if( retries < attempts )
                     LogMsg<2>("BitBabbler::init_device: retrying");
 
                 if( ! InitMPSSE() )
@@ -135,6 +177,180 @@ namespace BitB
 
         } //}}}
 
+        // Request len bytes from the device and read them into buf.  This will
+        // throw if it fails, or if no data is returned after FTDI_READ_RETRIES
+        // successive attempts to read it.
+        void read_( uint8_t *buf, size_t len )
+        { //{{{
+
+            const uint8_t   cmd[] =
+            {
+              #ifdef LSB_FIRST
+
+               #ifdef SAMPLE_FALLING_EDGE
+                MPSSE_DATA_BYTE_IN_NEG_LSB,
+               #else
+                MPSSE_DATA_BYTE_IN_POS_LSB,
+               #endif
+
+              #else   // MSB first
+
+               #ifdef SAMPLE_FALLING_EDGE
+                MPSSE_DATA_BYTE_IN_NEG_MSB,
+               #else
+                MPSSE_DATA_BYTE_IN_POS_MSB,
+               #endif
+
+              #endif
+
+                uint8_t((len - 1) & 0xFF),
+                uint8_t((len - 1) >> 8),
+
+                MPSSE_SEND_IMMEDIATE
+            };
+
+            WriteCommand( cmd, sizeof(cmd) );
+
+            LogMsg<6>( "BitBabbler::read( %zu ): wrote request", len );
+
+            size_t  count = 0;
+            size_t  n = 0;
+
+            do {
+                size_t  ret = ftdi_read( buf + count, len - count );
+
+                if( __builtin_expect( ret > 0, 1 ) )
+                {
+                    LogMsg<6>( "BitBabbler::read( %zu ): read %zu (n = %zu)",
+                                                                len, ret, n );
+                    count += ret;
+
+                    if( __builtin_expect( count == len, 1 ) )
+                    {
+                        // This is just to create buffer bloat errors,
+                        // mostly for testing the purge recovery code.
+                        //WriteCommand( cmd, sizeof(cmd) );
+
+                       #ifdef CHECK_EXCESS_BYTES
+
+                        if( __builtin_expect(GetReadAhead() != 0 ||
+                                             GetLineStatus() != (FTDI_THRE | FTDI_TEMT), 0) )
+                        {
+                            size_t      ra = GetReadAhead();
+                            unsigned    ls = GetLineStatus();
+
+                            ret = ftdi_read( buf, len );
+
+                            throw Error( _("BitBabbler::read( %zu ): Uh Oh excess data. "
+                                            "Buffered %zu, line status 0x%02x [%s ]"),
+                                            len, ra, ls,
+                                            OctetsToHex( OctetString( buf,
+                                                                      std::min(ret, size_t(8)) )
+                                                       ).c_str() );
+                        }
+
+                       #endif
+
+                        return;
+                    }
+
+                    n = 0;
+                }
+
+            } while( ++n < FTDI_READ_RETRIES );
+
+            ThrowUSBError( LIBUSB_ERROR_TIMEOUT, _("BitBabbler::read( %zu ) failed (n = %zu)"),
+                                                                                    len, n );
+        } //}}}
+
+        // Log the time it took to recover from a failed read, and how.
+        void note_recovered( RecoveryStage stage, uint64_t start )
+        { //{{{
+
+            static const char *stage_name[] = { "resync", "reinit", "reset" };
+
+            ++m_recovered[stage];
+            m_resets = 0;
+
+            LogMsg<1>( "BitBabbler: recovered by %s in %.1fms "
+                       "(total %u resync, %u reinit, %u reset, %u failed)",
+                       stage_name[stage], double(GetMonotonicUS() - start) / 1000,
+                       m_recovered[RECOVER_RESYNC], m_recovered[RECOVER_REINIT],
+                       m_recovered[RECOVER_RESET], m_recover_failed );
+        } //}}}
+
+        // Choose the chunk size and latency timer to suit the current bitrate,
+        // unless they were set explicitly.  The latency is only applied to the
+        // device by init_device(), so if it changes while the device is claimed
+        // it must be initialised again.
+        void set_chunking()
+        { //{{{
+
+            unsigned    maxpacket = GetMaxPacketSize();
+
+            // Select the chunk size to be the largest power of 2 between the
+            // maximum packet size and 64kB that will take less than 250ms to
+            // transfer (which is then the maximum time we'll block waiting to
+            // perform an orderly exit).
+            size_t      chunksize = std::max( maxpacket,
+                                    std::min( m_chunksize_opt ? m_chunksize_opt
+                                                              : 65536u,
+                                              powof2_down(m_bitrate / 32
+                                                                    / maxpacket
+                                                                    * maxpacket) ) );
+
+            // Select the latency to avoid timing out and returning a short packet
+            // before the full chunksize can be transferred.  This isn't actually
+            // the fastest way to get lots of data out of the device, but it does
+            // significantly minimise the CPU load because we don't spin hard doing
+            // many small transactions to get a whole chunk out.
+            unsigned    latency = std::max( 1u,
+                                  std::min( 255u,
+                                            maxpacket * 8000 / m_bitrate + 2 ) );
+
+            // The above computes what should be our theoretical optimum latency,
+            // ie. the amount of time it would take to completely fill a packet
+            // of the maximum allowable size.  That in theory, should give us the
+            // best throughput, since it requires the least number of transactions
+            // to complete the transfer.  In practice however, it appears that we
+            // can wring a bit more speed out with a lower latency than that, even
+            // when it means every packet ends up 'short' - though it comes at the
+            // cost of significantly increasing CPU usage as the number of packets
+            // required can increase drastically.  This appears to be true even if
+            // the 'performance' CPU governor is used, though it still may be a
+            // function of just not letting the CPU throttle down as much by simply
+            // keeping it busy more of the time.
+            //
+            // For a BitBabbler White in the default configuration, the latency
+            // required to fill a 64kB request is 3ms.  Decreasing that to 1ms is
+            // worth about 2MB/hr in the rate of data which we can read from one.
+            // Which is less than half a percent improvement, and the extra CPU
+            // time cost is disproportionately larger than that - but it may still
+            // be a useful speed up to want for some uses cases.  (By comparison,
+            // on the system I tested this on, using the performance governor was
+            // worth about an extra 2% in output rate, or about 10MB/hr over what
+            // was seen with the default 'powersave' option.)
+            //
+            // So we default to making efficient use of the CPU, but allow people
+            // to override the latency if they do want speed over everything else.
+            if( m_latency_opt != unsigned(-1) )
+                latency = m_latency_opt;
+
+
+            SetChunkSize( chunksize );
+            SetLatency( latency );
+
+        } //}}}
+
+        // Time out a stalled transfer after twice the time that a whole chunk
+        // should take at the current bitrate, with some margin for the latency
+        // timer and scheduling of the bus, instead of waiting for many seconds.
+        void set_transfer_timeout()
+        {
+            SetTransferTimeout( unsigned( uint64_t(GetChunkSize()) * 16000 / m_bitrate )
+                                + GetLatency() + 250 );
+        }
+
 
     public:
 
@@ -150,28 +366,40 @@ namespace BitB
             unsigned                enable_mask;
             unsigned                disable_polarity;
             unsigned                bitrate;
+            unsigned                bitrate_min;    // Bounds for auto-bitrate
+            unsigned                bitrate_max;
             unsigned                chunksize;
             unsigned                latency;
             unsigned                fold;
+            unsigned                fold_min;       // Bounds for auto-fold
+            unsigned                fold_max;
+            Conditioner::Ratio      condition;
+            std::string             pool;           // Empty for the default pool
             unsigned                group;
             unsigned                sleep_init;     // in milliseconds
             unsigned                sleep_max;
             unsigned                suspend_after;
             bool                    no_qa;
+            bool                    standby;
 
 
             Options()
                 : enable_mask( 0x0f )
                 , disable_polarity( 0x00 )
                 , bitrate( 0 )
+                , bitrate_min( 0 )
+                , bitrate_max( 0 )
                 , chunksize( 0 )
                 , latency( unsigned(-1) )
                 , fold( unsigned(-1) )
+                , fold_min( unsigned(-1) )
+                , fold_max( unsigned(-1) )
                 , group( 0 )
                 , sleep_init( 100 )
                 , sleep_max( 60000 )
                 , suspend_after( 0 )
                 , no_qa( false )
+                , standby( false )
             {}
 
 
@@ -213,6 +441,66 @@ namespace BitB
                                                                         sleep_init, sleep_max );
             } //}}}
 
+            void SetAutoBitrate( const std::string &arg )
+            { //{{{
+
+                size_t  n = arg.find(':');
+
+                if( n == std::string::npos )
+                    throw Error( _("BitBabbler::Options: invalid auto-bitrate argument '%s'"),
+                                                                                arg.c_str() );
+                bitrate_min = unsigned(StrToScaledD( arg.substr(0, n) ));
+                bitrate_max = unsigned(StrToScaledD( arg.substr(n + 1) ));
+
+                if( bitrate_min == 0 || bitrate_min > bitrate_max )
+                    throw Error( _("BitBabbler::Options: invalid auto-bitrate range '%s', "
+                                   "expected min:max with 0 < min <= max"), arg.c_str() );
+            } //}}}
+
+            void SetAutoFold( const std::string &arg )
+            { //{{{
+
+                size_t  n = arg.find(':');
+
+                if( n == std::string::npos )
+                    throw Error( _("BitBabbler::Options: invalid auto-fold argument '%s'"),
+                                                                            arg.c_str() );
+                fold_min = StrToU( arg.substr(0, n), 10 );
+                fold_max = StrToU( arg.substr(n + 1), 10 );
+
+                if( fold_min > fold_max || fold_max > 8 )
+                    throw Error( _("BitBabbler::Options: invalid auto-fold range '%s', "
+                                   "expected min:max with min <= max <= 8"), arg.c_str() );
+            } //}}}
+
+
+            // Return true if a device configured with o would be set up in
+            // exactly the same way as one configured with these options.
+            // The id which selects the device(s) they apply to is ignored.
+            bool SameSettings( const Options &o ) const
+            { //{{{
+
+                return enable_mask      == o.enable_mask
+                    && disable_polarity == o.disable_polarity
+                    && bitrate          == o.bitrate
+                    && bitrate_min      == o.bitrate_min
+                    && bitrate_max      == o.bitrate_max
+                    && chunksize        == o.chunksize
+                    && latency          == o.latency
+                    && fold             == o.fold
+                    && fold_min         == o.fold_min
+                    && fold_max         == o.fold_max
+                    && condition.in     == o.condition.in
+                    && condition.out    == o.condition.out
+                    && pool             == o.pool
+                    && group            == o.group
+                    && sleep_init       == o.sleep_init
+                    && sleep_max        == o.sleep_max
+                    && suspend_after    == o.suspend_after
+                    && no_qa            == o.no_qa
+                    && standby          == o.standby;
+            } //}}}
+
         }; //}}}
 
 
@@ -229,6 +517,21 @@ namespace BitB
 
         } //}}}
 
+        // Return the next real bitrate below (a real) bitrate.
+        static unsigned LowerBitrate( unsigned bitrate )
+        {
+            return 30000000 / (30000000 / bitrate + 1);
+        }
+
+        // Return the next real bitrate above (a real) bitrate.
+        static unsigned HigherBitrate( unsigned bitrate )
+        {
+            if( bitrate >= 15000000 )
+                return 30000000;
+
+            return 30000000 / (30000000 / bitrate - 1);
+        }
+
 
     private:
 
@@ -274,13 +577,31 @@ namespace BitB
             , m_enable_mask( ~options.enable_mask << 4 & 0xf0 )
             , m_disable_pol( options.disable_polarity << 4 & 0xf0 )
             , m_bitrate( choose_bitrate(options) )
+            , m_bitrate_min( options.bitrate_min ? RealBitrate(options.bitrate_min) : m_bitrate )
+            , m_bitrate_max( options.bitrate_max ? RealBitrate(options.bitrate_max) : m_bitrate )
+            , m_chunksize_opt( options.chunksize )
+            , m_latency_opt( options.latency )
             , m_fold( choose_folding(options) )
+            , m_fold_min( options.fold_min != unsigned(-1) ? options.fold_min : m_fold )
+            , m_fold_max( options.fold_max != unsigned(-1) ? options.fold_max : m_fold )
+            , m_condition( options.condition )
             , m_sleep_init( options.sleep_init )
             , m_sleep_max( options.sleep_max )
             , m_suspend_after( options.suspend_after )
             , m_no_qa( options.no_qa )
+            , m_standby( options.standby )
+            , m_recover_failed( 0 )
+            , m_resets( 0 )
+            , m_reset_start( 0 )
         { //{{{
 
+            memset( m_recovered, 0, sizeof(m_recovered) );
+
+            // If the folding will be chosen automatically, start from what it
+            // would otherwise have been, so long as that is within the bounds.
+            m_fold    = std::min( std::max( m_fold, m_fold_min ), m_fold_max );
+            m_bitrate = std::min( std::max( m_bitrate, m_bitrate_min ), m_bitrate_max );
+
             if( options.bitrate == m_bitrate )
                 LogMsg<2>( "+ BitBabbler( bitrate %u, fold %u, mask 0x%02x [%02x] )",
                                 m_bitrate, m_fold, options.enable_mask, m_enable_mask );
@@ -289,62 +610,12 @@ namespace BitB
                     options.bitrate, m_bitrate, m_fold, options.enable_mask, m_enable_mask );
 
 
-            unsigned    maxpacket = GetMaxPacketSize();
-
-            // Select the chunk size to be the largest power of 2 between the
-            // maximum packet size and 64kB that will take less than 250ms to
-            // transfer (which is then the maximum time we'll block waiting to
-            // perform an orderly exit).
-            size_t      chunksize = std::max( maxpacket,
-                                    std::min( options.chunksize ? options.chunksize
-                                                                : 65536u,
-                                              powof2_down(m_bitrate / 32
-                                                                    / maxpacket
-                                                                    * maxpacket) ) );
-
-            // Select the latency to avoid timing out and returning a short packet
-            // before the full chunksize can be transferred.  This isn't actually
-            // the fastest way to get lots of data out of the device, but it does
-            // significantly minimise the CPU load because we don't spin hard doing
-            // many small transactions to get a whole chunk out.
-            unsigned    latency = std::max( 1u,
-                                  std::min( 255u,
-                                            maxpacket * 8000 / m_bitrate + 2 ) );
-
-            // The above computes what should be our theoretical optimum latency,
-            // ie. the amount of time it would take to completely fill a packet
-            // of the maximum allowable size.  That in theory, should give us the
-            // best throughput, since it requires the least number of transactions
-            // to complete the transfer.  In practice however, it appears that we
-            // can wring a bit more speed out with a lower latency than that, even
-            // when it means every packet ends up 'short' - though it comes at the
-            // cost of significantly increasing CPU usage as the number of packets
-            // required can increase drastically.  This appears to be true even if
-            // the 'performance' CPU governor is used, though it still may be a
-            // function of just not letting the CPU throttle down as much by simply
-            // keeping it busy more of the time.
-            //
-            // For a BitBabbler White in the default configuration, the latency
-            // required to fill a 64kB request is 3ms.  Decreasing that to 1ms is
-            // worth about 2MB/hr in the rate of data which we can read from one.
-            // Which is less than half a percent improvement, and the extra CPU
-            // time cost is disproportionately larger than that - but it may still
-            // be a useful speed up to want for some uses cases.  (By comparison,
-            // on the system I tested this on, using the performance governor was
-            // worth about an extra 2% in output rate, or about 10MB/hr over what
-            // was seen with the default 'powersave' option.)
-            //
-            // So we default to making efficient use of the CPU, but allow people
-            // to override the latency if they do want speed over everything else.
-            if( options.latency != unsigned(-1) )
-                latency = options.latency;
-
-
-            chunksize = SetChunkSize( chunksize );
-            SetLatency( latency );
+            set_chunking();
+            set_transfer_timeout();
 
             LogMsg<3>( "Chunk size %zu, %zu ms/per chunk (latency %u ms, max packet %u)",
-                        chunksize, chunksize * 8000 / m_bitrate, latency, maxpacket );
+                        GetChunkSize(), GetChunkSize() * 8000 / m_bitrate,
+                        GetLatency(), GetMaxPacketSize() );
 
             if( claim_now )
                 Claim();
@@ -365,6 +636,8 @@ namespace BitB
                 return false;
 
             init_device();
+
+            BB_TRACE1( device__claim, GetSerial().c_str() );
             return true;
 
         } //}}}
@@ -375,6 +648,8 @@ namespace BitB
             ResetBitmode();
             FTDI::Release();
 
+            BB_TRACE1( device__release, GetSerial().c_str() );
+
         } //}}}
 
 
@@ -383,11 +658,78 @@ namespace BitB
             return m_bitrate;
         }
 
+        unsigned GetMinBitrate() const
+        {
+            return m_bitrate_min;
+        }
+
+        unsigned GetMaxBitrate() const
+        {
+            return m_bitrate_max;
+        }
+
+        // Change the bitrate while the device is running.  This must not be
+        // called concurrently with read(), which normally means that it should
+        // only be called from the thread which is reading from the device.
+        void SetBitrate( unsigned bitrate )
+        { //{{{
+
+            unsigned    latency = GetLatency();
+
+            m_bitrate = RealBitrate( bitrate );
+            set_chunking();
+            set_transfer_timeout();
+
+            // If it isn't claimed, then init_device() will set this when it is.
+            if( ! IsClaimed() )
+                return;
+
+            // The latency timer can't safely be changed on the fly, so if the
+            // new rate needs a different one, initialise the device again
+            // (which will also set the new clock divisor).
+            if( GetLatency() != latency )
+            {
+                init_device( REINIT_RETRIES );
+
+                LogMsg<3>( "BitBabbler: bitrate set to %u (chunk size %zu, latency %u ms)",
+                                                m_bitrate, GetChunkSize(), GetLatency() );
+                return;
+            }
+
+            unsigned        clk_div = 30000000 / m_bitrate - 1;
+            const uint8_t   cmd[] =
+            {
+                MPSSE_SET_CLK_DIVISOR,
+                uint8_t( clk_div & 0xFF ),
+                uint8_t( clk_div >> 8 )
+            };
+
+            WriteCommand( cmd, sizeof(cmd) );
+
+            LogMsg<3>( "BitBabbler: bitrate set to %u", m_bitrate );
+
+        } //}}}
+
         unsigned GetFolding() const
         {
             return m_fold;
         }
 
+        unsigned GetMinFolding() const
+        {
+            return m_fold_min;
+        }
+
+        unsigned GetMaxFolding() const
+        {
+            return m_fold_max;
+        }
+
+        const Conditioner::Ratio &GetConditioning() const
+        {
+            return m_condition;
+        }
+
         unsigned GetIdleSleepInit() const
         {
             return m_sleep_init;
@@ -408,6 +750,42 @@ namespace BitB
             return m_no_qa;
         }
 
+        bool IsStandby() const
+        {
+            return m_standby;
+        }
+
+
+        EntropySource::RecoveryCounts GetRecoveryCounts() const
+        {
+            EntropySource::RecoveryCounts   c;
+
+            c.resync = m_recovered[RECOVER_RESYNC];
+            c.reinit = m_recovered[RECOVER_REINIT];
+            c.reset  = m_recovered[RECOVER_RESET];
+            c.failed = m_recover_failed;
+
+            return c;
+        }
+
+
+        // Note that the device is being reset on the bus to recover from an
+        // error, and return the time in milliseconds to wait before trying to
+        // claim it again.  The first reset doesn't wait at all, but it doubles
+        // with each one after that until there is a good read from it again.
+        unsigned BeginReset()
+        { //{{{
+
+            if( m_resets++ == 0 )
+            {
+                m_reset_start = GetMonotonicUS();
+                return 0;
+            }
+
+            return std::min( RESET_BACKOFF_MIN << std::min( m_resets - 2, 16u ),
+                             unsigned(RESET_BACKOFF_MAX) );
+        } //}}}
+
 
         size_t read( uint8_t *buf, size_t len )
         { //{{{
@@ -415,112 +793,784 @@ namespace BitB
             if( __builtin_expect( len < 1 || len > 65536, 0 ) )
                 throw Error( _("BitBabbler::read( %zu ): invalid length"), len );
 
-            const uint8_t   cmd[] =
-            {
-              #ifdef LSB_FIRST
+            BB_TRACE2( read__start, GetSerial().c_str(), len );
 
-               #ifdef SAMPLE_FALLING_EDGE
-                MPSSE_DATA_BYTE_IN_NEG_LSB,
-               #else
-                MPSSE_DATA_BYTE_IN_POS_LSB,
-               #endif
+            try {
+                read_( buf, len );
+
+                if( __builtin_expect( m_resets != 0, 0 ) )
+                    note_recovered( RECOVER_RESET, m_reset_start );
+
+                BB_TRACE2( read__done, GetSerial().c_str(), len );
+                return len;
+            }
+            catch( const abi::__forced_unwind& ) { throw; }
+            BB_CATCH_STD( 1, stringprintf("BitBabbler::read( %zu ) failed", len).c_str() )
+
+            // We shouldn't ever get here in normal operation, but if for some
+            // reason things back up and the request fails, or the device stops
+            // returning data, start with the quickest way of recovering which
+            // might work, and only escalate to slower ones if it doesn't.  If
+            // the last stage here fails too, its exception is passed up to the
+            // caller, for Recover() to reset the device on the bus.
+            uint64_t    start = GetMonotonicUS();
+
+            try {
+                if( Resync( RESYNC_TIMEOUT ) )
+                {
+                    read_( buf, len );
+                    note_recovered( RECOVER_RESYNC, start );
+
+                    BB_TRACE2( read__done, GetSerial().c_str(), len );
+                    return len;
+                }
+
+                LogMsg<2>( "BitBabbler::read( %zu ): resync failed", len );
+            }
+            catch( const abi::__forced_unwind& ) { throw; }
+            BB_CATCH_STD( 2, stringprintf("BitBabbler::read( %zu ): resync failed", len).c_str() )
+
+            try {
+                LogMsg<1>( "BitBabbler::read( %zu ): reinitialising device", len );
+                FTDI::Claim();
+                init_device( REINIT_RETRIES );
+                read_( buf, len );
+            }
+            catch( const abi::__forced_unwind& ) { throw; }
+            catch( ... )
+            {
+                ++m_recover_failed;
+                LogMsg<1>( "BitBabbler::read( %zu ): reinit failed after %.1fms",
+                                    len, double(GetMonotonicUS() - start) / 1000 );
+                throw;
+            }
+
+            note_recovered( RECOVER_REINIT, start );
+
+            BB_TRACE2( read__done, GetSerial().c_str(), len );
+            return len;
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Adapt a BitBabbler device to the EntropySource interface of the Pool.
+    class BitBabblerSource : public EntropySource
+    { //{{{
+    private:
+
+        BitBabbler::Handle  m_babbler;
+
+
+    public:
+
+        BitBabblerSource( const BitBabbler::Handle &babbler )
+            : m_babbler( babbler )
+        {}
+
+
+        const BitBabbler::Handle &GetBabbler() const
+        {
+            return m_babbler;
+        }
+
+
+        virtual const std::string &GetID() const
+        {
+            return m_babbler->GetSerial();
+        }
+
+        virtual bool Claim()
+        {
+            return m_babbler->Claim();
+        }
+
+        virtual void Release()
+        {
+            m_babbler->Release();
+        }
+
+        virtual bool IsClaimed() const
+        {
+            return m_babbler->IsClaimed();
+        }
+
+        virtual size_t GetChunkSize() const
+        {
+            return m_babbler->GetChunkSize();
+        }
+
+        virtual unsigned GetFolding() const
+        {
+            return m_babbler->GetFolding();
+        }
+
+        virtual unsigned GetMinFolding() const
+        {
+            return m_babbler->GetMinFolding();
+        }
+
+        virtual unsigned GetBitrate() const
+        {
+            return m_babbler->GetBitrate();
+        }
+
+        virtual unsigned GetMinBitrate() const
+        {
+            return m_babbler->GetMinBitrate();
+        }
+
+        virtual unsigned GetMaxBitrate() const
+        {
+            return m_babbler->GetMaxBitrate();
+        }
+
+        virtual void SetBitrate( unsigned bitrate )
+        {
+            m_babbler->SetBitrate( bitrate );
+        }
+
+        virtual unsigned GetMaxFolding() const
+        {
+            return m_babbler->GetMaxFolding();
+        }
+
+        virtual Conditioner::Ratio GetConditioning() const
+        {
+            return m_babbler->GetConditioning();
+        }
+
+        virtual unsigned GetIdleSleepInit() const
+        {
+            return m_babbler->GetIdleSleepInit();
+        }
+
+        virtual unsigned GetIdleSleepMax() const
+        {
+            return m_babbler->GetIdleSleepMax();
+        }
+
+        virtual unsigned GetSuspendAfter() const
+        {
+            return m_babbler->GetSuspendAfter();
+        }
+
+        virtual bool NoQA() const
+        {
+            return m_babbler->NoQA();
+        }
+
+        virtual bool IsStandby() const
+        {
+            return m_babbler->IsStandby();
+        }
+
+        // At rates of 5Mbps or greater, wait for the first Ent8 test results
+        // before declaring the source is generating an acceptable quality of
+        // entropy.  Below that let it come online if the FIPS tests aren't
+        // rejecting it, with at least 20 consecutive blocks having passed.
+        virtual bool AssumeEnt8OK() const
+        {
+            return m_babbler->GetBitrate() < 5000000;
+        }
+
+        // Every device on a bus shares the bandwidth of its host controller,
+        // whichever hubs and ports they are connected through to reach it.
+        virtual std::string GetBusID() const
+        {
+            return stringprintf( "%03u", m_babbler->GetBusNumber() );
+        }
+
+        virtual bool IsDevice( const USBContext::Device::Handle &d ) const
+        {
+            return m_babbler->IsDevice( d );
+        }
+
+
+        virtual size_t read( uint8_t *buf, size_t len )
+        {
+            return m_babbler->read( buf, len );
+        }
+
+        virtual RecoveryCounts GetRecoveryCounts() const
+        {
+            return m_babbler->GetRecoveryCounts();
+        }
+
+        virtual bool Recover( const std::exception &e, unsigned &delay )
+        { //{{{
+
+            const USBError *u = dynamic_cast<const USBError*>( &e );
+
+            if( ! u )
+                return false;
+
+            // Don't warn about enum values not being explicitly handled here,
+            // we don't want to have to chase every new error code added to
+            // libusb that we don't explicitly care about handling here.
+            EM_PUSH_DIAGNOSTIC_IGNORE("-Wswitch-enum")
+
+            switch( u->GetErrorCode() )
+            {
+                case LIBUSB_ERROR_PIPE:
+                    m_babbler->LogMsg<1>( "Pool source_thread caught (device %sclaimed): %s",
+                                            m_babbler->IsClaimed() ? "": "un", e.what() );
+                    m_babbler->Release();
+                    delay = m_babbler->BeginReset();
+                    return true;
+
+                case LIBUSB_ERROR_TIMEOUT:
+                case LIBUSB_ERROR_OTHER:
+                {
+                    m_babbler->LogMsg<1>( "Pool source_thread caught: %s", e.what() );
+
+                    delay = m_babbler->BeginReset();
+
+                    m_babbler->SoftReset();
+                    m_babbler->FTDI::Release();
+                    return true;
+                }
+
+                default:
+                    return false;
+            }
+            EM_POP_DIAGNOSTIC
+
+        } //}}}
+
+    }; //}}}
+
+
+    // A source of entropy from the udp-out socket of a remote seedd instance.
+    //{{{
+    // This lets a host with no BitBabbler of its own draw entropy from others
+    // which do have one, and serve local consumers from its own pool.  It will
+    // have its own QA checking applied before being mixed into the local pool.
+    //}}}
+    class RemoteSource : public EntropySource
+    { //{{{
+    public:
+
+        typedef RefPtr< RemoteSource >  Handle;
+
+
+        struct Options
+        { //{{{
+
+            typedef std::list< Options >    List;
+
+            std::string     addr;       // The udp: or tcp: address to read from
+            std::string     pool;       // The named pool to use, empty for the default
+            unsigned        group;      // The pool group to add entropy to
+            unsigned        prefetch;   // Number of UDP requests in flight
+            size_t          rate;       // Max bytes per second, 0 is unlimited
+            bool            no_qa;
+
+
+            Options()
+                : group( 0 )
+                , prefetch( 8 )
+                , rate( 0 )
+                , no_qa( false )
+            {}
+
+        }; //}}}
+
+
+    private:
+
+        Options                 m_opt;
+        SocketReader::Handle    m_reader;
+        uint64_t                m_due;
+
+
+        static SocketReader::Options reader_options( const Options &opt )
+        {
+            SocketReader::Options   so( opt.addr );
+
+            so.batch = opt.prefetch;
+            return so;
+        }
+
+
+    public:
+
+        RemoteSource( const Options &options )
+            : m_opt( options )
+            , m_reader( new SocketReader( reader_options(options) ) )
+            , m_due( 0 )
+        {
+            Log<2>( "+ RemoteSource( %s, group %u, prefetch %u, rate %zu )\n",
+                    m_opt.addr.c_str(), m_opt.group, m_opt.prefetch, m_opt.rate );
+        }
+
+        ~RemoteSource()
+        {
+            Log<2>( "- RemoteSource( %s )\n", m_opt.addr.c_str() );
+        }
+
+
+        unsigned GetGroup() const
+        {
+            return m_opt.group;
+        }
+
+
+        virtual const std::string &GetID() const
+        {
+            return m_opt.addr;
+        }
+
+        // Enough to fill the whole prefetch window with one read.
+        virtual size_t GetChunkSize() const
+        {
+            return SocketReader::MAX_REQUEST_SIZE * std::max( 1u, m_opt.prefetch );
+        }
+
+        // Don't keep fetching from the remote once the pool is full.
+        // Wait until someone reads from it before we take any more.
+        virtual unsigned GetIdleSleepInit() const
+        {
+            return 0;
+        }
+
+        virtual bool NoQA() const
+        {
+            return m_opt.no_qa;
+        }
+
+
+        virtual size_t read( uint8_t *buf, size_t len )
+        { //{{{
+
+            size_t  n = m_reader->read( buf, len );
+
+            if( m_opt.rate )
+            {
+                // Don't count any time we spent idle against the rate limit.
+                uint64_t    now = GetMonotonicUS();
+
+                m_due = std::max( m_due, now ) + n * 1000000 / m_opt.rate;
+
+                if( m_due > now )
+                    usleep( useconds_t(m_due - now) );
+            }
+
+            return n;
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Steer the output rate of a source from its measured min-entropy.
+    //{{{
+    // Each time the HealthMonitor for a source has a new short term Ent8 result,
+    // we look at the min-entropy it measured.  If that is dropping toward the
+    // point where the QA checks would start failing, or the Ent8 or Ent16 tests
+    // are already failing, we ask for the output rate to be decreased straight
+    // away.  The Ent16 tests take far too long to produce results to steer this
+    // directly, but a failure of them will still push it back down.  If it has
+    // been comfortably above that for m_hold consecutive results, we ask for it
+    // to be increased.  If an increase then has to be reversed, m_hold is
+    // doubled, so that we will quickly settle on the highest rate a source can
+    // sustain, rather than keep pushing it past that, while still probing again
+    // occasionally in case conditions (like its temperature) have changed.  The
+    // result which follows a change is not used, since it will have been
+    // measured partly from output with the old settings.
+    //
+    // What an increase or decrease means is up to the caller.  The source thread
+    // uses it to adjust the folding and/or the bitrate of a device, when those
+    // have been given a range to automatically choose a setting from.
+    //}}}
+    class QAFeedback
+    { //{{{
+    public:
+
+        enum Action
+        {
+            HOLD,
+            INCREASE,
+            DECREASE
+        };
+
+
+    private:
+
+        static const unsigned HOLD_INIT = 4;
+        static const unsigned HOLD_MAX  = 1024;
+
+        unsigned long long  m_last_result;
+        unsigned            m_good;
+        unsigned            m_hold;
+        bool                m_increased;
+        bool                m_skip_next;
+
+
+    public:
+
+        QAFeedback()
+            : m_last_result( 0 )
+            , m_good( 0 )
+            , m_hold( HOLD_INIT )
+            , m_increased( false )
+            , m_skip_next( false )
+        {}
+
+
+        // Return the change that should be made to the output rate.
+        // If it can't be increased or decreased any further, the caller
+        // should indicate that, and we'll HOLD instead.
+        Action Update( const HealthMonitor &qa, bool can_increase, bool can_decrease )
+        { //{{{
+
+            // The Ent8 short term min-entropy (in bits per byte) above which we
+            // consider the output good enough to try increasing it, and below
+            // which we will decrease it.  The QA failure limit for this is 7.73,
+            // and ideal random data over a 500000 sample block will typically
+            // measure about 7.91, with a standard deviation of about 0.015.
+            const double    ENT8_INCREASE   = 7.88;
+            const double    ENT8_DECREASE   = 7.80;
+
+            HealthMonitor::MinEntropy   m = qa.GetMinEntropy();
+
+            if( m.results == m_last_result )
+                return HOLD;
+
+            m_last_result = m.results;
+
+            if( m_skip_next )
+            {
+                m_skip_next = false;
+                return HOLD;
+            }
+
+            if( ! m.ent8_ok || ! m.ent16_ok || m.ent8_short < ENT8_DECREASE )
+            {
+                m_good = 0;
+
+                if( ! can_decrease )
+                    return HOLD;
+
+                if( m_increased )
+                    m_hold = std::min( m_hold * 2, unsigned(HOLD_MAX) );
+
+                m_increased = false;
+                m_skip_next = true;
+                return DECREASE;
+            }
+
+            if( m.ent8_short < ENT8_INCREASE )
+            {
+                m_good = 0;
+                return HOLD;
+            }
+
+            if( ++m_good < m_hold || ! can_increase )
+                return HOLD;
+
+            m_good      = 0;
+            m_increased = true;
+            m_skip_next = true;
+            return INCREASE;
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Forecast when the pool will next be drained after it has been idle.
+    //{{{
+    // A read from a pool which was full, after no reads for at least MIN_GAP,
+    // is taken to be the start of a new burst of demand.  If the intervals
+    // between the most recent bursts agree with each other (as they will for
+    // things like jobs run periodically by cron), we expect the next one to
+    // follow at that same interval, within a window of TOLERANCE of it.  If a
+    // burst is missed, the forecast is carried forward by one more interval,
+    // but if that one is missed too, then we stop forecasting until a pattern
+    // is established again.  All times here are in milliseconds.
+    //}}}
+    class DemandForecast
+    { //{{{
+    private:
+
+        static const unsigned   HISTORY     = 4;
+        static const unsigned   MIN_GAP     = 2000;
+        static const unsigned   MAX_MISSES  = 2;
+
+        uint64_t    m_burst[HISTORY];
+        unsigned    m_bursts;
+        uint64_t    m_last_read;
+
+
+        // The allowed deviation from the forecast interval.
+        static uint64_t tolerance( uint64_t interval )
+        {
+            return interval / 8 + MIN_GAP / 2;
+        }
+
+        uint64_t burst( unsigned n ) const
+        {
+            return m_burst[(m_bursts - 1 - n) % HISTORY];
+        }
+
+
+    public:
+
+        DemandForecast()
+            : m_bursts( 0 )
+            , m_last_read( 0 )
+        {}
+
+
+        // Record a read from the pool, noting whether it was full at the time.
+        void Read( bool was_full, uint64_t now )
+        { //{{{
+
+            if( was_full && (m_bursts == 0 || now - m_last_read >= MIN_GAP) )
+                m_burst[m_bursts++ % HISTORY] = now;
+
+            m_last_read = now;
+
+        } //}}}
+
+        // Return the time until the next burst of demand is expected to begin,
+        // 0 if we are already in the window where it is expected, or -1 if we
+        // don't currently have any forecast of when that will be.
+        unsigned NextBurst( uint64_t now ) const
+        { //{{{
+
+            if( m_bursts < HISTORY )
+                return unsigned(-1);
+
+            uint64_t    interval    = burst(0) - burst(1);
+            uint64_t    tol         = tolerance( interval );
+
+            for( unsigned i = 1; i < HISTORY - 1; ++i )
+            {
+                uint64_t    d = burst(i) - burst(i + 1);
+
+                if( d + tol < interval || d > interval + tol )
+                    return unsigned(-1);
+            }
+
+            for( unsigned i = 1; i <= MAX_MISSES; ++i )
+            {
+                uint64_t    next = burst(0) + interval * i;
+
+                if( now + tol < next )
+                    return unsigned( std::min( next - tol - now, uint64_t(unsigned(-2)) ) );
+
+                if( now <= next + tol )
+                    return 0;
+            }
+
+            return unsigned(-1);
+
+        } //}}}
+
+    }; //}}}
+
+
+    // Share the bandwidth of each USB bus between the sources reading from it.
+    //{{{
+    // A BitBabbler streams bits to the host at its configured bitrate for as
+    // long as a read from it is in progress, so when many of them are on the
+    // same bus and all read at once, their combined rate can exceed what the
+    // host controller is really able to schedule.  When that happens, reads
+    // begin timing out, the devices get reset to recover, and the aggregate
+    // throughput falls as more devices are added instead of rising.
+    //
+    // This only admits a read to a bus while the sum of the byte rates of all
+    // the reads in progress on it stays within the budget (in bytes/sec), and
+    // makes the others wait their turn.  A read is always admitted when the
+    // bus is otherwise idle, so a budget smaller than the rate of one device
+    // will serialise reads, but never stall them completely.  Sources which
+    // had to wait, or which see others waiting, should shrink the size of
+    // their reads, so each one holds the bus for less time and they can be
+    // interleaved more finely.  A budget of 0 means there is no limit.
+    //}}}
+    class BusScheduler : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< BusScheduler >      Handle;
+
+        // A conservative part of what bulk transfers on a high speed bus are
+        // able to sustain in practice, which is well short of its raw rate.
+        static const size_t DEFAULT_BUDGET = 24 * 1024 * 1024;
+
+
+    private:
+
+        struct Bus
+        { //{{{
+
+            size_t      rate;       // The sum of the rates of reads in progress
+            unsigned    reading;
+            unsigned    waiting;
+
+            Bus()
+                : rate( 0 )
+                , reading( 0 )
+                , waiting( 0 )
+            {}
+
+        }; //}}}
+
+        typedef std::map< std::string, Bus >    BusMap;
+
+
+        // Keep the count of waiting readers right if we are cancelled.
+        struct WaitGuard
+        { //{{{
+
+            unsigned   &n;
+
+            WaitGuard( unsigned &count )
+                : n( count )
+            {
+                ++n;
+            }
+
+            ~WaitGuard()
+            {
+                --n;
+            }
+
+        }; //}}}
+
+
+        pthread_mutex_t     m_mutex;
+        pthread_cond_t      m_cond;
+        size_t              m_budget;
+        BusMap              m_buses;
+
+
+    public:
+
+        // Hold a share of a bus for as long as this remains in scope.
+        class Transfer
+        { //{{{
+        private:
+
+            BusScheduler   *m_sched;
+            std::string     m_bus;
+            size_t          m_rate;
+            bool            m_contended;
+
+
+        public:
+
+            // If bus is empty, the transfer is not scheduled at all.
+            Transfer( BusScheduler *sched, const std::string &bus, size_t rate )
+                : m_sched( bus.empty() ? NULL : sched )
+                , m_bus( bus )
+                , m_rate( rate )
+                , m_contended( false )
+            {
+                if( m_sched )
+                    m_contended = m_sched->Acquire( m_bus, m_rate );
+            }
+
+            ~Transfer()
+            {
+                if( m_sched )
+                    m_sched->Release( m_bus, m_rate );
+            }
+
+
+            // Return true if this had to wait for the bus, or others were
+            // waiting for it when we were admitted.
+            bool IsContended() const
+            {
+                return m_contended;
+            }
+
+        }; //}}}
 
-              #else   // MSB first
 
-               #ifdef SAMPLE_FALLING_EDGE
-                MPSSE_DATA_BYTE_IN_NEG_MSB,
-               #else
-                MPSSE_DATA_BYTE_IN_POS_MSB,
-               #endif
+        BusScheduler( size_t budget = DEFAULT_BUDGET )
+            : m_budget( budget )
+        {
+            Log<3>( "BusScheduler: budget %zu bytes/sec\n", budget );
 
-              #endif
+            pthread_mutex_init( &m_mutex, NULL );
+            pthread_cond_init( &m_cond, NULL );
+        }
 
-                uint8_t((len - 1) & 0xFF),
-                uint8_t((len - 1) >> 8),
+        ~BusScheduler()
+        {
+            pthread_cond_destroy( &m_cond );
+            pthread_mutex_destroy( &m_mutex );
+        }
 
-                MPSSE_SEND_IMMEDIATE
-            };
 
-            unsigned    reset_attempts = 0;
+        void SetBudget( size_t budget )
+        {
+            ScopedMutex     lock( &m_mutex );
 
-            try {
-                WriteCommand( cmd, sizeof(cmd) );
-                goto ok;
-            }
-            catch( const abi::__forced_unwind& ) { throw; }
-            BB_CATCH_STD( 0, stringprintf("BitBabbler::read( %zu ) exception", len).c_str() )
+            Log<3>( "BusScheduler: budget %zu -> %zu bytes/sec\n", m_budget, budget );
 
-            while( ++reset_attempts < FTDI_INIT_RETRIES ) {
-                // We shouldn't ever get here in normal operation, but if for some
-                // reason things back up and the USB write request fails, try once
-                // to reset the device and reissue the request before bailing out.
-                //
-                // We could also be here if the read repeatedly returns no data,
-                // which could happen if the command written was somehow corrupted
-                // in which case resetting the device is also the only way we can
-                // be sure of what state it is in.  We bound the maximum number of
-                // times that may be attempted while no error is being reported by
-                // any of these operations, but any real or permanent error should
-                // normally result in bailing out before that limit is reached.
-                LogMsg<1>( "BitBabbler::read( %zu ): attempting to reset device", len );
-                FTDI::Claim();
-                init_device();
-                WriteCommand( cmd, sizeof(cmd) );
+            m_budget = budget;
+            pthread_cond_broadcast( &m_cond );
+        }
 
-            ok:
-                LogMsg<6>( "BitBabbler::read( %zu ): wrote request", len );
+        size_t GetBudget()
+        {
+            ScopedMutex     lock( &m_mutex );
+            return m_budget;
+        }
 
-                size_t  count = 0;
-                size_t  n = 0;
 
-                do {
-                    size_t  ret = ftdi_read( buf + count, len - count );
+        // Wait until a read at rate bytes/sec fits within the budget for bus.
+        // Returns true if the bus was contended.
+        bool Acquire( const std::string &bus, size_t rate )
+        { //{{{
 
-                    if( __builtin_expect( ret > 0, 1 ) )
-                    {
-                        LogMsg<6>( "BitBabbler::read( %zu ): read %zu (n = %zu)",
-                                                                    len, ret, n );
-                        count += ret;
+            ScopedMutex     lock( &m_mutex );
+            Bus            &b = m_buses[bus];
+            bool            contended = b.waiting != 0;
 
-                        if( __builtin_expect( count == len, 1 ) )
-                        {
-                            // This is just to create buffer bloat errors,
-                            // mostly for testing the purge recovery code.
-                            //WriteCommand( cmd, sizeof(cmd) );
+            // Don't jump ahead of anything which is already waiting for it.
+            if( m_budget && b.reading && (b.waiting || b.rate + rate > m_budget) )
+            {
+                StageProfile::Timer t( StageProfile::BUS_WAIT );
+                WaitGuard           guard( b.waiting );
 
-                           #ifdef CHECK_EXCESS_BYTES
+                contended = true;
 
-                            if( __builtin_expect(GetReadAhead() != 0 ||
-                                                 GetLineStatus() != (FTDI_THRE | FTDI_TEMT), 0) )
-                            {
-                                size_t      ra = GetReadAhead();
-                                unsigned    ls = GetLineStatus();
+                Log<6>( "BusScheduler: waiting for bus %s (%zu + %zu bytes/sec)\n",
+                                                    bus.c_str(), b.rate, rate );
+                do {
+                    int ret = pthread_cond_wait( &m_cond, &m_mutex );
 
-                                ret = ftdi_read( buf, len );
+                    if( ret )
+                        throw SystemError( ret, "BusScheduler: pthread_cond_wait failed" );
 
-                                throw Error( _("BitBabbler::read( %zu ): Uh Oh excess data. "
-                                                "Buffered %zu, line status 0x%02x [%s ]"),
-                                                len, ra, ls,
-                                                OctetsToHex( OctetString( buf,
-                                                                          std::min(ret, size_t(8)) )
-                                                           ).c_str() );
-                            }
+                } while( m_budget && b.reading && b.rate + rate > m_budget );
+            }
 
-                           #endif
+            b.rate += rate;
+            ++b.reading;
 
-                            return len;
-                        }
+            return contended;
 
-                        n = 0;
-                    }
+        } //}}}
+
+        void Release( const std::string &bus, size_t rate )
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+            Bus            &b = m_buses[bus];
 
-                } while( ++n < FTDI_READ_RETRIES );
+            b.rate -= rate;
+            --b.reading;
 
-                LogMsg<1>( _("BitBabbler::read( %zu ) failed (n = %zu)"), len, n );
-            }
+            if( b.waiting )
+                pthread_cond_broadcast( &m_cond );
 
-            throw Error( _("BitBabbler::read( %zu ) failed after %u reset attempts"),
-                                                               len, reset_attempts );
         } //}}}
 
     }; //}}}
@@ -533,24 +1583,108 @@ namespace BitB
         struct Options
         { //{{{
 
+            std::string     name;                   // Empty for the default pool
             size_t          pool_size;
             std::string     kernel_device;
             unsigned        kernel_refill_time;     // in seconds
+            unsigned        kernel_credit_margin;   // in percent of measured entropy
+            size_t          usb_bus_budget;         // in bytes/sec, 0 for no limit
+
+            // If set, reads from USB sources will be scheduled with this,
+            // otherwise the pool will create its own using usb_bus_budget.
+            // Pools which share devices on the same buses should share it.
+            BusScheduler::Handle    bus_scheduler;
+
+            // If set, all of the waiting and timing done by the pool and its
+            // source threads will use this instead of the real system clock.
+            VirtualClock::Handle    clock;
 
 
             Options()
                 : pool_size( 65536 )
                 , kernel_device( "/dev/random" )
                 , kernel_refill_time( 60 )
+                , kernel_credit_margin( 2 )
+                , usb_bus_budget( BusScheduler::DEFAULT_BUDGET )
             {}
 
 
             std::string Str() const
             {
-                return stringprintf( "Size %zu, Kernel dev '%s', refill time %us",
+                return stringprintf( "%s%sSize %zu, Kernel dev '%s', refill time %us",
+                                     name.c_str(), name.empty() ? "" : ", ",
                                      pool_size, kernel_device.c_str(), kernel_refill_time );
             }
 
+            // The prefix for QA monitor IDs, so that each pool has its own.
+            std::string MonitorID( const char *id ) const
+            {
+                if( name.empty() )
+                    return id;
+
+                return stringprintf( "%s:%s", id, name.c_str() );
+            }
+
+        }; //}}}
+
+
+        // What a source, or a group of them, has contributed to the pool.
+        //{{{
+        // Output which was added while the pool was not full is counted as
+        // fresh, and output which could only be mixed into the entropy that
+        // it already held is counted as mixed.  A source which is spending
+        // most of its time doing the latter isn't really carrying any load.
+        //}}}
+        struct Contribution
+        { //{{{
+
+            unsigned long long  fresh;          // Bytes added while the pool wasn't full
+            unsigned long long  mixed;          // Bytes mixed into an already full pool
+            unsigned long long  dropped;        // Bytes discarded for failing QA
+            unsigned long long  idle_ms;        // Time throttled while the pool was full
+            unsigned long long  suspended_ms;   // Time with the source released
+            uint64_t            started_ms;     // When this accounting began
+
+
+            Contribution( uint64_t now = 0 )
+                : fresh( 0 )
+                , mixed( 0 )
+                , dropped( 0 )
+                , idle_ms( 0 )
+                , suspended_ms( 0 )
+                , started_ms( now )
+            {}
+
+
+            void AddOutput( size_t len, size_t new_bytes )
+            {
+                fresh += new_bytes;
+                mixed += len - new_bytes;
+            }
+
+            void AddIdle( uint64_t ms, bool suspended )
+            {
+                if( suspended )
+                    suspended_ms += ms;
+                else
+                    idle_ms += ms;
+            }
+
+            // The members of a JSON object with the totals and the average
+            // rates in bytes per second, without the enclosing braces.
+            std::string JSONFields( uint64_t now ) const
+            { //{{{
+
+                double  secs = now > started_ms ? double(now - started_ms) / 1000.0 : 0.0;
+                double  d    = secs > 0.0 ? secs : 1.0;
+
+                return stringprintf( "\"Seconds\":%.3f,\"Fresh\":%llu,\"Mixed\":%llu,"
+                                     "\"Dropped\":%llu,\"IdleMS\":%llu,\"SuspendedMS\":%llu,"
+                                     "\"FreshRate\":%.1f,\"MixedRate\":%.1f,\"DroppedRate\":%.1f",
+                                     secs, fresh, mixed, dropped, idle_ms, suspended_ms,
+                                     double(fresh) / d, double(mixed) / d, double(dropped) / d );
+            } //}}}
+
         }; //}}}
 
 
@@ -570,10 +1704,12 @@ namespace BitB
                 typedef std::list< Options >    List;
 
                 Group::ID   groupid;
-                size_t      size;
+                size_t      size;       // 0 for the size of the pool
+                bool        monitor;    // Check that the members are independent
 
 
                 Options( const char *arg )
+                    : monitor( false )
                 {
                     char           *e;
                     unsigned long   v = strtoul( arg, &e, 10 );
@@ -593,35 +1729,97 @@ namespace BitB
             Pool               *m_pool;
             ID                  m_id;
             size_t              m_size;
-            uint8_t            *m_buf;
+            BufferPool::Buffer  m_buf;
             Mask                m_filled;
+
+            // Each block is swapped out to here when it is filled, so it can
+            // be passed on to the Pool without holding m_mutex.  If that is
+            // still busy with the last one when another is filled, we fall
+            // back to copying it to a temporary buffer instead.
+            BufferPool::Buffer  m_out;
+            bool                m_out_busy;
             Mask                m_mask;
             unsigned            m_members;
+
+            // Standby sources are woken when fewer than the most active sources
+            // that this group has had are currently attached and passing QA,
+            // or if it has never had any active sources, when they are all it
+            // has to provide its output.
+            // While any standby source is contributing, we don't wait for the
+            // failing active sources to fill their share of the mixing buffer.
+            unsigned            m_active;
+            unsigned            m_active_max;
+            unsigned            m_active_ok;
+            Mask                m_standby;      // Members which are standby sources
+            Mask                m_idle;         // Standby members not contributing
+            Mask                m_failing;      // Active members not passing QA
+
+            // The accounting for the group as a whole, which includes members
+            // that have since been removed from it, and for each current member.
+            Contribution        m_total;
+            Contribution       *m_member[ sizeof(Mask) * 8 ];
+
+            // Only created if this group was asked to monitor its members.
+            QA::Correlation::Handle m_correlation;
+
             pthread_mutex_t     m_mutex;
+            pthread_cond_t      m_standbycond;
+
+
+            // You must hold m_mutex to call this
+            bool NeedStandby_() const
+            {
+                return m_active_max == 0 || m_active_ok < m_active_max;
+            }
+
+            // You must hold m_mutex to call this
+            bool IsFilled_() const
+            {
+                Mask    want = m_mask & ~m_idle;
+
+                if( m_standby & ~m_idle )
+                    want &= ~m_failing;
+
+                return (m_filled & want) == want;
+            }
 
 
         public:
 
-            Group( Pool *p, ID group_id, size_t size )
+            Group( Pool *p, ID group_id, size_t size, bool monitor = false )
                 : m_pool( p )
                 , m_id( group_id )
                 , m_size( powof2_up(size) )
-                , m_buf( new uint8_t[m_size] )
+                , m_buf( m_size )
                 , m_filled( 0 )
+                , m_out( m_size )
+                , m_out_busy( false )
                 , m_mask( 0 )
                 , m_members( 0 )
+                , m_active( 0 )
+                , m_active_max( 0 )
+                , m_active_ok( 0 )
+                , m_standby( 0 )
+                , m_idle( 0 )
+                , m_failing( 0 )
+                , m_total( p->now_ms() )
+                , m_correlation( monitor && group_id ? new QA::Correlation( m_size ) : NULL )
             {
-                Log<2>( "+ Pool::Group( %u, %zu )\n", m_id, m_size );
+                Log<2>( "+ Pool::Group( %u, %zu%s )\n", m_id, m_size,
+                                                 m_correlation != NULL ? ", monitor" : "" );
+
+                memset( m_member, 0, sizeof(m_member) );
 
                 pthread_mutex_init( &m_mutex, NULL );
+                pthread_cond_init( &m_standbycond, NULL );
             }
 
             ~Group()
             {
                 Log<2>( "- Pool::Group( %u, %zu )\n", m_id, m_size );
 
+                pthread_cond_destroy( &m_standbycond );
                 pthread_mutex_destroy( &m_mutex );
-                delete [] m_buf;
             }
 
 
@@ -684,7 +1882,127 @@ namespace BitB
             } //}}}
 
 
-            void AddEntropy( Mask m, uint8_t *b, size_t len )
+            // Track the state of the active (non-standby) sources in this group.
+            // A newly added source isn't counted as being ok until it has first
+            // passed QA, and if it is removed while it was ok, that is the same
+            // as if it had failed, until it (or some replacement) is added back.
+            void AddMember( Mask m, bool standby, Contribution *c )
+            { //{{{
+
+                ScopedMutex     lock( &m_mutex );
+
+                if( m )
+                {
+                    m_member[ __builtin_ctz(m) ] = c;
+
+                    if( m_correlation != NULL )
+                        m_correlation->AddMember( unsigned(__builtin_ctz(m)) );
+                }
+
+                if( standby )
+                {
+                    m_standby |= m;
+                    return;
+                }
+
+                m_failing |= m;
+
+                if( ++m_active > m_active_max )
+                    m_active_max = m_active;
+
+                m_pool->cond_broadcast( &m_standbycond );
+
+            } //}}}
+
+            void RemoveMember( Mask m, bool standby, bool was_ok )
+            { //{{{
+
+                ScopedMutex     lock( &m_mutex );
+
+                if( m )
+                {
+                    m_member[ __builtin_ctz(m) ] = NULL;
+
+                    if( m_correlation != NULL )
+                        m_correlation->RemoveMember( unsigned(__builtin_ctz(m)) );
+                }
+
+                m_standby &= ~m;
+                m_idle    &= ~m;
+                m_failing &= ~m;
+
+                if( standby )
+                    return;
+
+                --m_active;
+
+                if( was_ok )
+                    --m_active_ok;
+
+                m_pool->cond_broadcast( &m_standbycond );
+
+            } //}}}
+
+            void SetActiveOK( Mask m, bool &state, bool ok )
+            { //{{{
+
+                ScopedMutex     lock( &m_mutex );
+
+                if( state == ok )
+                    return;
+
+                state = ok;
+
+                if( ok )
+                {
+                    ++m_active_ok;
+                    m_failing &= ~m;
+                } else {
+                    --m_active_ok;
+                    m_failing |= m;
+                }
+
+                Log<3>( "Pool::Group(%u): %u of %u active sources ok\n",
+                                            m_id, m_active_ok, m_active_max );
+
+                m_pool->cond_broadcast( &m_standbycond );
+
+            } //}}}
+
+            bool NeedStandby()
+            {
+                ScopedMutex     lock( &m_mutex );
+                return NeedStandby_();
+            }
+
+            // Block standby member m until it is needed by this group.
+            void WaitForStandby( Mask m )
+            { //{{{
+
+                ScopedMutex     lock( &m_mutex );
+
+                m_idle   |= m;
+                m_filled &= ~m;
+
+                while( ! NeedStandby_() )
+                {
+                    int ret = m_pool->cond_wait( &m_standbycond, &m_mutex );
+
+                    if( ret )
+                    {
+                        m_idle &= ~m;
+                        throw SystemError( ret, "pthread_cond_wait failed: %s",
+                                                               strerror(ret) );
+                    }
+                }
+
+                m_idle &= ~m;
+
+            } //}}}
+
+
+            // Add a block from member m, which is accounted to c.
+            void AddEntropy( Mask m, Contribution &c, uint8_t *b, size_t len )
             { //{{{
 
                 if( len == 0 )
@@ -703,11 +2021,25 @@ namespace BitB
                     // only one source in this group (or if this is group 0).
                     m_filled = 0;
 
+                    // Don't leave a partial round for a member that rejoins.
+                    if( m_correlation != NULL )
+                        m_correlation->EndRound();
+
                     lock.Unlock();
-                    m_pool->AddEntropy( b, len );
+                    size_t  fresh = m_pool->AddEntropy( b, len );
+
+                    lock.Lock( &m_mutex );
+                    c.AddOutput( len, fresh );
+                    m_total.AddOutput( len, fresh );
+                    lock.Unlock();
+
+                    BB_TRACE4( group__add, m_id, m, len, true );
                     return;
                 }
 
+                if( m_correlation != NULL )
+                    m_correlation->AddBlock( unsigned(__builtin_ctz(m)), b, len );
+
                 if( ! m_filled )
                 {
                     memcpy( m_buf, b, len );
@@ -723,22 +2055,137 @@ namespace BitB
 
                 Log<5>("Group %u:%x: filled %x\n", m_id, m, m_filled);
 
-                if( m_filled == m_mask )
+                if( IsFilled_() )
                 {
-                    uint8_t buf[m_size];
+                    BufferPool::Buffer  buf;
+                    Mask                contributors = m_filled;
+                    bool                swapped      = ! m_out_busy;
+
+                    if( swapped )
+                    {
+                        m_buf.swap( m_out );
+                        m_out_busy = true;
+                    }
+                    else
+                    {
+                        buf.Reset( m_size );
+                        memcpy( buf, m_buf, m_size );
+                    }
 
-                    memcpy( buf, m_buf, m_size );
                     m_filled = 0;
 
+                    if( m_correlation != NULL )
+                        m_correlation->EndRound();
+
+                    lock.Unlock();
+                    size_t  fresh = m_pool->AddEntropy( swapped ? m_out : buf, m_size );
+
+                    // Every member that contributed to this block is credited
+                    // with all of it, since it was mixed from all of them.
+                    lock.Lock( &m_mutex );
+
+                    if( swapped )
+                        m_out_busy = false;
+                    m_total.AddOutput( m_size, fresh );
+
+                    for( Mask i = contributors; i; i &= i - 1 )
+                    {
+                        Contribution   *mc = m_member[ __builtin_ctz(i) ];
+
+                        if( mc )
+                            mc->AddOutput( m_size, fresh );
+                    }
+
                     lock.Unlock();
-                    m_pool->AddEntropy( buf, m_size );
+
+                    BB_TRACE4( group__add, m_id, m, len, true );
+                    return;
                 }
 
+                BB_TRACE4( group__add, m_id, m, len, false );
+
+            } //}}}
+
+
+            void AddDropped( Contribution &c, size_t len )
+            {
+                ScopedMutex     lock( &m_mutex );
+
+                c.dropped       += len;
+                m_total.dropped += len;
+            }
+
+            void AddIdle( Contribution &c, uint64_t ms, bool suspended )
+            {
+                ScopedMutex     lock( &m_mutex );
+
+                c.AddIdle( ms, suspended );
+                m_total.AddIdle( ms, suspended );
+            }
+
+            // Return a consistent copy of the accounting for member c.
+            Contribution GetContribution( const Contribution &c )
+            {
+                ScopedMutex     lock( &m_mutex );
+                return c;
+            }
+
+            // As above, and also return the state that SetActiveOK tracks
+            // for that member in ok.
+            Contribution GetContribution( const Contribution &c, const bool &state, bool &ok )
+            {
+                ScopedMutex     lock( &m_mutex );
+
+                ok = state;
+                return c;
+            }
+
+            Contribution GetTotal()
+            {
+                ScopedMutex     lock( &m_mutex );
+                return m_total;
+            }
+
+            bool HasMonitor() const
+            {
+                return m_correlation != NULL;
+            }
+
+            // Return a JSON object with the independence of the members of
+            // this group, or an empty string if it is not monitoring them.
+            std::string GetCorrelation()
+            { //{{{
+
+                if( ! m_correlation )
+                    return std::string();
+
+                ScopedMutex     lock( &m_mutex );
+                return m_correlation->AsJSON();
+
             } //}}}
 
         }; //}}}
 
 
+        // The current state of one source, and what it has contributed.
+        struct SourceStatus
+        { //{{{
+
+            typedef std::list< SourceStatus >   List;
+
+            std::string     pool;       // Empty for the default pool
+            std::string     id;
+            unsigned        group;
+            unsigned        bitrate;
+            bool            standby;
+            bool            ok;         // Passing QA, if not standby
+            uint64_t        age_ms;     // Time since accounting began
+            Contribution    stats;
+            EntropySource::RecoveryCounts   recovered;
+
+        }; //}}}
+
+
     private:
 
         struct Source : public RefCounted
@@ -749,31 +2196,55 @@ namespace BitB
 
 
             Pool                   *pool;
-            uint8_t                *buf;
+            BufferPool::Buffer      buf;
             size_t                  size;
             Group::Handle           group;
             Group::Mask             groupmask;
-            BitBabbler::Handle      babbler;
+            EntropySource::Handle   source;
             pthread_t               thread;
+            bool                    standby;
+            bool                    ok;         // Passing QA, if not standby
+            Contribution            stats;      // Guarded by the group mutex
+
+
+            static size_t input_size( const Group::Handle         &g,
+                                      const EntropySource::Handle &src )
+            { //{{{
+
+                Conditioner::Ratio  r = src->GetConditioning();
+
+                if( ! r.IsSet() )
+                    return g->GetSize() * (1u << src->GetMaxFolding());
 
+                if( g->GetSize() % Conditioner::OUTPUT_BYTES )
+                    throw Error( _("Pool::Source( %s ): group %u size %zu is not a multiple "
+                                   "of %zu, it can't be used with conditioning"),
+                                 src->GetID().c_str(), g->GetID(), g->GetSize(),
+                                 size_t(Conditioner::OUTPUT_BYTES) );
 
-            Source( Pool                       *p,
-                    const Group::Handle        &g,
-                    const BitBabbler::Handle   &b )
+                return Conditioner( r ).InputSize( g->GetSize() );
+
+            } //}}}
+
+
+            Source( Pool                        *p,
+                    const Group::Handle         &g,
+                    const EntropySource::Handle &src )
                 : pool( p )
-                , size( g->GetSize() * (1u << b->GetFolding()) )
+                , size( input_size( g, src ) )
                 , group( g )
                 , groupmask( g->GetNextMask() )
-                , babbler( b )
+                , source( src )
+                , standby( src->IsStandby() )
+                , ok( false )
+                , stats( p->now_ms() )
             {
-                Log<2>( "+ Pool::Source( %u:%u, %zu, %s )\n", group->GetID(), groupmask,
-                                                    size, babbler->GetSerial().c_str() );
-                if( size < babbler->GetChunkSize() )
-                    throw Error( _("Pool::Source( %u:%u, %s ): size %zu < chunksize %zu"),
-                                   group->GetID(), groupmask, babbler->GetSerial().c_str(),
-                                                        size, babbler->GetChunkSize() );
+                Log<2>( "+ Pool::Source( %u:%u, %zu, %s%s )\n", group->GetID(), groupmask,
+                                size, source->GetID().c_str(), standby ? ", standby" : "" );
 
-                buf = new uint8_t[size];
+                buf.Reset( size );
+
+                group->AddMember( groupmask, standby, &stats );
 
                 // Bump the refcount until the thread is started, otherwise we
                 // may lose a race with this Source being released by the caller
@@ -781,14 +2252,22 @@ namespace BitB
                 // Think of it as a virtual Handle passed with pthread_create.
                 Ref();
 
+                // Likewise, don't let a virtual clock run ahead of it starting.
+                if( pool->m_opt.clock != NULL )
+                    pool->m_opt.clock->AddThread();
+
                 // We don't need to Unref() if this fails, because we'll throw
                 // and it will never have been constructed to be destroyed ...
                 int ret = pthread_create( &thread, GetDefaultThreadAttr(),
                                           Pool::source_thread, this );
                 if( ret )
                 {
+                    if( pool->m_opt.clock != NULL )
+                        pool->m_opt.clock->RemoveThread();
+
+                    group->RemoveMember( groupmask, standby, false );
+
                     group->ReleaseMask( groupmask );
-                    delete [] buf;
 
                     throw SystemError( ret, _("Pool::Source: failed to create thread") );
                 }
@@ -797,9 +2276,10 @@ namespace BitB
             ~Source()
             {
                 Log<2>( "- Pool::Source( %u:%u, %zu, %s )\n", group->GetID(), groupmask,
-                                                    size, babbler->GetSerial().c_str() );
+                                                        size, source->GetID().c_str() );
+                group->RemoveMember( groupmask, standby, ok );
+
                 group->ReleaseMask( groupmask );
-                delete [] buf;
             }
 
         }; //}}}
@@ -826,25 +2306,83 @@ namespace BitB
                 , user_data( user_data )
             {}
 
-        }; //}}}
+        }; //}}}
+
+
+        typedef std::list< pthread_t >      ThreadList;
+        typedef std::list< Pool* >          List;
+
+
+        // Every Pool which currently exists, so their contributions can be
+        // reported from places which don't otherwise know about them all.
+        static List             ms_pools;
+        static pthread_mutex_t  ms_pools_mutex;
+
+
+        Options             m_opt;
+
+        BufferPool::Buffer  m_buf;
+        size_t              m_fill;
+        size_t              m_next;
+
+        Group::Map          m_groups;
+        Source::List        m_sources;
+        ThreadList          m_threads;
+
+        DemandForecast      m_forecast;
+
+        pthread_mutex_t     m_mutex;
+        pthread_cond_t      m_sourcecond;
+        pthread_cond_t      m_sinkcond;
+
+
+        // Return a time in milliseconds from the clock which the pool is using.
+        uint64_t now_ms() const
+        {
+            if( m_opt.clock != NULL )
+                return m_opt.clock->Now() / 1000;
+
+            return GetMonotonicUS() / 1000;
+        }
 
+        // Wait on cond for up to ms milliseconds, or until it is signalled if
+        // ms is unsigned(-1), using the clock which the pool is using.  The
+        // return value is the same as for pthread_cond_timedwait.
+        int cond_wait( pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                             unsigned ms = unsigned(-1) )
+        { //{{{
 
-        typedef std::list< pthread_t >      ThreadList;
+            if( m_opt.clock != NULL )
+                return m_opt.clock->Wait( cond, mutex, ms == unsigned(-1) ? uint64_t(-1)
+                                                                          : uint64_t(ms) * 1000 )
+                            ? 0 : ETIMEDOUT;
 
+            if( ms == unsigned(-1) )
+                return pthread_cond_wait( cond, mutex );
 
-        const Options       m_opt;
+            timespec    wait_until;
 
-        uint8_t            *m_buf;
-        size_t              m_fill;
-        size_t              m_next;
+            GetFutureTimespec( wait_until, ms );
+            return pthread_cond_timedwait( cond, mutex, &wait_until );
 
-        Group::Map          m_groups;
-        Source::List        m_sources;
-        ThreadList          m_threads;
+        } //}}}
 
-        pthread_mutex_t     m_mutex;
-        pthread_cond_t      m_sourcecond;
-        pthread_cond_t      m_sinkcond;
+        // Sleep for ms milliseconds, using the clock which the pool is using.
+        void sleep_ms( unsigned ms )
+        {
+            if( m_opt.clock != NULL )
+                m_opt.clock->Sleep( uint64_t(ms) * 1000 );
+            else
+                usleep( useconds_t(ms) * 1000 );
+        }
+
+        void cond_broadcast( pthread_cond_t *cond )
+        {
+            if( m_opt.clock != NULL )
+                m_opt.clock->Broadcast( cond );
+
+            pthread_cond_broadcast( cond );
+        }
 
 
         // You must hold m_mutex to call this
@@ -859,14 +2397,17 @@ namespace BitB
             return PoolIsFull_();
         }
 
-        void AddEntropy( uint8_t *buf, size_t len )
+        // Returns the number of bytes that were added to the pool while it
+        // was not full, with the rest of them mixed into what it already had.
+        size_t AddEntropy( uint8_t *buf, size_t len )
         { //{{{
 
             if( len == 0 )
-                return;
+                return 0;
 
-            ScopedMutex     lock( &m_mutex );
-            size_t          n = 0;
+            StageProfile::Timer t( StageProfile::POOL_ADD );
+            ScopedMutex         lock( &m_mutex );
+            size_t              n = 0;
 
             if( m_fill < m_opt.pool_size )
             {
@@ -879,9 +2420,11 @@ namespace BitB
                 n = b;
                 m_fill += b;
 
-                pthread_cond_broadcast( &m_sinkcond );
+                cond_broadcast( &m_sinkcond );
             }
 
+            size_t  fresh = n;
+
             while( n < len )
             {
                 size_t  b = std::min( m_opt.pool_size - m_next, len - n );
@@ -898,6 +2441,10 @@ namespace BitB
                     m_next = 0;
             }
 
+            BB_TRACE3( pool__add, m_opt.name.c_str(), len, m_fill );
+
+            return fresh;
+
         } //}}}
 
 
@@ -929,93 +2476,180 @@ namespace BitB
             //   with 0 meaning sleep indefinitely once MIN_SLEEP is exceeded.
             // - INITIAL_SLEEP is the duration we start doubling from once the
             //   Pool is full, with 0 meaning sleep indefinitely immediately.
-            static const unsigned   MIN_SLEEP       = 512;
-            static const unsigned   MAX_SLEEP       = s->babbler->GetIdleSleepMax();
-            static const unsigned   INITIAL_SLEEP   = s->babbler->GetIdleSleepInit();
-            static const unsigned   SUSPEND_AFTER   = s->babbler->GetSuspendAfter();
-
-            SetThreadName( s->babbler->GetSerial().substr(0,15) );
-
-            s->babbler->LogMsg<3>( "Pool: begin source_thread (idle sleep %u:%u, suspend %u)",
-                                                    INITIAL_SLEEP, MAX_SLEEP, SUSPEND_AFTER );
-
-            // At rates of 5Mbps or greater, wait for the first Ent8 test results
-            // before declaring the source is generating an acceptable quality of
-            // entropy.  Below that let it come online if the FIPS tests aren't
-            // rejecting it, with at least 20 consecutive blocks having passed.
-            HealthMonitor   qa( s->babbler->GetSerial(),
-                                s->babbler->GetBitrate() < 5000000 );
-
-            size_t          read_size   = s->babbler->GetChunkSize();
-            unsigned        fold        = s->babbler->GetFolding();
-            bool            no_qa       = s->babbler->NoQA();
+            // - SUSPEND_AFTER is the shortest sleep we will release the source
+            //   for, with 0 meaning never release it.  Once we have measured
+            //   how long it takes to Claim it again, this will be raised to
+            //   RESUME_RATIO times that, if that is longer, so that the cost
+            //   of resuming it is only ever a small part of the time it was
+            //   suspended for.
+            //
+            // These are not static, since each source may have its own settings.
+            const unsigned  MIN_SLEEP       = 512;
+            const unsigned  MAX_SLEEP       = s->source->GetIdleSleepMax();
+            const unsigned  INITIAL_SLEEP   = s->source->GetIdleSleepInit();
+            const unsigned  SUSPEND_AFTER   = s->source->GetSuspendAfter();
+            const unsigned  RESUME_RATIO    = 64;
+            const bool      STANDBY         = s->standby;
+
+            SetThreadName( s->source->GetID().substr(0,15) );
+
+            s->source->LogMsg<3>( "Pool: begin source_thread (idle sleep %u:%u, suspend %u%s)",
+                                INITIAL_SLEEP, MAX_SLEEP, SUSPEND_AFTER, STANDBY ? ", standby" : "" );
+
+            HealthMonitor   qa( s->source->GetID(), s->source->AssumeEnt8OK() );
+            StageProfile    profile( s->source->GetID() );
+
+            size_t          chunk_max   = std::min( s->source->GetChunkSize(), s->size );
+            size_t          chunk_min   = std::min( chunk_max, size_t(4096) );
+            const std::string   BUS     = s->source->GetBusID();
+            size_t          read_size   = chunk_max;
+
+            if( ! BUS.empty() )
+                s->source->LogMsg<3>( "Pool: reads scheduled on USB bus %s, chunk size %zu:%zu",
+                                                            BUS.c_str(), chunk_min, chunk_max );
+            unsigned        fold        = s->source->GetFolding();
+            Conditioner::Ratio  ratio   = s->source->GetConditioning();
+            Conditioner     conditioner( ratio );
+            const unsigned  FOLD_MIN    = ratio.IsSet() ? fold : s->source->GetMinFolding();
+            const unsigned  FOLD_MAX    = ratio.IsSet() ? fold : s->source->GetMaxFolding();
+            const unsigned  RATE_MIN    = s->source->GetMinBitrate();
+            const unsigned  RATE_MAX    = s->source->GetMaxBitrate();
+            const bool      AUTOTUNE    = FOLD_MIN != FOLD_MAX || RATE_MIN != RATE_MAX;
+            QAFeedback      feedback;
+            size_t          size        = ratio.IsSet() ? s->size
+                                                        : s->group->GetSize() << fold;
+            bool            no_qa       = s->source->NoQA();
+            bool            passed      = false;
+            unsigned        errors      = 0;
             unsigned        sleep_for   = 0;
+            unsigned        suspend     = SUSPEND_AFTER;
+            unsigned        resume_cost = 0;
 
 
             for(;;) try {
 
-                s->babbler->Claim();
+                s->source->Claim();
 
                 for(;;)
                 {
-                    if( __builtin_expect( sleep_for == unsigned(-1), 0 ) )
+                    // Once a standby source has shown that it is passing QA, it is
+                    // released until some active source in its group is failing or
+                    // removed, and then returns to standby when they all recover.
+                    if( __builtin_expect( STANDBY && passed, 0 ) && ! s->group->NeedStandby() )
+                    {
+                        s->source->LogMsg<1>( "Pool: entering standby" );
+                        s->source->Release();
+
+                        uint64_t    t = now_ms();
+
+                        s->group->WaitForStandby( s->groupmask );
+                        s->group->AddIdle( s->stats, now_ms() - t, true );
+
+                        s->source->LogMsg<1>( "Pool: activating standby" );
+                        s->source->Claim();
+                        sleep_for = 0;
+                    }
+
+                    if( __builtin_expect( sleep_for >= MIN_SLEEP, 0 ) )
                     {
-                        // Sleep until we're explicitly woken by the pool being read from.
+                        // Sleep until explicitly woken or the timeout expires,
+                        // where a sleep_for of unsigned(-1) has no timeout.
                         ScopedMutex     lock( &m_mutex );
 
                         if( __builtin_expect( PoolIsFull_(), 1 ) )
                         {
-                            s->babbler->LogMsg<6>( "Pool: source_thread waiting for wakeup" );
+                            unsigned    wait_for    = sleep_for;
+                            unsigned    demand      = m_forecast.NextBurst( now_ms() );
+                            bool        release     = suspend && sleep_for >= suspend;
+
+                            // If we expect the pool to be drained again before it would
+                            // be worth suspending the source, keep it claimed, otherwise
+                            // wake early enough to have resumed it before that happens.
+                            if( release && demand != unsigned(-1) )
+                            {
+                                unsigned    lead = resume_cost + MIN_SLEEP;
+
+                                if( demand < lead + suspend )
+                                    release = false;
+                                else if( demand - lead < wait_for )
+                                    wait_for = demand - lead;
+                            }
+
+                            if( wait_for == unsigned(-1) )
+                                s->source->LogMsg<6>( "Pool: source_thread waiting for wakeup" );
+                            else if( wait_for != sleep_for )
+                                s->source->LogMsg<5>( "Pool: source_thread sleeping for %ums, "
+                                                      "before demand forecast in %ums",
+                                                      wait_for, demand );
+                            else
+                                s->source->LogMsg<6>( "Pool: source_thread sleeping for %ums",
+                                                                                    wait_for );
+                            if( release )
+                                s->source->Release();
+
+                            BB_TRACE3( source__sleep, s->source->GetID().c_str(),
+                                                      wait_for, release );
+
+                            uint64_t    slept = now_ms();
+                            int         ret   = cond_wait( &m_sourcecond, &m_mutex, wait_for );
 
-                            if( SUSPEND_AFTER )
-                                s->babbler->Release();
+                            BB_TRACE2( source__wake, s->source->GetID().c_str(),
+                                                     ret == ETIMEDOUT );
 
-                            int ret = pthread_cond_wait( &m_sourcecond, &m_mutex );
+                            s->group->AddIdle( s->stats, now_ms() - slept, release );
 
-                            if( ret )
+                            if( ret && ret != ETIMEDOUT )
                                 throw SystemError( ret, "pthread_cond_wait failed: %s",
                                                                        strerror(ret) );
-                            if( SUSPEND_AFTER )
+                            if( release )
                             {
                                 lock.Unlock();
-                                s->babbler->Claim();
-                            }
-                        }
-                    }
-                    else if( __builtin_expect( sleep_for >= MIN_SLEEP, 0 ) )
-                    {
-                        // Sleep until explicitly woken or the timeout expires.
-                        timespec        wait_until;
 
-                        GetFutureTimespec( wait_until, sleep_for );
+                                uint64_t    t = now_ms();
 
-                        ScopedMutex     lock( &m_mutex );
+                                s->source->Claim();
 
-                        if( __builtin_expect( PoolIsFull_(), 1 ) )
-                        {
-                            s->babbler->LogMsg<6>( "Pool: source_thread sleeping for %ums",
-                                                                                sleep_for );
-                            if( SUSPEND_AFTER && sleep_for >= SUSPEND_AFTER )
-                                s->babbler->Release();
+                                // Track a moving average of the time it takes to resume.
+                                unsigned    c = unsigned( now_ms() - t );
 
-                            int ret = pthread_cond_timedwait( &m_sourcecond, &m_mutex, &wait_until );
+                                resume_cost = resume_cost ? (resume_cost * 3 + c) / 4 : std::max( c, 1u );
+                                suspend     = std::max( SUSPEND_AFTER, resume_cost * RESUME_RATIO );
 
-                            if( ret && ret != ETIMEDOUT )
-                                throw SystemError( ret, "pthread_cond_timedwait failed: %s",
-                                                                            strerror(ret) );
-                            if( SUSPEND_AFTER && sleep_for >= SUSPEND_AFTER )
-                            {
-                                lock.Unlock();
-                                s->babbler->Claim();
+                                s->source->LogMsg<5>( "Pool: resumed in %ums (avg %ums), "
+                                                      "suspend after %ums", c, resume_cost, suspend );
                             }
                         }
                     }
 
 
-                    for( size_t p = 0, n = 0; p <= s->size - read_size; p += n )
-                        n = s->babbler->read( s->buf + p, read_size );
+                    // Halve the size of reads while the bus is contended, so the
+                    // sources sharing it take turns in smaller slices, and grow it
+                    // back to the preferred size again while it is not.
+                    for( size_t p = 0, n = 0; p < size; p += n )
+                    {
+                        BusScheduler::Transfer  xfer( m_opt.bus_scheduler.Raw(), BUS,
+                                                      s->source->GetBitrate() / 8 );
+
+                        n = s->source->read( s->buf + p, std::min( read_size, size - p ) );
+
+                        if( xfer.IsContended() )
+                            read_size = std::max( read_size / 2, chunk_min );
+                        else
+                            read_size = std::min( read_size * 2, chunk_max );
+                    }
+
+                    // When conditioning, the QA checks must see the raw input.
+                    // The output of the hash would pass them no matter how little
+                    // entropy that had, so checking it would tell us nothing.
+                    if( ratio.IsSet() )
+                        passed = qa.Check( s->buf, size );
 
-                    size_t n = FoldBytes( s->buf, s->size, fold );
+                    size_t n;
+                    {
+                        StageProfile::Timer t( StageProfile::FOLD );
+                        n = ratio.IsSet() ? conditioner.Condition( s->buf, size )
+                                          : FoldBytes( s->buf, size, fold );
+                    }
 
 
                     if( __builtin_expect( PoolIsFull(), 0 ) )
@@ -1052,39 +2686,102 @@ namespace BitB
                     // action of their own in response to the alert, and this likewise
                     // will ensure they have as much data as possible, as quickly as
                     // possible to base that decision on.
-                    if( __builtin_expect( qa.Check( s->buf, n ) || no_qa, 1 ) )
-                        s->group->AddEntropy( s->groupmask, s->buf, n );
+                    if( ! ratio.IsSet() )
+                        passed = qa.Check( s->buf, n );
+
+                    if( __builtin_expect( passed || no_qa, 1 ) )
+                    {
+                        StageProfile::Timer t( StageProfile::GROUP_ADD );
+                        s->group->AddEntropy( s->groupmask, s->stats, s->buf, n );
+                    }
                     else
+                    {
+                        s->group->AddDropped( s->stats, n );
                         sleep_for = 0;
+                    }
+
+                    if( ! STANDBY )
+                    {
+                        if( passed )
+                            errors = 0;
+
+                        if( __builtin_expect( passed != s->ok, 0 ) )
+                            s->group->SetActiveOK( s->groupmask, s->ok, passed );
+                    }
+
+                    // If we're free to choose the fold and/or bitrate, let the QA
+                    // results steer them.  The bitrate is adjusted in fine steps,
+                    // and increased before folding is reduced.  Folding is coarse,
+                    // so if there's any of it to spare, it is the first thing that
+                    // we increase again when the quality drops, before easing off
+                    // the bitrate if that doesn't bring it back.  When conditioning,
+                    // the folding is fixed, and qa is measuring the raw input, so
+                    // the bitrate is steered by what the device really produces,
+                    // not by the hash output, which would always look ideal.
+                    if( __builtin_expect( AUTOTUNE, 0 ) )
+                    {
+                        unsigned    rate = s->source->GetBitrate();
+
+                        switch( feedback.Update( qa, rate < RATE_MAX || fold > FOLD_MIN,
+                                                     rate > RATE_MIN || fold < FOLD_MAX ) )
+                        {
+                            case QAFeedback::HOLD:
+                                break;
+
+                            case QAFeedback::INCREASE:
+                                if( rate < RATE_MAX )
+                                    s->source->SetBitrate( BitBabbler::HigherBitrate( rate ) );
+                                else
+                                    --fold;
+                                break;
+
+                            case QAFeedback::DECREASE:
+                                if( fold < FOLD_MAX )
+                                    ++fold;
+                                else
+                                    s->source->SetBitrate( BitBabbler::LowerBitrate( rate ) );
+                                break;
+                        }
+
+                        if( rate != s->source->GetBitrate() )
+                        {
+                            s->source->LogMsg<1>( "Pool: auto-bitrate changed from %u to %u",
+                                                            rate, s->source->GetBitrate() );
+
+                            // The chunk size is chosen to suit the bitrate.
+                            chunk_max = std::min( s->source->GetChunkSize(), s->size );
+                            chunk_min = std::min( chunk_max, size_t(4096) );
+                            read_size = std::min( std::max( read_size, chunk_min ), chunk_max );
+                        }
+
+                        if( ! ratio.IsSet() && size != s->group->GetSize() << fold )
+                        {
+                            s->source->LogMsg<1>( "Pool: auto-fold changed to %u", fold );
+                            size = s->group->GetSize() << fold;
+                        }
+                    }
                 }
             }
-            catch( const USBError &e )
+            catch( const std::exception &e )
             {
-                // Don't warn about enum values not being explicitly handled here,
-                // we don't want to have to chase every new error code added to
-                // libusb that we don't explicitly care about handling here.
-                EM_PUSH_DIAGNOSTIC_IGNORE("-Wswitch-enum")
+                // An active source which fails repeatedly without a good block
+                // in between is counted as failed, so that a standby source can
+                // cover for it while it is trying to recover.
+                if( ! STANDBY && ++errors > 1 )
+                    s->group->SetActiveOK( s->groupmask, s->ok, false );
 
-                switch( e.GetErrorCode() )
-                {
-                    case LIBUSB_ERROR_PIPE:
-                        s->babbler->LogMsg<1>( "Pool source_thread caught (device %sclaimed): %s",
-                                                s->babbler->IsClaimed() ? "": "un", e.what() );
-                        s->babbler->Release();
-                        break;
+                passed = false;
 
-                    case LIBUSB_ERROR_TIMEOUT:
-                    case LIBUSB_ERROR_OTHER:
-                        s->babbler->LogMsg<1>( "Pool source_thread caught: %s", e.what() );
+                unsigned    delay = 0;
 
-                        s->babbler->SoftReset();
-                        s->babbler->FTDI::Release();
-                        break;
+                if( ! s->source->Recover( e, delay ) )
+                    throw;
 
-                    default:
-                        throw;
+                if( delay )
+                {
+                    s->source->LogMsg<2>( "Pool: waiting %ums before claiming it again", delay );
+                    sleep_ms( delay );
                 }
-                EM_POP_DIAGNOSTIC
             }
 
         } //}}}
@@ -1092,7 +2789,8 @@ namespace BitB
         static void *source_thread( void *p )
         { //{{{
 
-            Source::Handle  s = static_cast<Source*>( p );
+            Source::Handle              s = static_cast<Source*>( p );
+            VirtualClock::ThreadGuard   clock( s->pool->m_opt.clock );
 
             // Drop the 'virtual handle' from the ctor, we have a real one now.
             s->Unref();
@@ -1102,10 +2800,10 @@ namespace BitB
             }
             catch( const abi::__forced_unwind& )
             {
-                s->babbler->LogMsg<3>( "Pool: source_thread cancelled" );
+                s->source->LogMsg<3>( "Pool: source_thread cancelled" );
                 throw;
             }
-            BB_CATCH_STD( 0, s->babbler->MsgStr( _("uncaught source_thread exception") ).c_str() )
+            BB_CATCH_STD( 0, s->source->MsgStr( _("uncaught source_thread exception") ).c_str() )
 
             s->pool->detach_source( s );
             return NULL;
@@ -1135,6 +2833,8 @@ namespace BitB
         { //{{{
 
             WriteFD::Handle     w = static_cast<WriteFD*>( p );
+            StageProfile        profile( w->pool->MonitorID(
+                                            stringprintf( "FD %d", w->fd ).c_str() ) );
 
             SetThreadName( "write fd" );
 
@@ -1192,7 +2892,8 @@ namespace BitB
 
     public:
 
-        typedef RefPtr< Pool >      Handle;
+        typedef RefPtr< Pool >                  Handle;
+        typedef std::map< std::string, Handle > Map;
 
 
         Pool( const Options &options = Options() )
@@ -1203,17 +2904,28 @@ namespace BitB
 
             Log<2>( "+ Pool( %s )\n", m_opt.Str().c_str() );
 
-            m_buf = new uint8_t[m_opt.pool_size];
+            if( m_opt.bus_scheduler == NULL )
+                m_opt.bus_scheduler = new BusScheduler( m_opt.usb_bus_budget );
+
+            m_buf.Reset( m_opt.pool_size );
 
             pthread_mutex_init( &m_mutex, NULL );
             pthread_cond_init( &m_sourcecond, NULL );
             pthread_cond_init( &m_sinkcond, NULL );
 
+            pthread_mutex_lock( &ms_pools_mutex );
+            ms_pools.push_back( this );
+            pthread_mutex_unlock( &ms_pools_mutex );
+
         } //}}}
 
         ~Pool()
         { //{{{
 
+            pthread_mutex_lock( &ms_pools_mutex );
+            ms_pools.remove( this );
+            pthread_mutex_unlock( &ms_pools_mutex );
+
             pthread_mutex_lock( &m_mutex );
 
             Log<3>( "Pool: terminating threads\n" );
@@ -1286,141 +2998,432 @@ namespace BitB
             for( Source::List::iterator i = s.begin(), e = s.end(); i != e; ++ i )
                 pthread_join( (*i)->thread, NULL );
 
-           #endif
+           #endif
+
+            pthread_cond_destroy( &m_sinkcond );
+            pthread_cond_destroy( &m_sourcecond );
+            pthread_mutex_destroy( &m_mutex );
+
+            Log<2>( "- Pool( %s )\n", m_opt.Str().c_str() );
+
+        } //}}}
+
+
+        // Group size will be rounded up to a power of 2, a size of 0 will use
+        // the size of this pool.  If monitor is true, the group will check that
+        // the output of its members is independent before they are mixed.
+        void AddGroup( Group::ID group_id, size_t size, bool monitor = false )
+        { //{{{
+
+            Log<2>( "Pool::AddGroup( %u, %zu%s )\n", group_id, size, monitor ? ", monitor" : "" );
+
+            ScopedMutex             lock( &m_mutex );
+            Group::Map::iterator    i = m_groups.find( group_id );
+
+            if( i != m_groups.end() )
+                throw Error( _("Pool::AddGroup( %u, %zu ): group already exists"),
+                                                                group_id, size );
+
+            m_groups[group_id] = new Group( this, group_id, size ? size : m_opt.pool_size,
+                                                                                monitor );
+
+        } //}}}
+
+        void AddSource( Group::ID group_id, const EntropySource::Handle &source )
+        { //{{{
+
+            source->LogMsg<2>( "Pool::AddSource: adding to group %u", group_id );
+
+            ScopedMutex             lock( &m_mutex );
+            Group::Map::iterator    gi = m_groups.find( group_id );
+            Group::Handle           g;
+
+            if( gi == m_groups.end() )
+            {
+                g = new Group( this, group_id, m_opt.pool_size );
+                m_groups[group_id] = g;
+
+            } else {
+
+                g = gi->second;
+            }
+
+            m_sources.push_back( new Source( this, g, source ) );
+
+        } //}}}
+
+        void AddSource( Group::ID group_id, const BitBabbler::Handle &babbler )
+        {
+            AddSource( group_id, new BitBabblerSource( babbler ) );
+        }
+
+        void RemoveSource( const USBContext::Device::Handle &d )
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+
+            for( Source::List::iterator i = m_sources.begin(),
+                                        e = m_sources.end(); i != e; ++ i )
+            {
+                if( (*i)->source->IsDevice( d ) )
+                {
+                    pthread_t   p = (*i)->thread;
+                    m_sources.erase( i );
+
+                    lock.Unlock();
+                    pthread_cancel( p );
+
+                   #if defined(__FreeBSD__) && __FreeBSD__ < 13
+                    //{{{
+                    // On FreeBSD 11 (where hotplug support was first added)
+                    // if the device was removed while we were in an active
+                    // call to libusb_bulk_transfer(), then that call may
+                    // deadlock (typically somewhere in libusb_handle_events)
+                    // and we will never be able to join the cancelled thread.
+                    //
+                    // So to avoid it also deadlocking us, we limit the amount
+                    // of time we'll wait for the join to succeed, and if that
+                    // elapses, we'll bark about it, then just leak the thread
+                    // and its associated resources, and move on.
+                    //
+                    // It's not ideal, but it's about the best we can do until
+                    // the FreeBSD side of things is fixed.
+                    //
+                    // Since it looks like FreeBSD 13 doesn't have this problem
+                    // anymore, it can use the same code as everyone else again.
+
+                    Log<4>( "Pool::RemoveSource: cancelling thread for %s\n",
+                                                    d->VerboseStr().c_str() );
+
+                    timespec           wait_until;
+                    GetFutureTimespec( wait_until, 2000 );
+
+                    int ret = pthread_timedjoin_np( p, NULL, &wait_until );
+
+                    if( ret )
+                        LogErr<0>( ret,
+                                   "Pool::RemoveSource: failed to join thread for removed device %s",
+                                   d->VerboseStr().c_str() );
+                    else
+                        Log<4>( "Pool::RemoveSource: joined thread for %s\n",
+                                                    d->VerboseStr().c_str() );
+                    //}}}
+                   #else
+
+                    pthread_join( p, NULL );
+
+                   #endif
+
+                    return;
+                }
+            }
+
+        } //}}}
+
+        void RemoveAllSources()
+        { //{{{
+
+            Source::List    s;
+            {
+                ScopedMutex     lock( &m_mutex );
+
+                for( Source::List::iterator i = m_sources.begin(),
+                                            e = m_sources.end(); i != e; ++ i )
+                    pthread_cancel( (*i)->thread );
+
+                s.swap( m_sources );
+            }
+
+            // Block until they are actually released, so that the caller has some
+            // guarantee that it's safe to use removed sources for something else,
+            // without racing against the removal still being completed here.
+            for( Source::List::iterator i = s.begin(), e = s.end(); i != e; ++ i )
+                pthread_join( (*i)->thread, NULL );
+
+        } //}}}
+
+
+        // Change the size of the pool while it is running.  As much of the
+        // entropy that it currently holds as will fit is retained.  Groups
+        // which were already created with the old pool size keep the size
+        // they have until they are recreated.
+        void Resize( size_t size )
+        { //{{{
+
+            if( size == 0 )
+                throw Error( _("Pool::Resize: invalid pool size 0") );
+
+            ScopedMutex     lock( &m_mutex );
+
+            if( size == m_opt.pool_size )
+                return;
+
+            Log<1>( "Pool: resizing from %zu to %zu bytes (%zu filled)\n",
+                                            m_opt.pool_size, size, m_fill );
+
+            BufferPool::Buffer  buf( size );
+
+            m_fill = std::min( m_fill, size );
+            memcpy( buf, m_buf, m_fill );
+            memset( m_buf, 0, m_opt.pool_size );
+
+            m_buf.swap( buf );
+            m_opt.pool_size = size;
+
+            if( m_next >= size )
+                m_next = 0;
+
+            // Wake everything that might be waiting on the old size.
+            cond_broadcast( &m_sourcecond );
+            cond_broadcast( &m_sinkcond );
+
+        } //}}}
+
+        size_t GetSize()
+        {
+            ScopedMutex     lock( &m_mutex );
+            return m_opt.pool_size;
+        }
+
+        // Return a QA monitor ID for output from this pool.  The name of a
+        // pool can't be changed, so this doesn't need to take the lock.
+        std::string MonitorID( const char *id ) const
+        {
+            return m_opt.MonitorID( id );
+        }
+
+        // This will take effect the next time the kernel is refilled.
+        void SetKernelRefillTime( unsigned seconds )
+        {
+            ScopedMutex     lock( &m_mutex );
+            m_opt.kernel_refill_time = seconds;
+        }
+
+        unsigned GetKernelRefillTime()
+        {
+            ScopedMutex     lock( &m_mutex );
+            return m_opt.kernel_refill_time;
+        }
+
+        // This will take effect the next time the kernel is refilled.
+        void SetKernelCreditMargin( unsigned percent )
+        {
+            ScopedMutex     lock( &m_mutex );
+            m_opt.kernel_credit_margin = std::min( percent, 100u );
+        }
+
+        unsigned GetKernelCreditMargin()
+        {
+            ScopedMutex     lock( &m_mutex );
+            return m_opt.kernel_credit_margin;
+        }
+
+        const BusScheduler::Handle &GetBusScheduler() const
+        {
+            return m_opt.bus_scheduler;
+        }
 
-            pthread_cond_destroy( &m_sinkcond );
-            pthread_cond_destroy( &m_sourcecond );
-            pthread_mutex_destroy( &m_mutex );
 
-            delete [] m_buf;
+        // Return a JSON object with what each group, and each source in them,
+        // has contributed to this pool.
+        std::string GetContributions()
+        { //{{{
 
-            Log<2>( "- Pool( %s )\n", m_opt.Str().c_str() );
+            Group::Map      groups;
+            Source::List    sources;
 
-        } //}}}
+            {
+                ScopedMutex     lock( &m_mutex );
 
+                groups  = m_groups;
+                sources = m_sources;
+            }
 
-        // Group size will be rounded up to a power of 2
-        void AddGroup( Group::ID group_id, size_t size )
-        { //{{{
+            uint64_t        now = now_ms();
+            std::string     g;
+            std::string     src;
 
-            Log<2>( "Pool::AddGroup( %u, %zu )\n", group_id, size );
+            for( Group::Map::iterator i = groups.begin(), e = groups.end(); i != e; ++i )
+            {
+                if( ! g.empty() )
+                    g += ',';
 
-            ScopedMutex             lock( &m_mutex );
-            Group::Map::iterator    i = m_groups.find( group_id );
+                g += stringprintf( "\"%u\":{", i->first )
+                   + i->second->GetTotal().JSONFields( now ) + '}';
+            }
 
-            if( i != m_groups.end() )
-                throw Error( _("Pool::AddGroup( %u, %zu ): group already exists"),
-                                                                group_id, size );
+            for( Source::List::iterator i = sources.begin(), e = sources.end(); i != e; ++i )
+            {
+                const Source::Handle           &h = *i;
+                EntropySource::RecoveryCounts   r = h->source->GetRecoveryCounts();
+
+                if( ! src.empty() )
+                    src += ',';
+
+                src += '"' + h->source->GetID() + "\":"
+                     + stringprintf( "{\"Group\":%u,\"Standby\":%s,", h->group->GetID(),
+                                                             h->standby ? "true" : "false" )
+                     + h->group->GetContribution( h->stats ).JSONFields( now )
+                     + stringprintf( ",\"Recovered\":{\"Resync\":%u,\"Reinit\":%u,"
+                                     "\"Reset\":%u,\"Failed\":%u}}",
+                                     r.resync, r.reinit, r.reset, r.failed );
+            }
 
-            m_groups[group_id] = new Group( this, group_id, size );
+            return "{\"Groups\":{" + g + "},\"Sources\":{" + src + "}}";
 
         } //}}}
 
-        void AddSource( Group::ID group_id, const BitBabbler::Handle &babbler )
+        // Return a JSON object with the contributions to every pool, or to
+        // only the named one, keyed by pool name (which is empty for the
+        // default pool).
+        static std::string GetAllContributions( const std::string &name = std::string(),
+                                                bool only_named = false )
         { //{{{
 
-            babbler->LogMsg<2>( "Pool::AddSource: adding to group %u", group_id );
-
-            ScopedMutex             lock( &m_mutex );
-            Group::Map::iterator    gi = m_groups.find( group_id );
-            Group::Handle           g;
+            ScopedMutex     lock( &ms_pools_mutex );
+            std::string     report( 1, '{' );
+            bool            first = true;
 
-            if( gi == m_groups.end() )
+            for( List::iterator i = ms_pools.begin(), e = ms_pools.end(); i != e; ++i )
             {
-                g = new Group( this, group_id, m_opt.pool_size );
-                m_groups[group_id] = g;
+                if( only_named && (*i)->m_opt.name != name )
+                    continue;
 
-            } else {
+                if( first )
+                    first = false;
+                else
+                    report += ',';
 
-                g = gi->second;
+                report += '"' + (*i)->m_opt.name + "\":"
+                        + (*i)->GetContributions();
             }
 
-            m_sources.push_back( new Source( this, g, babbler ) );
+            return report + '}';
 
         } //}}}
 
-        void RemoveSource( const USBContext::Device::Handle &d )
+        // Return a JSON object with the independence of the members of each
+        // group in this pool that is monitoring them, and the ID of the source
+        // for each member number that it reports.
+        std::string GetCorrelation()
         { //{{{
 
-            ScopedMutex     lock( &m_mutex );
+            Group::Map      groups;
+            Source::List    sources;
 
-            for( Source::List::iterator i = m_sources.begin(),
-                                        e = m_sources.end(); i != e; ++ i )
             {
-                if( (*i)->babbler->IsDevice( d ) )
+                ScopedMutex     lock( &m_mutex );
+
+                groups  = m_groups;
+                sources = m_sources;
+            }
+
+            std::string     report;
+
+            for( Group::Map::iterator i = groups.begin(), e = groups.end(); i != e; ++i )
+            {
+                if( ! i->second->HasMonitor() )
+                    continue;
+
+                std::string     members;
+
+                for( Source::List::iterator si = sources.begin(),
+                                            se = sources.end(); si != se; ++si )
                 {
-                    pthread_t   p = (*i)->thread;
-                    m_sources.erase( i );
+                    const Source::Handle   &h = *si;
 
-                    lock.Unlock();
-                    pthread_cancel( p );
+                    if( h->group != i->second || h->groupmask == 0 )
+                        continue;
 
-                   #if defined(__FreeBSD__) && __FreeBSD__ < 13
-                    //{{{
-                    // On FreeBSD 11 (where hotplug support was first added)
-                    // if the device was removed while we were in an active
-                    // call to libusb_bulk_transfer(), then that call may
-                    // deadlock (typically somewhere in libusb_handle_events)
-                    // and we will never be able to join the cancelled thread.
-                    //
-                    // So to avoid it also deadlocking us, we limit the amount
-                    // of time we'll wait for the join to succeed, and if that
-                    // elapses, we'll bark about it, then just leak the thread
-                    // and its associated resources, and move on.
-                    //
-                    // It's not ideal, but it's about the best we can do until
-                    // the FreeBSD side of things is fixed.
-                    //
-                    // Since it looks like FreeBSD 13 doesn't have this problem
-                    // anymore, it can use the same code as everyone else again.
+                    if( ! members.empty() )
+                        members += ',';
 
-                    Log<4>( "Pool::RemoveSource: cancelling thread for %s\n",
-                                                    d->VerboseStr().c_str() );
+                    members += stringprintf( "\"%u\":\"", __builtin_ctz(h->groupmask) )
+                             + h->source->GetID() + '"';
+                }
 
-                    timespec           wait_until;
-                    GetFutureTimespec( wait_until, 2000 );
+                if( ! report.empty() )
+                    report += ',';
 
-                    int ret = pthread_timedjoin_np( p, NULL, &wait_until );
+                report += stringprintf( "\"%u\":{\"Sources\":{", i->first ) + members
+                        + "},\"Monitor\":" + i->second->GetCorrelation() + '}';
+            }
 
-                    if( ret )
-                        LogErr<0>( ret,
-                                   "Pool::RemoveSource: failed to join thread for removed device %s",
-                                   d->VerboseStr().c_str() );
-                    else
-                        Log<4>( "Pool::RemoveSource: joined thread for %s\n",
-                                                    d->VerboseStr().c_str() );
-                    //}}}
-                   #else
+            return '{' + report + '}';
 
-                    pthread_join( p, NULL );
+        } //}}}
 
-                   #endif
+        // Return a JSON object with the correlation of the groups in every pool,
+        // or in only the named one, keyed by pool name as for GetAllContributions.
+        static std::string GetAllCorrelation( const std::string &name = std::string(),
+                                              bool only_named = false )
+        { //{{{
 
-                    return;
-                }
+            ScopedMutex     lock( &ms_pools_mutex );
+            std::string     report( 1, '{' );
+            bool            first = true;
+
+            for( List::iterator i = ms_pools.begin(), e = ms_pools.end(); i != e; ++i )
+            {
+                if( only_named && (*i)->m_opt.name != name )
+                    continue;
+
+                if( first )
+                    first = false;
+                else
+                    report += ',';
+
+                report += '"' + (*i)->m_opt.name + "\":" + (*i)->GetCorrelation();
             }
 
+            return report + '}';
+
         } //}}}
 
-        void RemoveAllSources()
+        // Append the status of each source of this pool to l.
+        void GetSourceStatus( SourceStatus::List &l )
         { //{{{
 
-            Source::List    s;
+            Source::List    sources;
+
             {
                 ScopedMutex     lock( &m_mutex );
+                sources = m_sources;
+            }
 
-                for( Source::List::iterator i = m_sources.begin(),
-                                            e = m_sources.end(); i != e; ++ i )
-                    pthread_cancel( (*i)->thread );
+            uint64_t    now = now_ms();
 
-                s.swap( m_sources );
+            for( Source::List::iterator i = sources.begin(), e = sources.end(); i != e; ++i )
+            {
+                const Source::Handle   &h = *i;
+
+                l.push_back( SourceStatus() );
+
+                SourceStatus   &st = l.back();
+
+                st.pool    = m_opt.name;
+                st.id      = h->source->GetID();
+                st.group   = h->group->GetID();
+                st.bitrate = h->source->GetBitrate();
+                st.standby = h->standby;
+                st.stats   = h->group->GetContribution( h->stats, h->ok, st.ok );
+                st.age_ms  = now > st.stats.started_ms ? now - st.stats.started_ms : 0;
+                st.recovered = h->source->GetRecoveryCounts();
             }
 
-            // Block until they are actually released, so that the caller has some
-            // guarantee that it's safe to use removed sources for something else,
-            // without racing against the removal still being completed here.
-            for( Source::List::iterator i = s.begin(), e = s.end(); i != e; ++ i )
-                pthread_join( (*i)->thread, NULL );
+        } //}}}
+
+        // Return the status of every source, of every pool.
+        static SourceStatus::List GetAllSourceStatus()
+        { //{{{
+
+            ScopedMutex         lock( &ms_pools_mutex );
+            SourceStatus::List  l;
+
+            for( List::iterator i = ms_pools.begin(), e = ms_pools.end(); i != e; ++i )
+                (*i)->GetSourceStatus( l );
+
+            return l;
 
         } //}}}
 
@@ -1430,20 +3433,25 @@ namespace BitB
         { //{{{
 
             Log<5>( "Pool::read( %zu )\n", len );
+            BB_TRACE2( pool__read__start, m_opt.name.c_str(), len );
 
-            ScopedMutex     lock( &m_mutex );
+            StageProfile::Timer t( StageProfile::POOL_WAIT );
+            ScopedMutex         lock( &m_mutex );
+
+            m_forecast.Read( PoolIsFull_(), now_ms() );
 
             while( m_fill < m_opt.pool_size && m_fill < len )
-                pthread_cond_wait( &m_sinkcond, &m_mutex );
+                cond_wait( &m_sinkcond, &m_mutex );
 
             size_t  n = std::min( m_fill, len );
 
             memcpy( buf, m_buf + (m_fill - n), n );
             m_fill -= n;
 
-            pthread_cond_broadcast( &m_sourcecond );
+            cond_broadcast( &m_sourcecond );
 
             Log<5>( "Pool::read( %zu ) returning %zu (%zu remain)\n", len, n, m_fill );
+            BB_TRACE3( pool__read__done, m_opt.name.c_str(), n, m_fill );
             return n;
 
         } //}}}
@@ -1452,13 +3460,15 @@ namespace BitB
         void WriteToFD( int fd, size_t len = 0 )
         { //{{{
 
-            uint8_t     buf[65536];
+            BufferPool::Buffer  buf( 65536 );
 
             for(;;)
             {
-                size_t      b = len ? std::min( len, sizeof(buf) ) : sizeof(buf);
+                size_t      b = len ? std::min( len, buf.Size() ) : buf.Size();
                 size_t      n = read( buf, b );
 
+                StageProfile::Timer t( StageProfile::OUTPUT );
+
                 for( size_t c = n; c; )
                 {
                     ssize_t w = write( fd, buf + n - c, c );
@@ -1499,6 +3509,77 @@ namespace BitB
         } //}}}
 
 
+        // Return the entropy, in bits per byte, which we can credit to the
+        // kernel for output that passed both of the given QA stages.  This is
+        // the lowest of the current short term min-entropy measured for each
+        // of them, less the configured safety margin.  Until both of them
+        // have measured enough to estimate that, we credit only a conservative
+        // UNMEASURED_CREDIT bits per byte.
+        //
+        // Note that this is a measure of the statistics of the output of the
+        // pool, not of the min-entropy of the sources that were mixed into it.
+        // Folding, mixing, and most of all hashing, can make output look ideal
+        // regardless of what went into it, so this can only ever lower the
+        // credit from what the configuration of the sources is trusted for,
+        // it can't confirm that they really provide it.
+        double KernelCreditPerByte( const HealthMonitor &qa, const HealthMonitor &qa2 )
+        { //{{{
+
+            static const double UNMEASURED_CREDIT = 1.0;
+
+            HealthMonitor::MinEntropy   m  = qa.GetMinEntropy();
+            HealthMonitor::MinEntropy   m2 = qa2.GetMinEntropy();
+
+            if( ! m.results || ! m2.results )
+                return UNMEASURED_CREDIT;
+
+            double  h = std::min( 8.0, std::min( m.ent8_short, m2.ent8_short ) );
+
+            if( h < 0.0 )
+                h = 0.0;
+
+            return h * (100 - GetKernelCreditMargin()) / 100.0;
+
+        } //}}}
+
+       #if EM_PLATFORM_LINUX
+
+        // Return the number of bytes, of the len that we have available, which
+        // it would take to fill the kernel's pool if each is credited with
+        // credit bits of entropy.  We'll always give it at least MIN_FEED to
+        // mix in when we are woken, even if it already looks to be full, since
+        // we may have been woken by the refill timeout just to refresh it.
+        static size_t KernelWantBytes( int fd, double credit, size_t len )
+        { //{{{
+
+            static const size_t MIN_FEED = 64;
+
+            int         avail;
+            int         poolsize = 4096;
+            FILE       *f        = fopen( "/proc/sys/kernel/random/poolsize", "r" );
+
+            if( f )
+            {
+                if( fscanf( f, "%d", &poolsize ) != 1 )
+                    poolsize = 4096;
+
+                fclose( f );
+            }
+
+            if( ioctl( fd, RNDGETENTCNT, &avail ) )
+                avail = 0;
+
+            if( credit <= 0.0 || avail >= poolsize )
+                return std::min( len, MIN_FEED );
+
+            size_t  n = size_t( double(poolsize - avail) / credit ) + 1;
+
+            return std::min( len, std::max( n, MIN_FEED ) );
+
+        } //}}}
+
+       #endif
+
         BB_NORETURN
         void FeedKernelEntropy( const std::string &dev = std::string() )
         { //{{{
@@ -1529,13 +3610,13 @@ namespace BitB
             // passes, we give it to the kernel.
             //
             // If all is working well, the QA testing feeding our pool should
-            // ensure that it has very near to 8 bits of entropy per byte, so
-            // for each iteration here we take ~20k bits of entropy, fold it
-            // to 5k bits for the kernel to process, of which with its default
-            // pool size it will credit us for at most 4096 bits of entropy.
-            // That should mean the estimate of 8 bits of entropy per byte that
-            // we tell it we are providing should be reasonable even if we are
-            // a hair below that in the worst case.
+            // ensure that it has very near to 8 bits of entropy per byte, but
+            // rather than just assume that, we credit the kernel with what the
+            // QA at both stages has actually measured (less a safety margin),
+            // see KernelCreditPerByte().  On Linux, we also only give it as
+            // many of the folded bytes as it needs to fill its pool with that
+            // credit, and keep the rest of them for the next time it wakes us,
+            // so that we don't burn through more of our own pool than we must.
 
             int fd = open( dev.empty() ? m_opt.kernel_device.c_str() : dev.c_str(), O_RDWR );
 
@@ -1545,8 +3626,6 @@ namespace BitB
 
             const unsigned  N       = QA::FIPS::BUFFER_SIZE; // 20kbits for FIPS test.
             const unsigned  folds   = 2;
-            const int       timeout = int(m_opt.kernel_refill_time)
-                                    ? int(m_opt.kernel_refill_time * 1000) : -1;
 
             union {
                 uint8_t                 b[N + sizeof(struct rand_pool_info)];
@@ -1557,20 +3636,35 @@ namespace BitB
             uint8_t         b2[N];
             size_t          b2_fill = 0;
 
-            HealthMonitor   qa( "Pool" );
-            HealthMonitor   qa2( "Kernel" );
+            // Folded output which passed QA, but which the kernel didn't need
+            // the last time we fed it.  This never holds more than the size
+            // of a folded block plus what we wanted but didn't have, so N is
+            // always enough.
+            uint8_t         spare[N];
+            size_t          spare_fill = 0;
+
+            HealthMonitor   qa( m_opt.MonitorID( "Pool" ) );
+            HealthMonitor   qa2( m_opt.MonitorID( "Kernel" ) );
+            StageProfile    profile( m_opt.MonitorID( "Kernel" ) );
 
-            bool            source_ok;
             bool            folded_ok = false;
 
             for(;;)
             {
                 size_t      n;
+                double      credit  = KernelCreditPerByte( qa, qa2 );
 
-                do {
+               #if EM_PLATFORM_LINUX
+                size_t      want    = KernelWantBytes( fd, credit, N >> folds );
+               #else
+                size_t      want    = N >> folds;
+               #endif
+
+                while( spare_fill < want )
+                {
                     n = read( buf, N );
 
-                    if( ! (source_ok = qa.Check( buf, n )) )
+                    if( ! qa.Check( buf, n ) )
                     {
                         b2_fill = 0;
                         continue;
@@ -1587,17 +3681,40 @@ namespace BitB
                         folded_ok = qa2.Check( b2, N );
                     }
 
-                } while( ! source_ok || ! folded_ok );
+                    if( folded_ok )
+                    {
+                        memcpy( spare + spare_fill, buf, n );
+                        spare_fill += n;
+                    }
+                }
+
+                n = want;
 
+                memcpy( buf, spare, n );
+                memmove( spare, spare + n, spare_fill - n );
+                spare_fill -= n;
 
-                rpi.entropy_count = int(n * 8);
+                rpi.entropy_count = int( double(n) * credit );
                 rpi.buf_size      = int(n);
 
+                Log<5>( "Pool::FeedKernelEntropy: %zu bytes, credit %d bits (%.3f bits/byte)\n",
+                                                        n, rpi.entropy_count, credit );
+
+                // This may be changed by a reconfiguration while we run.
+                unsigned    refill  = GetKernelRefillTime();
+                int         timeout = refill ? int(refill * 1000) : -1;
+
 
                #if EM_PLATFORM_LINUX
 
-                if( ioctl( fd, RNDADDENTROPY, &rpi ) )
-                    throw SystemError( _("Pool::FeedKernelEntropy: ioctl failed") );
+                {
+                    StageProfile::Timer t( StageProfile::OUTPUT );
+
+                    if( ioctl( fd, RNDADDENTROPY, &rpi ) )
+                        throw SystemError( _("Pool::FeedKernelEntropy: ioctl failed") );
+                }
+
+                BB_TRACE3( kernel__inject, m_opt.name.c_str(), n, rpi.entropy_count );
 
                 EM_TRY_PUSH_DIAGNOSTIC_IGNORE("-Wgnu-designator")
 
@@ -1614,11 +3731,17 @@ namespace BitB
                 // MacOS has no method of signalling to us when its kernel might
                 // actually want more entropy, so we'll just feed it a new block
                 // each time the kernel_refill_time expires.
-                ssize_t r = write( fd, buf, n );
+                ssize_t r;
+                {
+                    StageProfile::Timer t( StageProfile::OUTPUT );
+                    r = write( fd, buf, n );
+                }
 
                 if( r < 0 )
                     throw SystemError( _("Pool::FeedKernelEntropy: write to kernel device failed") );
 
+                BB_TRACE3( kernel__inject, m_opt.name.c_str(), n, rpi.entropy_count );
+
                 usleep( timeout * 1000 );
 
                #else
@@ -1662,9 +3785,72 @@ namespace BitB
 
         pthread_mutex_t             m_pool_mutex;
         Pool::Handle                m_pool;
+        Pool::Map                   m_named_pools;
         BitBabbler::Options         m_default_options;
         BitBabbler::Options::List   m_device_options;
 
+        // The options in use before a call to ReconfigureDevices().
+        BitBabbler::Options         m_old_default_options;
+        BitBabbler::Options::List   m_old_device_options;
+        unsigned                    m_reconfigured;
+
+
+        // Return the options from the given set that device d should be
+        // configured with, or NULL if it isn't selected to be used.
+        static const BitBabbler::Options *
+        options_for( const Device::Handle               &d,
+                     const BitBabbler::Options          &default_options,
+                     const BitBabbler::Options::List    &device_options )
+        { //{{{
+
+            if( device_options.empty() )
+                return &default_options;
+
+            for( BitBabbler::Options::List::const_iterator i = device_options.begin(),
+                                                           e = device_options.end();
+                                                           i != e; ++i )
+                if( i->id.Matches( d ) )
+                    return &*i;
+
+            return NULL;
+
+        } //}}}
+
+        // You must hold m_pool_mutex to call this.
+        void add_source_( const Device::Handle &d, const BitBabbler::Options &opt )
+        { //{{{
+
+            if( opt.pool.empty() )
+            {
+                m_pool->AddSource( opt.group, new BitBabbler( d, opt, false ) );
+                return;
+            }
+
+            Pool::Map::iterator     i = m_named_pools.find( opt.pool );
+
+            if( i == m_named_pools.end() )
+            {
+                Log<0>( _("DevList: no pool named '%s' for device %s\n"),
+                                    opt.pool.c_str(), d->VerboseStr().c_str() );
+                return;
+            }
+
+            i->second->AddSource( opt.group, new BitBabbler( d, opt, false ) );
+
+        } //}}}
+
+        // You must hold m_pool_mutex to call this.
+        void remove_source_( const Device::Handle &d )
+        { //{{{
+
+            m_pool->RemoveSource( d );
+
+            for( Pool::Map::iterator i = m_named_pools.begin(),
+                                     e = m_named_pools.end(); i != e; ++i )
+                i->second->RemoveSource( d );
+
+        } //}}}
+
 
     protected:
 
@@ -1687,23 +3873,10 @@ namespace BitB
                 return;
             }
 
-            if( m_device_options.empty() )
-            {
-                m_pool->AddSource( m_default_options.group,
-                                   new BitBabbler( d, m_default_options, false ) );
-                return;
-            }
-
-            for( BitBabbler::Options::List::iterator i = m_device_options.begin(),
-                                                     e = m_device_options.end();
-                                                     i != e; ++i )
-            {
-                if( i->id.Matches( d ) )
-                {
-                    m_pool->AddSource( i->group, new BitBabbler( d, *i, false ) );
-                    return;
-                }
-            }
+            const BitBabbler::Options  *opt = options_for( d, m_default_options,
+                                                              m_device_options );
+            if( opt )
+                add_source_( d, *opt );
 
         } //}}}
 
@@ -1713,7 +3886,36 @@ namespace BitB
             ScopedMutex     lock( &m_pool_mutex );
 
             if( m_pool != NULL )
-                m_pool->RemoveSource( d );
+                remove_source_( d );
+
+        } //}}}
+
+        virtual void DeviceChanged( const Device::Handle &d )
+        { //{{{
+
+            ScopedMutex     lock( &m_pool_mutex );
+
+            if( ! m_pool || d->GetSerial().empty() )
+                return;
+
+            const BitBabbler::Options  *opt = options_for( d, m_default_options,
+                                                              m_device_options );
+            const BitBabbler::Options  *old = options_for( d, m_old_default_options,
+                                                              m_old_device_options );
+            if( ! old && ! opt )
+                return;
+
+            if( old && opt && old->SameSettings( *opt ) )
+                return;
+
+            Log<1>( _("DevList: reconfiguring %s\n"), d->VerboseStr().c_str() );
+            ++m_reconfigured;
+
+            if( old )
+                remove_source_( d );
+
+            if( opt )
+                add_source_( d, *opt );
 
         } //}}}
 
@@ -1723,6 +3925,7 @@ namespace BitB
         DevList( unsigned vendorid, unsigned productid )
             : m_vendorid( vendorid )
             , m_productid( productid )
+            , m_reconfigured( 0 )
         {
             pthread_mutex_init( &m_pool_mutex, NULL );
         }
@@ -1733,6 +3936,21 @@ namespace BitB
         }
 
 
+        // Make a pool available for devices to be added to by name.  This
+        // should be called before AddDevicesToPool() for any named pools
+        // that the device options will refer to.
+        void AddNamedPool( const std::string &name, const Pool::Handle &pool )
+        { //{{{
+
+            ScopedMutex     lock( &m_pool_mutex );
+
+            if( m_named_pools.find( name ) != m_named_pools.end() )
+                throw Error( _("DevList::AddNamedPool: pool '%s' already exists"),
+                                                                    name.c_str() );
+            m_named_pools[name] = pool;
+
+        } //}}}
+
         void AddDevicesToPool( const Pool::Handle               &pool,
                                const BitBabbler::Options        &default_options,
                                const BitBabbler::Options::List  &device_options )
@@ -1742,8 +3960,14 @@ namespace BitB
                 ScopedMutex     lock( &m_pool_mutex );
 
                 if( m_pool != NULL )
+                {
                     m_pool->RemoveAllSources();
 
+                    for( Pool::Map::iterator i = m_named_pools.begin(),
+                                             e = m_named_pools.end(); i != e; ++i )
+                        i->second->RemoveAllSources();
+                }
+
                 m_pool            = pool;
                 m_default_options = default_options;
                 m_device_options  = device_options;
@@ -1753,6 +3977,36 @@ namespace BitB
 
         } //}}}
 
+        // Change the options used for devices which are (or will be) added
+        // to the pool.  Only devices whose configuration actually changes
+        // will be removed and added back to it with their new options, the
+        // sources for all the others will be left running undisturbed.
+        // Returns the number of devices which were reconfigured.
+        unsigned ReconfigureDevices( const BitBabbler::Options        &default_options,
+                                     const BitBabbler::Options::List  &device_options )
+        { //{{{
+
+            {
+                ScopedMutex     lock( &m_pool_mutex );
+
+                m_old_default_options = m_default_options;
+                m_old_device_options  = m_device_options;
+                m_default_options     = default_options;
+                m_device_options      = device_options;
+                m_reconfigured        = 0;
+
+                if( ! m_pool )
+                    return 0;
+            }
+
+            RefreshAllDevices();
+
+            ScopedMutex     lock( &m_pool_mutex );
+
+            return m_reconfigured;
+
+        } //}}}
+
 
         unsigned GetVendorID() const        { return m_vendorid; }
         unsigned GetProductID() const       { return m_productid; }
@@ -0,0 +1,534 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_SIMULATION_H
+#define _BB_SIMULATION_H
+
+#include <bit-babbler/secret-source.h>
+#include <bit-babbler/drbg.h>
+
+#include <vector>
+#include <algorithm>
+
+
+namespace BitB
+{
+    // A model of a BitBabbler device, for simulating the Pool with a VirtualClock.
+    //{{{
+    // Reading from it takes the time that the real device would take to output
+    // the same number of bits at its configured bitrate, and resuming it after
+    // it was released takes the given resume time.  The bits it outputs are a
+    // ChaCha20 keystream, so they will pass the QA checks in the same way that
+    // a good device would.  We keep track of the time spent in each state, so
+    // the power-state residency can be reported for a simulation.  If there is
+    // no clock, it runs in real time instead, as an emulated device for seedd.
+    //}}}
+    class SimSource : public EntropySource
+    { //{{{
+    public:
+
+        typedef RefPtr< SimSource >     Handle;
+
+        enum State
+        {
+            SUSPENDED,
+            RESUMING,
+            IDLE,
+            ACTIVE,
+            STATES
+        };
+
+
+    private:
+
+        VirtualClock::Handle    m_clock;
+        std::string             m_id;
+        unsigned                m_bitrate;
+        unsigned                m_fold;
+        unsigned                m_sleep_init;
+        unsigned                m_sleep_max;
+        unsigned                m_suspend_after;
+        bool                    m_standby;
+        uint64_t                m_resume_time;
+
+        ChaCha20                m_bits;
+
+        pthread_mutex_t         m_mutex;
+        State                   m_state;
+        uint64_t                m_since;
+        uint64_t                m_time[STATES];
+        unsigned                m_resumes;
+        uint64_t                m_bytes;
+
+
+        uint64_t now()
+        {
+            return m_clock != NULL ? m_clock->Now() : GetMonotonicUS();
+        }
+
+        void sleep( uint64_t us )
+        {
+            if( m_clock != NULL )
+                m_clock->Sleep( us );
+            else
+                usleep( useconds_t(us) );
+        }
+
+        void set_state( State s )
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+            uint64_t        now = this->now();
+
+            m_time[m_state] += now - m_since;
+            m_since          = now;
+            m_state          = s;
+
+        } //}}}
+
+
+    public:
+
+        // The resume_time is in microseconds.
+        SimSource( const VirtualClock::Handle &clock, unsigned n,
+                   const BitBabbler::Options &options, uint64_t resume_time )
+            : m_clock( clock )
+            , m_id( stringprintf( "Sim%u", n ) )
+            , m_bitrate( options.bitrate ? BitBabbler::RealBitrate( options.bitrate ) : 2500000 )
+            , m_fold( options.fold != unsigned(-1) ? options.fold : 1 )
+            , m_sleep_init( options.sleep_init )
+            , m_sleep_max( options.sleep_max )
+            , m_suspend_after( options.suspend_after )
+            , m_standby( options.standby )
+            , m_resume_time( resume_time )
+            , m_state( SUSPENDED )
+            , m_since( 0 )
+            , m_resumes( 0 )
+            , m_bytes( 0 )
+        { //{{{
+
+            uint8_t     key[ChaCha20::KEY_BYTES]     = { uint8_t(n) };
+            uint8_t     nonce[ChaCha20::NONCE_BYTES] = {};
+
+            m_bits.SetKey( key, nonce );
+
+            memset( m_time, 0, sizeof(m_time) );
+            pthread_mutex_init( &m_mutex, NULL );
+
+            m_since = now();
+
+            LogMsg<2>( "+ SimSource( bitrate %u, fold %u, resume %lluus )",
+                       m_bitrate, m_fold, (unsigned long long)m_resume_time );
+
+        } //}}}
+
+        ~SimSource()
+        {
+            LogMsg<2>( "- SimSource" );
+            pthread_mutex_destroy( &m_mutex );
+        }
+
+
+        virtual const std::string &GetID() const
+        {
+            return m_id;
+        }
+
+        virtual bool Claim()
+        { //{{{
+
+            if( m_state == SUSPENDED )
+            {
+                set_state( RESUMING );
+                sleep( m_resume_time );
+                ++m_resumes;
+            }
+
+            set_state( IDLE );
+            return true;
+
+        } //}}}
+
+        virtual void Release()
+        {
+            set_state( SUSPENDED );
+        }
+
+        virtual bool IsClaimed() const
+        {
+            return m_state != SUSPENDED;
+        }
+
+        // The same as what a real device would choose with a maximum packet
+        // size of 512 bytes.
+        virtual size_t GetChunkSize() const
+        {
+            return std::max( 512u, std::min( 65536u, powof2_down( m_bitrate / 32 ) ) );
+        }
+
+        virtual unsigned GetFolding() const         { return m_fold; }
+        virtual unsigned GetBitrate() const         { return m_bitrate; }
+        virtual unsigned GetIdleSleepInit() const   { return m_sleep_init; }
+        virtual unsigned GetIdleSleepMax() const    { return m_sleep_max; }
+        virtual unsigned GetSuspendAfter() const    { return m_suspend_after; }
+        virtual bool IsStandby() const              { return m_standby; }
+
+
+        virtual size_t read( uint8_t *buf, size_t len )
+        { //{{{
+
+            set_state( ACTIVE );
+            sleep( uint64_t(len) * 8000000 / m_bitrate );
+            m_bits.Keystream( buf, len );
+            set_state( IDLE );
+
+            m_bytes += len;
+            return len;
+
+        } //}}}
+
+
+        // Return the time spent in each State up until the time end.
+        void GetResidency( uint64_t end, uint64_t times[STATES] )
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+
+            memcpy( times, m_time, sizeof(m_time) );
+
+            if( end > m_since )
+                times[m_state] += end - m_since;
+
+        } //}}}
+
+        unsigned GetResumes() const
+        {
+            return m_resumes;
+        }
+
+        uint64_t GetBytes() const
+        {
+            return m_bytes;
+        }
+
+    }; //}}}
+
+
+    // Run a Pool against a VirtualClock to evaluate its idle policies.
+    //{{{
+    // The demand trace is read from a file, where each line is either blank,
+    // a comment starting with '#', or one of:
+    //
+    //  resume <ms>                     The time a device takes to resume.
+    //  end <time>                      Keep running until at least this time.
+    //  <time> <bytes> [<period> [<until>]]
+    //
+    // The last reads that many bytes from the pool at that time (in seconds),
+    // and then again every period seconds until the until time (or the end
+    // time, if that is not given).  Requests are made sequentially, so if the
+    // pool can't keep up with them, the latency of later ones will include
+    // the time that they were queued behind earlier ones.
+    //}}}
+    class Simulation
+    { //{{{
+    private:
+
+        struct Demand
+        { //{{{
+
+            uint64_t    at;         // in microseconds
+            size_t      bytes;
+
+            Demand( uint64_t t, size_t n )
+                : at( t )
+                , bytes( n )
+            {}
+
+            bool operator<( const Demand &d ) const
+            {
+                return at < d.at;
+            }
+
+        }; //}}}
+
+        typedef std::vector< Demand >       DemandList;
+
+        struct Repeat
+        { //{{{
+
+            uint64_t    at;
+            size_t      bytes;
+            uint64_t    period;
+            uint64_t    until;      // 0 means the end time
+
+        }; //}}}
+
+        typedef std::vector< Repeat >       RepeatList;
+
+
+        DemandList      m_demand;
+        uint64_t        m_end;
+        uint64_t        m_resume_time;
+
+
+        static uint64_t seconds( const std::string &s )
+        {
+            return uint64_t( StrToScaledD( s ) * 1e6 );
+        }
+
+        static std::vector< std::string > split( const std::string &line )
+        { //{{{
+
+            std::vector< std::string >  v;
+            size_t                      b = 0;
+
+            for(;;)
+            {
+                b = line.find_first_not_of( " \t\r", b );
+
+                if( b == std::string::npos || line[b] == '#' )
+                    return v;
+
+                size_t  e = line.find_first_of( " \t\r", b );
+
+                v.push_back( line.substr( b, e - b ) );
+
+                if( e == std::string::npos )
+                    return v;
+
+                b = e;
+            }
+
+        } //}}}
+
+        void parse( const std::string &data )
+        { //{{{
+
+            RepeatList  repeats;
+            unsigned    lineno = 0;
+
+            for( size_t b = 0; b < data.size(); )
+            {
+                size_t      e    = data.find( '\n', b );
+                std::string line = data.substr( b, e - b );
+
+                b = e == std::string::npos ? e : e + 1;
+                ++lineno;
+
+                std::vector< std::string >  t = split( line );
+
+                if( t.empty() )
+                    continue;
+
+                try {
+                    if( t[0] == "resume" && t.size() == 2 )
+                    {
+                        m_resume_time = uint64_t( StrToScaledD( t[1] ) * 1e3 );
+                        continue;
+                    }
+
+                    if( t[0] == "end" && t.size() == 2 )
+                    {
+                        m_end = std::max( m_end, seconds( t[1] ) );
+                        continue;
+                    }
+
+                    if( t.size() < 2 || t.size() > 4 )
+                        throw Error( _("expected: <time> <bytes> [<period> [<until>]]") );
+
+                    Repeat  r;
+
+                    r.at     = seconds( t[0] );
+                    r.bytes  = StrToScaledUL( t[1], 1024 );
+                    r.period = t.size() > 2 ? seconds( t[2] ) : 0;
+                    r.until  = t.size() > 3 ? seconds( t[3] ) : 0;
+
+                    if( r.bytes == 0 )
+                        throw Error( _("bytes must be greater than 0") );
+
+                    if( t.size() > 2 && r.period == 0 )
+                        throw Error( _("period must be greater than 0") );
+
+                    repeats.push_back( r );
+                    m_end = std::max( m_end, std::max( r.at, r.until ) );
+                }
+                catch( const std::exception &e )
+                {
+                    throw Error( _("Simulation: invalid trace at line %u '%s': %s"),
+                                                    lineno, line.c_str(), e.what() );
+                }
+            }
+
+            for( RepeatList::iterator i = repeats.begin(), e = repeats.end(); i != e; ++i )
+            {
+                uint64_t    until = i->until ? i->until : m_end;
+
+                m_demand.push_back( Demand( i->at, i->bytes ) );
+
+                if( i->period )
+                    for( uint64_t t = i->at + i->period; t <= until; t += i->period )
+                        m_demand.push_back( Demand( t, i->bytes ) );
+            }
+
+            std::stable_sort( m_demand.begin(), m_demand.end() );
+
+            if( m_demand.empty() )
+                throw Error( _("Simulation: the trace has no demand in it") );
+
+        } //}}}
+
+
+        static double percent( uint64_t n, uint64_t total )
+        {
+            return total ? 100.0 * double(n) / double(total) : 0.0;
+        }
+
+        static double ms( uint64_t us )
+        {
+            return double(us) / 1000.0;
+        }
+
+
+    public:
+
+        Simulation( const char *trace_path )
+            : m_end( 0 )
+            , m_resume_time( 100000 )
+        { //{{{
+
+            char            buf[65536];
+            std::string     data;
+            size_t          n;
+            FILE           *f = fopen( trace_path, "r" );
+
+            if( ! f )
+                throw SystemError( _("Simulation: failed to open trace file '%s'"), trace_path );
+
+            while(( n = fread( buf, 1, sizeof(buf), f ) ))
+                data.append( buf, n );
+
+            fclose( f );
+
+            parse( data );
+
+        } //}}}
+
+
+        // Run the simulation with a modelled device for each of the given
+        // device options (or for the default options if there are none),
+        // and return a report of the results.
+        std::string Run( Pool::Options                       pool_options,
+                         const Pool::Group::Options::List   &group_options,
+                         const BitBabbler::Options          &default_options,
+                         const BitBabbler::Options::List    &device_options )
+        { //{{{
+
+            VirtualClock::Handle    clock = new VirtualClock;
+
+            pool_options.clock = clock;
+
+            Pool::Handle                pool = new Pool( pool_options );
+            std::vector< SimSource::Handle >    devices;
+            BitBabbler::Options::List   dev_opts = device_options;
+
+            if( dev_opts.empty() )
+                dev_opts.push_back( default_options );
+
+            for( Pool::Group::Options::List::const_iterator i = group_options.begin(),
+                                                            e = group_options.end(); i != e; ++i )
+                pool->AddGroup( i->groupid, i->size );
+
+            for( BitBabbler::Options::List::iterator i = dev_opts.begin(),
+                                                     e = dev_opts.end(); i != e; ++i )
+            {
+                SimSource::Handle   d = new SimSource( clock, unsigned(devices.size()),
+                                                       *i, m_resume_time );
+                devices.push_back( d );
+                pool->AddSource( i->group, EntropySource::Handle( d ) );
+            }
+
+
+            uint64_t                wall_start = GetMonotonicUS();
+            std::vector< uint64_t > latency;
+            uint8_t                 buf[65536];
+            uint64_t                bytes = 0;
+
+            latency.reserve( m_demand.size() );
+
+            for( DemandList::iterator i = m_demand.begin(), e = m_demand.end(); i != e; ++i )
+            {
+                uint64_t    now = clock->Now();
+
+                if( i->at > now )
+                    clock->Sleep( i->at - now );
+
+                for( size_t n = i->bytes; n; )
+                    n -= pool->read( buf, std::min( n, sizeof(buf) ) );
+
+                latency.push_back( clock->Now() - i->at );
+                bytes += i->bytes;
+            }
+
+            uint64_t    now = clock->Now();
+
+            if( m_end > now )
+                clock->Sleep( m_end - now );
+
+            clock->Stop();
+
+            uint64_t    end       = clock->Now();
+            uint64_t    wall_time = GetMonotonicUS() - wall_start;
+
+            pool->RemoveAllSources();
+
+
+            std::sort( latency.begin(), latency.end() );
+
+            uint64_t    total_latency = 0;
+
+            for( size_t i = 0; i < latency.size(); ++i )
+                total_latency += latency[i];
+
+            std::string report = stringprintf(
+                "Simulated %.3fs in %.3fs\n"
+                "Demand: %zu requests, %llu bytes, %.1f bytes/s\n"
+                "Latency: mean %.3fms, median %.3fms, 99%% %.3fms, max %.3fms\n",
+                double(end) / 1e6, double(wall_time) / 1e6,
+                latency.size(), (unsigned long long)bytes,
+                end ? double(bytes) * 1e6 / double(end) : 0.0,
+                ms( total_latency / latency.size() ),
+                ms( latency[latency.size() / 2] ),
+                ms( latency[latency.size() * 99 / 100] ),
+                ms( latency.back() ) );
+
+            for( size_t i = 0; i < devices.size(); ++i )
+            {
+                uint64_t    t[SimSource::STATES];
+
+                devices[i]->GetResidency( end, t );
+
+                report.append( stringprintf(
+                    "%s: bitrate %u, fold %u, %u resumes, %llu bytes read, %.1f bytes/s\n"
+                    "  suspended %.2f%%, resuming %.2f%%, idle %.2f%%, active %.2f%%\n",
+                    devices[i]->GetID().c_str(), devices[i]->GetBitrate(),
+                    devices[i]->GetFolding(), devices[i]->GetResumes(),
+                    (unsigned long long)devices[i]->GetBytes(),
+                    end ? double(devices[i]->GetBytes()) * 1e6 / double(end) : 0.0,
+                    percent( t[SimSource::SUSPENDED], end ),
+                    percent( t[SimSource::RESUMING], end ),
+                    percent( t[SimSource::IDLE], end ),
+                    percent( t[SimSource::ACTIVE], end ) ) );
+            }
+
+            return report;
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_SIMULATION_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
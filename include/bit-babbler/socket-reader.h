@@ -0,0 +1,442 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_SOCKET_READER_H
+#define _BB_SOCKET_READER_H
+
+#include <bit-babbler/refptr.h>
+#include <bit-babbler/socket.h>
+
+#if EM_PLATFORM_POSIX
+ #include <sys/time.h>
+ #include <errno.h>
+#endif
+
+
+namespace BitB
+{
+    // Client for reading entropy from a network socket.
+    //{{{
+    // This can fetch data from either the UDP request/response protocol that
+    // is implemented by SocketSource, or it can simply read whatever is sent
+    // to it over a stream socket connection.  The address to read from is in
+    // the form 'udp:host:port' or 'tcp:host:port'.
+    //
+    // For UDP, we keep up to Options::batch requests in flight at once, and
+    // where the platform supports it, collect the replies using recvmmsg(2)
+    // so that a whole batch can be received with a single system call.  A
+    // lost request or reply is simply dropped after Options::timeout ms, and
+    // will be replaced by a new request in the next batch.  For stream sockets
+    // the connection is (re)established on demand, so a remote which is not
+    // yet (or no longer) available will not cause the reader to fail.
+    //}}}
+    class SocketReader : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< SocketReader >  Handle;
+
+
+        // The largest request that SocketSource will respond to.
+        static const size_t     MAX_REQUEST_SIZE = 32768;
+
+        // The maximum number of UDP requests we will have in flight at once.
+        static const unsigned   MAX_BATCH = 64;
+
+
+        struct Options
+        { //{{{
+
+            std::string     addr;           // The 'udp:host:port' to read from
+            size_t          request_size;   // Bytes to ask for per UDP request
+            unsigned        batch;          // Max number of UDP requests in flight
+            unsigned        timeout;        // Time in ms to wait for a reply
+
+            Options()
+                : request_size( MAX_REQUEST_SIZE )
+                , batch( 8 )
+                , timeout( 1000 )
+            {}
+
+            Options( const std::string &address )
+                : addr( address )
+                , request_size( MAX_REQUEST_SIZE )
+                , batch( 8 )
+                , timeout( 1000 )
+            {}
+
+        }; //}}}
+
+
+        // Return true if addr is in a form that we should try to connect to.
+        static bool IsSocketAddr( const std::string &addr )
+        {
+            return addr.compare( 0, 4, "udp:" ) == 0 || addr.compare( 0, 4, "tcp:" ) == 0;
+        }
+
+        // Return the length of the 'proto:host:port' prefix of str, or 0 if str
+        // does not begin with a socket address.  This lets the address be split
+        // from any other colon separated fields which may follow it.
+        static size_t SocketAddrLen( const std::string &str )
+        { //{{{
+
+            if( ! IsSocketAddr( str ) )
+                return 0;
+
+            size_t  n = 4;
+
+            if( str.size() > n && str[n] == '[' )
+            {
+                n = str.find( ']', n );
+
+                if( n == std::string::npos )
+                    return str.size();
+            }
+
+            n = str.find( ':', n );
+
+            if( n == std::string::npos )
+                return str.size();
+
+            n = str.find( ':', n + 1 );
+
+            if( n == std::string::npos )
+                return str.size();
+
+            return n;
+
+        } //}}}
+
+
+    private:
+
+       #if EM_PLATFORM_MSW
+        WinsockScope    m_winsock;
+       #endif
+
+        Options         m_options;
+        SockAddr        m_sa;
+        bool            m_udp;
+        int             m_fd;
+
+        unsigned long   m_requests;
+        unsigned long   m_replies;
+        unsigned long   m_timeouts;
+        unsigned long   m_reconnects;
+
+
+        void Close()
+        { //{{{
+
+            if( m_fd == -1 )
+                return;
+
+           #if EM_PLATFORM_MSW
+            closesocket( m_fd );
+           #else
+            close( m_fd );
+           #endif
+
+            m_fd = -1;
+
+        } //}}}
+
+        // Returns true if the connection is established, or false if it should
+        // be retried again later.  Throws if this is a hard failure that will
+        // not be resolved by trying again.
+        bool Connect()
+        { //{{{
+
+            m_fd = socket( m_sa.addr.any.sa_family, m_sa.addr_type, m_sa.addr_protocol );
+
+            if( m_fd == -1 )
+                throw SocketError( _("SocketReader( %s ): failed to create socket"),
+                                                            m_options.addr.c_str() );
+
+           #if EM_PLATFORM_MSW
+            DWORD   tv = m_options.timeout;
+           #else
+            timeval tv = { time_t(m_options.timeout / 1000),
+                           suseconds_t(m_options.timeout % 1000 * 1000) };
+           #endif
+
+            if( setsockopt( m_fd, SOL_SOCKET, SO_RCVTIMEO,
+                            reinterpret_cast<const char*>(&tv), sizeof(tv) ) == -1 )
+            {
+                Close();
+                throw SocketError( _("SocketReader( %s ): failed to set SO_RCVTIMEO"),
+                                                                m_options.addr.c_str() );
+            }
+
+            if( connect( m_fd, &m_sa.addr.any, m_sa.addr_len ) == -1 )
+            {
+                LogSocketErr<2>( _("SocketReader( %s ): failed to connect"),
+                                                    m_options.addr.c_str() );
+                Close();
+                return false;
+            }
+
+            Log<3>( "SocketReader( %s ): connected\n", m_options.addr.c_str() );
+            return true;
+
+        } //}}}
+
+        // Wait until we are connected, retrying every Options::timeout ms.
+        void WaitForConnection()
+        { //{{{
+
+            while( m_fd == -1 && ! Connect() )
+                usleep( useconds_t(m_options.timeout * 1000) );
+
+        } //}}}
+
+
+        void send_requests( size_t len, unsigned count )
+        { //{{{
+
+            for( unsigned i = 0; i < count; ++i )
+            {
+                size_t      r = std::min( m_options.request_size, len );
+                uint16_t    req = htons( uint16_t(r) );
+
+               #if EM_PLATFORM_MSW
+                ssize_t n = send( m_fd, reinterpret_cast<const char*>(&req), sizeof(req), 0 );
+               #else
+                ssize_t n = send( m_fd, &req, sizeof(req), 0 );
+               #endif
+
+                if( n != ssize_t(sizeof(req)) )
+                    LogSocketErr<2>( _("SocketReader( %s ): failed to send request"),
+                                                            m_options.addr.c_str() );
+                len -= r;
+                ++m_requests;
+            }
+
+        } //}}}
+
+        // Receive up to count replies into buf, packing them contiguously.
+        // Returns the number of replies received, with the number of bytes
+        // that were read from them returned in bytes.  Returns 0 if no reply
+        // arrived before the timeout expired.
+        unsigned recv_replies( uint8_t *buf, size_t len, unsigned count, size_t &bytes )
+        { //{{{
+
+            size_t  rs = m_options.request_size;
+
+            bytes = 0;
+
+           #if EM_PLATFORM_LINUX
+
+            mmsghdr     msgs[MAX_BATCH];
+            iovec       iov[MAX_BATCH];
+            unsigned    n = 0;
+
+            for( size_t off = 0; n < count && off < len; ++n, off += rs )
+            {
+                iov[n].iov_base = buf + off;
+                iov[n].iov_len  = std::min( rs, len - off );
+
+                memset( &msgs[n].msg_hdr, 0, sizeof(msgs[n].msg_hdr) );
+                msgs[n].msg_hdr.msg_iov    = &iov[n];
+                msgs[n].msg_hdr.msg_iovlen = 1;
+            }
+
+            int r = recvmmsg( m_fd, msgs, n, MSG_WAITFORONE, NULL );
+
+            if( r < 0 )
+            {
+                if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                    LogErr<2>( _("SocketReader( %s ): recvmmsg failed"),
+                                                m_options.addr.c_str() );
+                return 0;
+            }
+
+            // Pack any short replies down, so the data is contiguous.
+            for( int i = 0; i < r; ++i )
+            {
+                uint8_t *p = static_cast<uint8_t*>( iov[i].iov_base );
+
+                if( p != buf + bytes )
+                    memmove( buf + bytes, p, msgs[i].msg_len );
+
+                bytes += msgs[i].msg_len;
+            }
+
+            return unsigned(r);
+
+           #else
+
+            (void)count;
+
+           #if EM_PLATFORM_MSW
+            ssize_t r = recv( m_fd, reinterpret_cast<char*>(buf), std::min( rs, len ), 0 );
+           #else
+            ssize_t r = recv( m_fd, buf, std::min( rs, len ), 0 );
+           #endif
+
+            if( r < 0 )
+                return 0;
+
+            bytes = size_t(r);
+            return 1;
+
+           #endif
+
+        } //}}}
+
+        size_t read_udp( uint8_t *buf, size_t len )
+        { //{{{
+
+            size_t  n = 0;
+
+            while( n < len )
+            {
+                size_t      rs      = m_options.request_size;
+                unsigned    pending = unsigned( std::min( size_t(m_options.batch),
+                                                          (len - n + rs - 1) / rs ) );
+
+                send_requests( len - n, pending );
+
+                while( pending )
+                {
+                    size_t      bytes;
+                    unsigned    r = recv_replies( buf + n, len - n, pending, bytes );
+
+                    if( r == 0 )
+                    {
+                        ++m_timeouts;
+                        Log<3>( "SocketReader( %s ): timeout with %u requests pending"
+                                " (%lu requests, %lu replies, %lu timeouts)\n",
+                                m_options.addr.c_str(), pending,
+                                m_requests, m_replies, m_timeouts );
+                        break;
+                    }
+
+                    m_replies += r;
+                    pending   -= std::min( r, pending );
+                    n         += bytes;
+                }
+            }
+
+            return n;
+
+        } //}}}
+
+        size_t read_stream( uint8_t *buf, size_t len )
+        { //{{{
+
+            size_t  n = 0;
+
+            while( n < len )
+            {
+                WaitForConnection();
+
+               #if EM_PLATFORM_MSW
+                ssize_t r = recv( m_fd, reinterpret_cast<char*>(buf + n), len - n, 0 );
+               #else
+                ssize_t r = recv( m_fd, buf + n, len - n, 0 );
+               #endif
+
+                if( r > 0 )
+                {
+                    n += size_t(r);
+                    continue;
+                }
+
+                if( r == 0 )
+                    Log<1>( _("SocketReader( %s ): connection closed by peer\n"),
+                                                        m_options.addr.c_str() );
+               #if EM_PLATFORM_POSIX
+                else if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
+                {
+                    ++m_timeouts;
+                    continue;
+                }
+               #endif
+                else
+                    LogSocketErr<1>( _("SocketReader( %s ): read failed"),
+                                                    m_options.addr.c_str() );
+                Close();
+                ++m_reconnects;
+            }
+
+            return n;
+
+        } //}}}
+
+
+    public:
+
+        SocketReader( const Options &options )
+            : m_options( options )
+            , m_sa( options.addr.substr( std::min( size_t(4), options.addr.size() ) ) )
+            , m_udp( options.addr.compare( 0, 4, "udp:" ) == 0 )
+            , m_fd( -1 )
+            , m_requests( 0 )
+            , m_replies( 0 )
+            , m_timeouts( 0 )
+            , m_reconnects( 0 )
+        { //{{{
+
+            Log<2>( "+ SocketReader( '%s' )\n", m_options.addr.c_str() );
+
+            if( ! IsSocketAddr( m_options.addr ) )
+                throw Error( _("SocketReader( %s ): expected udp: or tcp: address"),
+                                                            m_options.addr.c_str() );
+
+            if( m_options.request_size < 1 || m_options.request_size > MAX_REQUEST_SIZE )
+                throw Error( _("SocketReader( %s ): request size %zu is not between 1 and %zu"),
+                             m_options.addr.c_str(), m_options.request_size, MAX_REQUEST_SIZE );
+
+            if( m_options.batch < 1 )
+                m_options.batch = 1;
+            else if( m_options.batch > MAX_BATCH )
+                m_options.batch = MAX_BATCH;
+
+            if( m_options.timeout < 1 )
+                m_options.timeout = 1;
+
+            m_sa.GetAddrInfo( m_udp ? SOCK_DGRAM : SOCK_STREAM, AI_ADDRCONFIG );
+
+            if( m_sa.addr.any.sa_family != AF_INET && m_sa.addr.any.sa_family != AF_INET6 )
+                throw Error( _("SocketReader( %s ): not an IPv4 or IPv6 address (family %u)"),
+                                        m_options.addr.c_str(), m_sa.addr.any.sa_family );
+
+            // A UDP socket doesn't need the remote to be up for connect to
+            // succeed, so any failure here is not something to retry later.
+            if( m_udp && ! Connect() )
+                throw SocketError( _("SocketReader( %s ): connect failed"),
+                                                    m_options.addr.c_str() );
+        } //}}}
+
+        ~SocketReader()
+        { //{{{
+
+            Log<2>( "- SocketReader( '%s' )\n", m_options.addr.c_str() );
+            Close();
+
+        } //}}}
+
+
+        const std::string &GetAddr() const { return m_options.addr; }
+
+        unsigned long GetRequests() const   { return m_requests; }
+        unsigned long GetReplies() const    { return m_replies; }
+        unsigned long GetTimeouts() const   { return m_timeouts; }
+        unsigned long GetReconnects() const { return m_reconnects; }
+
+
+        // Block until len bytes have been read into buf.
+        size_t read( uint8_t *buf, size_t len )
+        {
+            return m_udp ? read_udp( buf, len ) : read_stream( buf, len );
+        }
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_SOCKET_READER_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
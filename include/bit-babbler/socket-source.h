@@ -4,12 +4,22 @@
 #ifndef _BB_SOCKET_SOURCE_H
 #define _BB_SOCKET_SOURCE_H
 
-#include <bit-babbler/secret-source.h>
+#include <bit-babbler/drbg.h>
 #include <bit-babbler/socket.h>
 
 
 namespace BitB
 {
+    // A UDP server which answers requests for up to MAX_BYTES of entropy.
+    //{{{
+    // Each request is a datagram containing just the number of bytes wanted,
+    // as a 16-bit value in network byte order, and the reply is a datagram
+    // with that many bytes of QA checked output from the Pool.  If created
+    // with DRBG options, the reply will instead be the output of a DRBG which
+    // is seeded from the Pool, for consumers that need more than the hardware
+    // can provide.  Those are only ever served from a separate socket, so that
+    // nobody can mistake them for the output of the hardware itself.
+    //}}}
     class SocketSource : public RefCounted
     { //{{{
     private:
@@ -19,6 +29,7 @@ namespace BitB
        #endif
 
         Pool::Handle            m_pool;
+        DRBG::Handle            m_drbg;
         SockAddr                m_sa;
         int                     m_fd;
         pthread_t               m_serverthread;
@@ -28,20 +39,25 @@ namespace BitB
         void do_server_thread()
         { //{{{
 
-            SetThreadName( "UDP out" );
+            SetThreadName( m_drbg != NULL ? "DRBG UDP out" : "UDP out" );
 
             std::string     addr = m_sa.AddrStr();
 
+            if( m_drbg != NULL )
+                addr.append( " DRBG" );
+
             Log<3>( "SocketSource( %s ): begin server_thread\n", addr.c_str() );
 
-            const size_t    MAX_BYTES = 32768;
+            const size_t        MAX_BYTES = 32768;
             union {
                 uint16_t    len;
                 char        buf[8];
             };
-            uint8_t         rbuf[MAX_BYTES];
-            sockaddr_any_t  peeraddr;
-            HealthMonitor   qa( "UDP" );
+            BufferPool::Buffer  rbuf( MAX_BYTES );
+            sockaddr_any_t      peeraddr;
+            HealthMonitor       qa( m_pool->MonitorID( m_drbg != NULL ? "DRBG UDP" : "UDP" ) );
+            StageProfile        profile( qa.GetID() );
+            bool                drbg_ok = true;
 
             for(;;)
             {
@@ -63,19 +79,51 @@ namespace BitB
                         continue;
                     }
 
-                    do {
+                    if( m_drbg != NULL )
+                    {
+                        // The seed was already QA checked, this is only a
+                        // sanity check that we're not sending out garbage.
+                        // If it fails, reseed, and don't answer any request
+                        // until its output is passing the checks again.
+                        m_drbg->Generate( rbuf, bytes );
+                        r = bytes;
+
+                        if( ! qa.Check( rbuf, r ) )
+                        {
+                            if( drbg_ok )
+                            {
+                                Log<0>( "SocketSource( %s ): DRBG output failed QA, reseeding\n",
+                                                                                addr.c_str() );
+                                m_drbg->Reseed();
+                                drbg_ok = false;
+                            }
+                            continue;
+                        }
+
+                        if( ! drbg_ok )
+                        {
+                            Log<0>( "SocketSource( %s ): DRBG output passing QA again\n",
+                                                                            addr.c_str() );
+                            drbg_ok = true;
+                        }
+                    }
+                    else do {
                         r = m_pool->read( rbuf, bytes );
                     }
                     while( ! qa.Check( rbuf, r ) );
 
                     Log<5>( "SocketSource( %s ): returning %zu bytes\n", addr.c_str(), r );
 
-                   #if EM_PLATFORM_MSW
-                    n = sendto( m_fd, reinterpret_cast<const char*>(rbuf), r, 0,
-                                                    &peeraddr.any, peeraddrlen );
-                   #else
-                    n = sendto( m_fd, rbuf, r, 0, &peeraddr.any, peeraddrlen );
-                   #endif
+                    {
+                        StageProfile::Timer t( StageProfile::OUTPUT );
+
+                       #if EM_PLATFORM_MSW
+                        n = sendto( m_fd, reinterpret_cast<const char*>(rbuf.Raw()), r, 0,
+                                                        &peeraddr.any, peeraddrlen );
+                       #else
+                        n = sendto( m_fd, rbuf, r, 0, &peeraddr.any, peeraddrlen );
+                       #endif
+                    }
 
                     if( n == -1 )
                         LogSocketErr<1>( _("SocketSource( %s ): sendto failed"), addr.c_str() );
@@ -125,14 +173,7 @@ namespace BitB
         } //}}}
 
 
-    public:
-
-        typedef RefPtr< SocketSource >  Handle;
-
-
-        SocketSource( const Pool::Handle &pool, const std::string &addr, bool freebind = false )
-            : m_pool( pool )
-            , m_sa( addr )
+        void Open( const std::string &addr, bool freebind )
         { //{{{
 
             Log<2>( "+ SocketSource( '%s' )\n", addr.c_str() );
@@ -170,6 +211,33 @@ namespace BitB
 
         } //}}}
 
+
+    public:
+
+        typedef RefPtr< SocketSource >  Handle;
+
+
+        SocketSource( const Pool::Handle &pool, const std::string &addr, bool freebind = false )
+            : m_pool( pool )
+            , m_sa( addr )
+        { //{{{
+
+            Open( addr, freebind );
+
+        } //}}}
+
+        // Serve DRBG output, seeded from pool, instead of raw pool output.
+        SocketSource( const Pool::Handle &pool, const std::string &addr,
+                      const DRBG::Options &drbg, bool freebind = false )
+            : m_pool( pool )
+            , m_drbg( new DRBG( pool, "UDP " + addr, drbg ) )
+            , m_sa( addr )
+        { //{{{
+
+            Open( addr, freebind );
+
+        } //}}}
+
         ~SocketSource()
         { //{{{
 
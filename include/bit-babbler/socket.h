@@ -130,6 +130,24 @@ namespace BitB
 
         } //}}}
 
+        // Return true if the address found by GetAddrInfo can only
+        // be reached by other processes on this host.
+        bool IsLoopback() const
+        { //{{{
+
+            switch( addr.any.sa_family )
+            {
+                case AF_INET:
+                    return ntohl( addr.in.sin_addr.s_addr ) >> 24 == 127;
+
+                case AF_INET6:
+                    return IN6_IS_ADDR_LOOPBACK( &addr.in6.sin6_addr );
+            }
+
+            return false;
+
+        } //}}}
+
     }; //}}}
 
 
@@ -0,0 +1,337 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_STAGE_PROFILE_H
+#define _BB_STAGE_PROFILE_H
+
+#include <bit-babbler/log.h>
+
+#include <list>
+
+
+namespace BitB
+{
+    // Accumulate the time that a thread spends in each stage of the entropy path.
+    //{{{
+    // Each thread which reads from a source, or writes pool output somewhere,
+    // creates one of these on its stack, and it will then collect the timing
+    // for every StageTimer which is run by that thread, in whatever code the
+    // timer is in.  The times are recorded without locking, and are published
+    // at most once a second for GetProfile() to report, so the cost of this
+    // is just two clock reads per timed stage, and it can always be enabled.
+    //
+    // Stages can be nested, and the time spent in an inner stage is counted
+    // only for that stage, not for the stage that it was nested inside too.
+    //}}}
+    class StageProfile
+    { //{{{
+    public:
+
+        enum Stage
+        {
+            BUS_WAIT,       // Waiting for the BusScheduler to allow a read
+            USB,            // In libusb bulk transfers
+            DEFRAME,        // Stripping the FTDI packet headers
+            FOLD,           // Folding or conditioning the raw bits
+            QA_FIPS,        // FIPS 140-2 tests
+            QA_ENT8,        // Ent8 tests (including the Monte Carlo estimate of pi)
+            QA_ENT16,       // Ent16 tests
+            QA_BIAS,        // BitBias tests
+            GROUP_ADD,      // Combining output with the rest of its group
+            POOL_ADD,       // Mixing output into the pool
+            POOL_WAIT,      // Waiting for the pool to have enough to read
+            OUTPUT,         // Writing pool output to its consumer
+
+            STAGE_COUNT
+        };
+
+
+    private:
+
+        typedef std::list< StageProfile* >  List;
+
+        static List                 ms_list;
+        static pthread_mutex_t      ms_mutex;
+        static pthread_key_t        ms_key;
+        static pthread_once_t       ms_once;
+
+
+        struct Counter
+        { //{{{
+
+            unsigned long long  count;
+            unsigned long long  total_ns;
+            unsigned long long  max_ns;
+
+
+            Counter()
+                : count( 0 )
+                , total_ns( 0 )
+                , max_ns( 0 )
+            {}
+
+            void Add( unsigned long long ns )
+            {
+                ++count;
+                total_ns += ns;
+
+                if( ns > max_ns )
+                    max_ns = ns;
+            }
+
+        }; //}}}
+
+
+        std::string         m_id;
+        StageProfile       *m_prev;
+
+        // These are only accessed by the thread which owns this profile.
+        Counter             m_local[STAGE_COUNT];
+        void               *m_timer;
+        uint64_t            m_next_publish;
+
+        // This is the copy of them which other threads can read.
+        mutable pthread_mutex_t     m_mutex;
+        Counter                     m_published[STAGE_COUNT];
+
+
+        // You cannot copy this class
+        StageProfile( const StageProfile& );
+        StageProfile &operator=( const StageProfile& );
+
+
+        static void create_key()
+        {
+            int ret = pthread_key_create( &ms_key, NULL );
+
+            if( ret )
+                LogErr<0>( ret, "StageProfile: failed to create thread key" );
+        }
+
+        static const char *stage_name( unsigned stage )
+        { //{{{
+
+            static const char *names[STAGE_COUNT] =
+            {
+                "BusWait",
+                "USB",
+                "Deframe",
+                "Fold",
+                "FIPS",
+                "Ent8",
+                "Ent16",
+                "BitBias",
+                "GroupAdd",
+                "PoolAdd",
+                "PoolWait",
+                "Output"
+            };
+
+            return names[stage];
+
+        } //}}}
+
+
+        void publish()
+        {
+            ScopedMutex     lock( &m_mutex );
+            memcpy( m_published, m_local, sizeof(m_published) );
+        }
+
+        void add( Stage stage, uint64_t ns, uint64_t now )
+        {
+            m_local[stage].Add( ns );
+
+            if( now >= m_next_publish )
+            {
+                publish();
+                m_next_publish = now + 1000000000;
+            }
+        }
+
+        std::string AsJSON() const
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+            std::string     s( 1, '{' );
+            bool            first = true;
+
+            for( unsigned i = 0; i < STAGE_COUNT; ++i )
+            {
+                const Counter  &c = m_published[i];
+
+                if( c.count == 0 )
+                    continue;
+
+                if( first )
+                    first = false;
+                else
+                    s += ',';
+
+                s += stringprintf( "\"%s\":{\"Count\":%llu,\"TotalNS\":%llu,\"MaxNS\":%llu}",
+                                   stage_name(i), c.count, c.total_ns, c.max_ns );
+            }
+
+            return s + '}';
+
+        } //}}}
+
+
+    public:
+
+        // Unlike GetMonotonicUS(), this never throws, since it is used in
+        // destructors.  If the clock can't be read, the time is just 0.
+        static uint64_t now_ns()
+        { //{{{
+
+          #if HAVE_CLOCK_GETTIME
+
+            timespec    t;
+
+            if( clock_gettime( CLOCK_MONOTONIC, &t ) == -1 )
+                return 0;
+
+            return uint64_t(t.tv_sec) * 1000000000 + uint64_t(t.tv_nsec);
+
+          #else
+
+            timeval     t;
+
+            if( gettimeofday( &t, NULL ) == -1 )
+                return 0;
+
+            return uint64_t(t.tv_sec) * 1000000000 + uint64_t(t.tv_usec) * 1000;
+
+          #endif
+
+        } //}}}
+
+
+        // Create a profile for the calling thread.  It must be destroyed by
+        // that same thread, and any profile which it was already collecting
+        // for will resume collecting when it is.
+        StageProfile( const std::string &id )
+            : m_id( id )
+            , m_timer( NULL )
+            , m_next_publish( 0 )
+        { //{{{
+
+            pthread_once( &ms_once, create_key );
+
+            m_prev = static_cast<StageProfile*>( pthread_getspecific( ms_key ) );
+
+            pthread_mutex_init( &m_mutex, NULL );
+            pthread_setspecific( ms_key, this );
+
+            pthread_mutex_lock( &ms_mutex );
+            ms_list.push_back( this );
+            pthread_mutex_unlock( &ms_mutex );
+
+        } //}}}
+
+        ~StageProfile()
+        { //{{{
+
+            pthread_mutex_lock( &ms_mutex );
+            ms_list.remove( this );
+            pthread_mutex_unlock( &ms_mutex );
+
+            pthread_setspecific( ms_key, m_prev );
+            pthread_mutex_destroy( &m_mutex );
+
+        } //}}}
+
+
+        const std::string &GetID() const { return m_id; }
+
+
+        // Return the profile that the calling thread is collecting for,
+        // or NULL if it doesn't have one.
+        static StageProfile *Current()
+        {
+            pthread_once( &ms_once, create_key );
+            return static_cast<StageProfile*>( pthread_getspecific( ms_key ) );
+        }
+
+        static std::string GetProfile( const std::string &id = std::string() )
+        { //{{{
+
+            ScopedMutex     lock( &ms_mutex );
+            std::string     report( 1, '{' );
+            bool            first = true;
+
+            for( List::iterator i = ms_list.begin(), e = ms_list.end(); i != e; ++i )
+            {
+                if( id.empty() || id == (*i)->m_id )
+                {
+                    if( first )
+                        first = false;
+                    else
+                        report += ',';
+
+                    report += '"' + (*i)->m_id + "\":" + (*i)->AsJSON();
+                }
+            }
+
+            return report + '}';
+
+        } //}}}
+
+
+        // Time a stage of processing, from construction until destruction.
+        class Timer
+        { //{{{
+        private:
+
+            StageProfile   *m_profile;
+            Timer          *m_parent;
+            Stage           m_stage;
+            uint64_t        m_start;
+            uint64_t        m_nested;
+
+
+            // You cannot copy this class
+            Timer( const Timer& );
+            Timer &operator=( const Timer& );
+
+
+        public:
+
+            Timer( Stage stage )
+                : m_profile( Current() )
+                , m_stage( stage )
+                , m_nested( 0 )
+            {
+                if( ! m_profile )
+                    return;
+
+                m_parent = static_cast<Timer*>( m_profile->m_timer );
+                m_profile->m_timer = this;
+                m_start = now_ns();
+            }
+
+            ~Timer()
+            {
+                if( ! m_profile )
+                    return;
+
+                uint64_t    now     = now_ns();
+                uint64_t    elapsed = now > m_start ? now - m_start : 0;
+
+                m_profile->add( m_stage, elapsed > m_nested ? elapsed - m_nested : 0, now );
+                m_profile->m_timer = m_parent;
+
+                if( m_parent )
+                    m_parent->m_nested += elapsed;
+            }
+
+        }; //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_STAGE_PROFILE_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -0,0 +1,202 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_STATS_PUBLISHER_H
+#define _BB_STATS_PUBLISHER_H
+
+#include <bit-babbler/stats-region.h>
+#include <bit-babbler/health-monitor.h>
+#include <bit-babbler/secret-source.h>
+
+
+namespace BitB
+{
+    // Periodically copy the QA and source statistics into a StatsRegion.
+    //{{{
+    // Everything that is published is gathered first, with the same locking
+    // that the control socket requests use, and then copied into the region
+    // in one short update, so readers are only ever held off for as long as
+    // it takes to do the copy.  Monitors and sources beyond the number that
+    // the region has room for are not published.
+    //}}}
+    class StatsPublisher : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< StatsPublisher >    Handle;
+
+        static const unsigned   DEFAULT_INTERVAL = 250;     // ms
+
+
+    private:
+
+        StatsRegion     m_region;
+        unsigned        m_interval;
+        pthread_t       m_thread;
+
+
+        static void copy_id( char *dest, const std::string &id )
+        {
+            size_t  n = std::min( id.size(), size_t(StatsRegion::ID_SIZE - 1) );
+
+            memcpy( dest, id.data(), n );
+            memset( dest + n, 0, StatsRegion::ID_SIZE - n );
+        }
+
+        template< typename R >
+        static void copy_result( StatsRegion::EntResult &dest, const R &r )
+        {
+            dest.entropy    = r.entropy;
+            dest.chisq      = r.chisq;
+            dest.mean       = r.mean;
+            dest.pi         = r.pi;
+            dest.corr       = r.corr;
+            dest.minentropy = r.minentropy;
+        }
+
+
+        void publish()
+        { //{{{
+
+            Monitor::Snapshot::List     qa  = Monitor::GetSnapshots();
+            Pool::SourceStatus::List    src = Pool::GetAllSourceStatus();
+            timeval                     now = GetWallTimeval();
+
+            // Don't leave the region locked if we're cancelled part way through.
+            int oldstate;
+            pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, &oldstate );
+
+            StatsRegion::Layout    &d   = m_region.BeginUpdate();
+            unsigned                nqa = 0;
+            unsigned                nsrc = 0;
+
+            for( Monitor::Snapshot::List::iterator i = qa.begin(), e = qa.end();
+                                        i != e && nqa < StatsRegion::MAX_MONITORS; ++i )
+            {
+                StatsRegion::QAEntry   &q = d.qa[nqa++];
+
+                copy_id( q.id, i->id );
+
+                q.bytes_analysed = i->bytes_analysed;
+                q.bytes_passed   = i->bytes_passed;
+                q.flags          = (i->fips_ok    ? StatsRegion::QA_FIPS_OK    : 0)
+                                 | (i->ent8_ok    ? StatsRegion::QA_ENT8_OK    : 0)
+                                 | (i->ent16_ok   ? StatsRegion::QA_ENT16_OK   : 0)
+                                 | (i->bias_ok    ? StatsRegion::QA_BIAS_OK    : 0)
+                                 | (i->have_ent8  ? StatsRegion::QA_HAVE_ENT8  : 0)
+                                 | (i->have_ent16 ? StatsRegion::QA_HAVE_ENT16 : 0);
+                q.reserved       = 0;
+
+                copy_result( q.ent8, i->ent8 );
+                copy_result( q.ent16, i->ent16 );
+            }
+
+            for( Pool::SourceStatus::List::iterator i = src.begin(), e = src.end();
+                                        i != e && nsrc < StatsRegion::MAX_SOURCES; ++i )
+            {
+                StatsRegion::SourceEntry   &s = d.source[nsrc++];
+
+                copy_id( s.id, i->id );
+                copy_id( s.pool, i->pool );
+
+                s.group        = i->group;
+                s.flags        = (i->ok      ? StatsRegion::SOURCE_OK      : 0)
+                               | (i->standby ? StatsRegion::SOURCE_STANDBY : 0);
+                s.bitrate      = i->bitrate;
+                s.reserved     = 0;
+                s.recover_resync = i->recovered.resync;
+                s.recover_reinit = i->recovered.reinit;
+                s.recover_reset  = i->recovered.reset;
+                s.recover_failed = i->recovered.failed;
+                s.age_ms       = i->age_ms;
+                s.fresh        = i->stats.fresh;
+                s.mixed        = i->stats.mixed;
+                s.dropped      = i->stats.dropped;
+                s.idle_ms      = i->stats.idle_ms;
+                s.suspended_ms = i->stats.suspended_ms;
+            }
+
+            d.header.interval_ms = m_interval;
+            d.header.num_qa      = nqa;
+            d.header.num_sources = nsrc;
+            d.header.updated_us  = uint64_t(now.tv_sec) * 1000000 + uint64_t(now.tv_usec);
+
+            m_region.EndUpdate();
+
+            pthread_setcancelstate( oldstate, NULL );
+
+        } //}}}
+
+        void do_publish_thread()
+        { //{{{
+
+            SetThreadName( "stats publisher" );
+
+            Log<3>( "StatsPublisher( %s ): begin publish_thread, every %ums\n",
+                                            m_region.GetPath().c_str(), m_interval );
+            for(;;)
+            {
+                publish();
+                usleep( useconds_t(m_interval * 1000) );
+            }
+
+        } //}}}
+
+        static void *publish_thread( void *p )
+        { //{{{
+
+            StatsPublisher  *s = static_cast<StatsPublisher*>( p );
+
+            try {
+                s->do_publish_thread();
+            }
+            catch( const abi::__forced_unwind& )
+            {
+                Log<3>( "StatsPublisher( %s ): publish_thread cancelled\n",
+                                            s->m_region.GetPath().c_str() );
+                throw;
+            }
+            BB_CATCH_STD( 0, _("uncaught StatsPublisher::publish_thread exception") )
+
+            return NULL;
+
+        } //}}}
+
+
+    public:
+
+        // Publish to a new region created at path, which will be readable by
+        // the owner, and also by members of group gid if it is not gid_t(-1).
+        StatsPublisher( const std::string &path, gid_t gid = gid_t(-1),
+                                                 unsigned interval_ms = DEFAULT_INTERVAL )
+            : m_region( path, true, S_IRUSR | S_IWUSR | (gid != gid_t(-1) ? S_IRGRP : 0), gid )
+            , m_interval( interval_ms ? interval_ms : DEFAULT_INTERVAL )
+        { //{{{
+
+            Log<2>( "+ StatsPublisher( %s, %ums )\n", path.c_str(), m_interval );
+
+            int ret = pthread_create( &m_thread, GetDefaultThreadAttr(), publish_thread, this );
+
+            if( ret )
+                throw SystemError( ret, _("StatsPublisher( %s ) failed to create thread"),
+                                                                            path.c_str() );
+        } //}}}
+
+        ~StatsPublisher()
+        { //{{{
+
+            Log<2>( "- StatsPublisher( %s )\n", m_region.GetPath().c_str() );
+
+            pthread_cancel( m_thread );
+            pthread_join( m_thread, NULL );
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_STATS_PUBLISHER_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -0,0 +1,429 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_STATS_REGION_H
+#define _BB_STATS_REGION_H
+
+#include <bit-babbler/refptr.h>
+#include <bit-babbler/log.h>
+
+#if EM_PLATFORM_POSIX
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+#endif
+
+
+namespace BitB
+{
+    // A snapshot of seedd's statistics, in a file that other processes can map.
+    //{{{
+    // The region has a fixed size and layout, described by the Layout struct
+    // below, using native byte order and alignment, so that a process on the
+    // same host can map it read-only and read the QA results and the status
+    // of each source directly from memory, without making any system calls
+    // or needing to parse anything.  The file should be on a tmpfs (like the
+    // /run directory where the control socket is), so that the kernel never
+    // needs to write it back to a disk.
+    //
+    // The writer updates it in place under a sequence lock.  The Header.seq
+    // count is odd while an update is in progress, and is incremented again
+    // when it is complete, so a reader can tell if what it copied out of the
+    // region was consistent by checking that seq was even before it began,
+    // and unchanged once it is done.  If it was not, the copy must be retried.
+    // Read() does exactly that.
+    //
+    // Any change to the layout must change VERSION.  Readers should check the
+    // magic, version, and sizes in the Header before trusting anything else.
+    // When the writer exits, it clears Header.pid and removes the file, but a
+    // reader which already had it mapped will still see its final contents.
+    //}}}
+    class StatsRegion : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< StatsRegion >   Handle;
+
+
+        static const uint32_t   MAGIC           = 0x74734242;   // "BBst" little endian
+        static const uint32_t   VERSION         = 3;    // Added SourceEntry recover_*
+        static const unsigned   ID_SIZE         = 64;
+        static const unsigned   MAX_MONITORS    = 64;
+        static const unsigned   MAX_SOURCES     = 64;
+
+        enum QAFlags
+        {
+            QA_FIPS_OK      = 0x01,
+            QA_ENT8_OK      = 0x02,
+            QA_ENT16_OK     = 0x04,
+            QA_HAVE_ENT8    = 0x08,     // The ent8 result is valid
+            QA_HAVE_ENT16   = 0x10,     // The ent16 result is valid
+            QA_BIAS_OK      = 0x20
+        };
+
+        enum SourceFlags
+        {
+            SOURCE_OK       = 0x01,     // Passing QA
+            SOURCE_STANDBY  = 0x02      // Only used if others in its group fail
+        };
+
+
+        struct Header
+        { //{{{
+
+            uint32_t            magic;
+            uint32_t            version;
+            uint32_t            size;               // sizeof(Layout)
+            uint32_t            header_size;        // sizeof(Header)
+            uint32_t            qa_size;            // sizeof(QAEntry)
+            uint32_t            source_size;        // sizeof(SourceEntry)
+
+            volatile uint32_t   seq;                // Odd while being updated
+            uint32_t            pid;                // Of the writer, 0 once it exits
+            uint32_t            interval_ms;        // Between updates
+            uint32_t            num_qa;             // Valid entries in Layout.qa
+            uint32_t            num_sources;        // Valid entries in Layout.source
+            uint32_t            reserved;
+
+            uint64_t            updated_us;         // Wall time, since the epoch
+
+        }; //}}}
+
+        struct EntResult
+        { //{{{
+
+            double              entropy;
+            double              chisq;
+            double              mean;
+            double              pi;
+            double              corr;
+            double              minentropy;
+
+        }; //}}}
+
+        // The current results from one QA monitor.
+        struct QAEntry
+        { //{{{
+
+            char                id[ID_SIZE];        // NUL terminated, may be truncated
+            uint64_t            bytes_analysed;
+            uint64_t            bytes_passed;
+            uint32_t            flags;              // QAFlags
+            uint32_t            reserved;
+            EntResult           ent8;               // Current short term results
+            EntResult           ent16;
+
+        }; //}}}
+
+        // The status of one source, and what it has contributed to its pool.
+        struct SourceEntry
+        { //{{{
+
+            char                id[ID_SIZE];        // NUL terminated, may be truncated
+            char                pool[ID_SIZE];      // Empty for the default pool
+            uint32_t            group;
+            uint32_t            flags;              // SourceFlags
+            uint32_t            bitrate;
+            uint32_t            reserved;
+            uint32_t            recover_resync;     // Failed reads recovered from, by
+            uint32_t            recover_reinit;     // each method, as for the Recovered
+            uint32_t            recover_reset;      // counts of --contributions
+            uint32_t            recover_failed;
+            uint64_t            age_ms;             // Time since accounting began
+            uint64_t            fresh;              // Bytes, as for --contributions
+            uint64_t            mixed;
+            uint64_t            dropped;
+            uint64_t            idle_ms;
+            uint64_t            suspended_ms;
+
+        }; //}}}
+
+        struct Layout
+        { //{{{
+
+            Header              header;
+            QAEntry             qa[MAX_MONITORS];
+            SourceEntry         source[MAX_SOURCES];
+
+        }; //}}}
+
+
+    private:
+
+        std::string     m_path;
+        Layout         *m_data;
+        bool            m_writer;
+
+
+        // You cannot copy this class
+        StatsRegion( const StatsRegion& );
+        StatsRegion &operator=( const StatsRegion& );
+
+
+        static void barrier()
+        {
+            __sync_synchronize();
+        }
+
+
+      #if EM_PLATFORM_POSIX
+
+        void map_file( int fd )
+        { //{{{
+
+            void   *p = mmap( NULL, sizeof(Layout), m_writer ? PROT_READ | PROT_WRITE : PROT_READ,
+                              MAP_SHARED, fd, 0 );
+
+            if( p == MAP_FAILED )
+            {
+                SystemError e( _("StatsRegion( %s ): failed to map file"), m_path.c_str() );
+
+                close( fd );
+                throw e;
+            }
+
+            close( fd );
+            m_data = static_cast<Layout*>( p );
+
+        } //}}}
+
+        void create( mode_t mode, gid_t gid )
+        { //{{{
+
+            // Always start with a new file, so that a reader which still has
+            // an old one mapped will never see us overwrite it.  It is built
+            // under a temporary name in the same directory, then renamed into
+            // place, so a reader can never open it before its permissions and
+            // header are set, or find no file at all while we replace it.
+            std::string tmp = m_path + ".XXXXXX";
+            int         fd  = mkstemp( &tmp[0] );
+
+            if( fd < 0 )
+                throw SystemError( _("StatsRegion( %s ): failed to create file"), m_path.c_str() );
+
+            // Force the desired mode, regardless of current umask.
+            if( fcntl( fd, F_SETFD, FD_CLOEXEC ) || fchmod( fd, mode )
+             || (gid != gid_t(-1) && fchown( fd, uid_t(-1), gid )) )
+            {
+                SystemError e( _("StatsRegion( %s ): failed to set file permissions"),
+                                                                    m_path.c_str() );
+                close( fd );
+                unlink( tmp.c_str() );
+                throw e;
+            }
+
+            if( ftruncate( fd, off_t(sizeof(Layout)) ) )
+            {
+                SystemError e( _("StatsRegion( %s ): failed to size file"), m_path.c_str() );
+
+                close( fd );
+                unlink( tmp.c_str() );
+                throw e;
+            }
+
+            try {
+                map_file( fd );
+            }
+            catch( ... )
+            {
+                unlink( tmp.c_str() );
+                throw;
+            }
+
+            Header &h = m_data->header;
+
+            h.magic       = MAGIC;
+            h.version     = VERSION;
+            h.size        = sizeof(Layout);
+            h.header_size = sizeof(Header);
+            h.qa_size     = sizeof(QAEntry);
+            h.source_size = sizeof(SourceEntry);
+            h.pid         = uint32_t(getpid());
+
+            if( rename( tmp.c_str(), m_path.c_str() ) )
+            {
+                SystemError e( _("StatsRegion( %s ): failed to rename file into place"),
+                                                                        m_path.c_str() );
+                munmap( m_data, sizeof(Layout) );
+                m_data = NULL;
+                unlink( tmp.c_str() );
+                throw e;
+            }
+
+        } //}}}
+
+        void open_existing()
+        { //{{{
+
+            int fd = open( m_path.c_str(), O_RDONLY | O_CLOEXEC );
+
+            if( fd < 0 )
+                throw SystemError( _("StatsRegion( %s ): failed to open file"), m_path.c_str() );
+
+            struct stat     s;
+
+            if( fstat( fd, &s ) )
+            {
+                SystemError e( _("StatsRegion( %s ): failed to stat file"), m_path.c_str() );
+
+                close( fd );
+                throw e;
+            }
+
+            if( size_t(s.st_size) < sizeof(Header) )
+            {
+                close( fd );
+                throw Error( _("StatsRegion( %s ): file is too small (%zu bytes)"),
+                                                    m_path.c_str(), size_t(s.st_size) );
+            }
+
+            if( size_t(s.st_size) != sizeof(Layout) )
+            {
+                close( fd );
+                throw Error( _("StatsRegion( %s ): file is %zu bytes, expected %zu.  "
+                               "It may be from an incompatible version."),
+                             m_path.c_str(), size_t(s.st_size), sizeof(Layout) );
+            }
+
+            map_file( fd );
+
+            const Header &h = m_data->header;
+
+            if( h.magic != MAGIC || h.version != VERSION || h.size != sizeof(Layout)
+             || h.header_size != sizeof(Header) || h.qa_size != sizeof(QAEntry)
+             || h.source_size != sizeof(SourceEntry) )
+            {
+                munmap( m_data, sizeof(Layout) );
+                throw Error( _("StatsRegion( %s ): unrecognised format, version %u"),
+                                                            m_path.c_str(), h.version );
+            }
+
+        } //}}}
+
+      #endif
+
+
+    public:
+
+        // Map an existing region for reading.  If create is true then a new
+        // region will be created at path for writing, with the given mode, and
+        // with the group changed to gid if it is not gid_t(-1).
+        StatsRegion( const std::string &path, bool create = false,
+                     mode_t mode = S_IRUSR | S_IWUSR, gid_t gid = gid_t(-1) )
+            : m_path( path )
+            , m_data( NULL )
+            , m_writer( create )
+        { //{{{
+
+            Log<2>( "+ StatsRegion( %s%s )\n", path.c_str(), create ? ", create" : "" );
+
+          #if EM_PLATFORM_POSIX
+
+            if( create )
+                this->create( mode, gid );
+            else
+                open_existing();
+
+          #else
+
+            (void)mode;
+            (void)gid;
+
+            throw Error( _("StatsRegion( %s ): not supported on this platform"), path.c_str() );
+
+          #endif
+
+        } //}}}
+
+        ~StatsRegion()
+        { //{{{
+
+            Log<2>( "- StatsRegion( %s )\n", m_path.c_str() );
+
+          #if EM_PLATFORM_POSIX
+
+            if( m_writer )
+            {
+                BeginUpdate();
+                m_data->header.pid = 0;
+                EndUpdate();
+
+                unlink( m_path.c_str() );
+            }
+
+            munmap( m_data, sizeof(Layout) );
+
+          #endif
+
+        } //}}}
+
+
+        const std::string &GetPath() const { return m_path; }
+
+
+        // The writer must call BeginUpdate before changing anything in the
+        // region, and EndUpdate once it is done.  Only one thread may update
+        // the region.
+        Layout &BeginUpdate()
+        {
+            m_data->header.seq = m_data->header.seq + 1;
+            barrier();
+
+            return *m_data;
+        }
+
+        void EndUpdate()
+        {
+            barrier();
+            m_data->header.seq = m_data->header.seq + 1;
+        }
+
+
+        // Copy a consistent snapshot of the region into out.  Only the valid
+        // entries of each table are copied.  Returns false if an update was
+        // always in progress for the given number of attempts, in which case
+        // the content of out is not valid and the caller should try again later.
+        bool Read( Layout &out, unsigned attempts = 1000 ) const
+        { //{{{
+
+            const Layout   *d = m_data;
+
+            for( unsigned i = 0; i < attempts; ++i )
+            {
+                uint32_t    seq = d->header.seq;
+
+                if( seq & 1 )
+                    continue;
+
+                barrier();
+
+                memcpy( &out.header, &d->header, sizeof(Header) );
+
+                unsigned    nqa = std::min( out.header.num_qa, uint32_t(MAX_MONITORS) );
+                unsigned    nsrc = std::min( out.header.num_sources, uint32_t(MAX_SOURCES) );
+
+                memcpy( out.qa, d->qa, nqa * sizeof(QAEntry) );
+                memcpy( out.source, d->source, nsrc * sizeof(SourceEntry) );
+
+                barrier();
+
+                if( d->header.seq == seq )
+                {
+                    out.header.num_qa      = nqa;
+                    out.header.num_sources = nsrc;
+                    return true;
+                }
+            }
+
+            return false;
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_STATS_REGION_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
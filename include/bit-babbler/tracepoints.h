@@ -0,0 +1,47 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_TRACEPOINTS_H
+#define _BB_TRACEPOINTS_H
+
+// Static (USDT) tracepoints for the bitbabbler provider.
+//{{{
+// When systemtap's sys/sdt.h is available, each of these compiles to a single
+// nop instruction in the hot path, with the location of it and its arguments
+// recorded in a note section of the binary.  A tracer like bpftrace or perf
+// can then patch it to trap to a probe handler while it is attached, so they
+// cost next to nothing when they aren't in use, and don't perturb the timing
+// of what is being traced like raising the logging verbosity would.  e.g.
+//
+//   bpftrace -e 'usdt:/usr/bin/seedd:bitbabbler:read__done
+//                { @bytes[str(arg0)] = sum(arg1); }'
+//
+// If sys/sdt.h isn't available they are compiled out, and their arguments are
+// not evaluated.  Arguments must be integer or pointer values.  The probes are
+// listed in the TRACEPOINTS section of the seedd(1) manual.
+//}}}
+
+#if HAVE_SYS_SDT_H
+
+ #include <sys/sdt.h>
+
+ #define BB_TRACE( name )                   DTRACE_PROBE( bitbabbler, name )
+ #define BB_TRACE1( name, a )               DTRACE_PROBE1( bitbabbler, name, a )
+ #define BB_TRACE2( name, a, b )            DTRACE_PROBE2( bitbabbler, name, a, b )
+ #define BB_TRACE3( name, a, b, c )         DTRACE_PROBE3( bitbabbler, name, a, b, c )
+ #define BB_TRACE4( name, a, b, c, d )      DTRACE_PROBE4( bitbabbler, name, a, b, c, d )
+
+#else
+
+ #define BB_TRACE( name )                   do {} while(0)
+ #define BB_TRACE1( name, a )               do {} while(0)
+ #define BB_TRACE2( name, a, b )            do {} while(0)
+ #define BB_TRACE3( name, a, b, c )         do {} while(0)
+ #define BB_TRACE4( name, a, b, c, d )      do {} while(0)
+
+#endif
+
+
+#endif  // _BB_TRACEPOINTS_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
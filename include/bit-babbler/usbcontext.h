@@ -1474,6 +1474,9 @@ namespace BitB
         virtual void DeviceAdded( const Device::Handle &d )     { (void)d; }
         virtual void DeviceRemoved( const Device::Handle &d )   { (void)d; }
 
+        // And this to be notified of every device by RefreshAllDevices().
+        virtual void DeviceChanged( const Device::Handle &d )   { (void)d; }
+
 
         libusb_context *GetContext() const                      { return m_usb; }
 
@@ -1619,6 +1622,24 @@ namespace BitB
 
         } //}}}
 
+        // Call DeviceChanged() for all the current devices, with the list
+        // locked against changes from hotplug events until it's done.
+        void RefreshAllDevices()
+        { //{{{
+
+            ScopedMutex     lock( &m_device_mutex );
+
+            for( Device::List::const_iterator i = m_devices.begin(),
+                                              e = m_devices.end(); i != e; ++i )
+            {
+                try {
+                    DeviceChanged( *i );
+                }
+                BB_CATCH_ALL( 0, "USBContext: refresh failed" )
+            }
+
+        } //}}}
+
 
     public:
 
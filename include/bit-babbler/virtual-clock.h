@@ -0,0 +1,268 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#ifndef _BB_VIRTUAL_CLOCK_H
+#define _BB_VIRTUAL_CLOCK_H
+
+#include <bit-babbler/refptr.h>
+#include <bit-babbler/exceptions.h>
+#include <bit-babbler/log.h>
+
+#include <list>
+
+
+namespace BitB
+{
+    // A clock for simulating the behaviour of threads which sleep and wait.
+    //{{{
+    // Time only passes on this clock when every thread which is registered
+    // with it is blocked in one of its Wait() or Sleep() calls.  When that
+    // happens, it jumps straight to the earliest time that any of them were
+    // waiting until, and wakes them, so an hour of threads mostly sleeping
+    // can be simulated in only the time it takes to run their real work.
+    //
+    // For that to work, every thread which might wake another one must be
+    // registered, and must use Broadcast() to do it, so that we know it is
+    // runnable again before it is actually scheduled to run.  Threads which
+    // are created by a registered thread should be registered by it before
+    // they are started, so that the clock can't run ahead of them starting.
+    // All times here are in microseconds.
+    //}}}
+    class VirtualClock : public RefCounted
+    { //{{{
+    public:
+
+        typedef RefPtr< VirtualClock >      Handle;
+
+
+        // Unregister the current thread when this goes out of scope.
+        class ThreadGuard
+        { //{{{
+        private:
+
+            Handle      m_clock;
+
+        public:
+
+            ThreadGuard( const Handle &clock )
+                : m_clock( clock )
+            {}
+
+            ~ThreadGuard()
+            {
+                if( m_clock != NULL )
+                    m_clock->RemoveThread();
+            }
+
+        }; //}}}
+
+
+    private:
+
+        struct Waiter
+        { //{{{
+
+            pthread_cond_t *cond;
+            uint64_t        deadline;
+            bool            woken;
+            bool            timedout;
+            pthread_cond_t  wake;
+
+
+            Waiter( pthread_cond_t *c, uint64_t until )
+                : cond( c )
+                , deadline( until )
+                , woken( false )
+                , timedout( false )
+            {
+                pthread_cond_init( &wake, NULL );
+            }
+
+            ~Waiter()
+            {
+                pthread_cond_destroy( &wake );
+            }
+
+        }; //}}}
+
+        typedef std::list< Waiter* >    WaiterList;
+
+
+        // Release our mutex and retake the caller's one when a Wait() returns,
+        // or if the thread is cancelled while blocked in it.
+        struct WaitGuard
+        { //{{{
+
+            VirtualClock       *clock;
+            Waiter             *waiter;
+            pthread_mutex_t    *mutex;
+
+            WaitGuard( VirtualClock *c, Waiter *w, pthread_mutex_t *m )
+                : clock( c )
+                , waiter( w )
+                , mutex( m )
+            {}
+
+            ~WaitGuard()
+            {
+                clock->m_waiters.remove( waiter );
+
+                if( ! waiter->woken )
+                    ++clock->m_running;
+
+                pthread_mutex_unlock( &clock->m_mutex );
+
+                if( mutex )
+                    pthread_mutex_lock( mutex );
+            }
+
+        }; //}}}
+
+
+        pthread_mutex_t     m_mutex;
+        uint64_t            m_now;
+        unsigned            m_running;
+        bool                m_stopped;
+        WaiterList          m_waiters;
+
+
+        void wake( Waiter *w, bool timedout )
+        {
+            w->woken    = true;
+            w->timedout = timedout;
+            ++m_running;
+            pthread_cond_signal( &w->wake );
+        }
+
+        // You must hold m_mutex to call this
+        void advance_()
+        { //{{{
+
+            if( m_running || m_stopped )
+                return;
+
+            uint64_t    next = uint64_t(-1);
+
+            for( WaiterList::iterator i = m_waiters.begin(),
+                                      e = m_waiters.end(); i != e; ++i )
+                if( ! (*i)->woken && (*i)->deadline < next )
+                    next = (*i)->deadline;
+
+            // Everything is waiting for something which will now never happen.
+            if( next == uint64_t(-1) )
+            {
+                Log<3>( "VirtualClock: all threads blocked at %.6fs\n", double(m_now) / 1e6 );
+                return;
+            }
+
+            if( next > m_now )
+                m_now = next;
+
+            for( WaiterList::iterator i = m_waiters.begin(),
+                                      e = m_waiters.end(); i != e; ++i )
+                if( ! (*i)->woken && (*i)->deadline <= m_now )
+                    wake( *i, true );
+
+        } //}}}
+
+
+    public:
+
+        // The clock starts with only the thread that created it registered.
+        VirtualClock()
+            : m_now( 0 )
+            , m_running( 1 )
+            , m_stopped( false )
+        {
+            pthread_mutex_init( &m_mutex, NULL );
+        }
+
+        ~VirtualClock()
+        {
+            pthread_mutex_destroy( &m_mutex );
+        }
+
+
+        uint64_t Now()
+        {
+            ScopedMutex     lock( &m_mutex );
+            return m_now;
+        }
+
+
+        void AddThread()
+        {
+            ScopedMutex     lock( &m_mutex );
+            ++m_running;
+        }
+
+        void RemoveThread()
+        {
+            ScopedMutex     lock( &m_mutex );
+            --m_running;
+            advance_();
+        }
+
+        // Stop the clock.  Threads which are waiting now, or wait after this,
+        // will only be woken again by a Broadcast() (or by being cancelled).
+        void Stop()
+        {
+            ScopedMutex     lock( &m_mutex );
+            m_stopped = true;
+        }
+
+
+        // Wait for cond to be broadcast or for timeout to elapse, with the
+        // same semantics as pthread_cond_timedwait, where the caller must
+        // hold mutex (if it is not NULL).  A timeout of -1 will wait until
+        // cond is broadcast, however long that takes.  Returns false if the
+        // timeout elapsed.
+        bool Wait( pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t timeout )
+        { //{{{
+
+            pthread_mutex_lock( &m_mutex );
+
+            Waiter      w( cond, timeout == uint64_t(-1) ? timeout : m_now + timeout );
+            WaitGuard   guard( this, &w, mutex );
+
+            --m_running;
+            m_waiters.push_back( &w );
+
+            if( mutex )
+                pthread_mutex_unlock( mutex );
+
+            advance_();
+
+            while( ! w.woken )
+                pthread_cond_wait( &w.wake, &m_mutex );
+
+            return ! w.timedout;
+
+        } //}}}
+
+        void Sleep( uint64_t us )
+        {
+            Wait( NULL, NULL, us );
+        }
+
+        // Wake every thread waiting on cond.
+        void Broadcast( pthread_cond_t *cond )
+        { //{{{
+
+            ScopedMutex     lock( &m_mutex );
+
+            for( WaiterList::iterator i = m_waiters.begin(),
+                                      e = m_waiters.end(); i != e; ++i )
+                if( (*i)->cond == cond && ! (*i)->woken )
+                    wake( *i, false );
+
+        } //}}}
+
+    }; //}}}
+
+}   // BitB namespace
+
+
+#endif  // _BB_VIRTUAL_CLOCK_H
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -7,12 +7,16 @@
 #include <bit-babbler/term_escape.h>
 
 #include <bit-babbler/impl/health-monitor.h>
+#include <bit-babbler/impl/stage-profile.h>
+#include <bit-babbler/impl/buffer-pool.h>
+#include <bit-babbler/impl/secret-source.h>
 #include <bit-babbler/impl/log.h>
 
 #include <getopt.h>
 
 using BitB::USBContext;
 using BitB::BitBabbler;
+using BitB::BufferPool;
 using BitB::QA::Ent8;
 using BitB::QA::BitRuns;
 using BitB::StrToU;
@@ -260,17 +264,11 @@ private:
     Options                     m_options;
     string                      m_id;
     pthread_t                   m_threadid;
-    uint8_t                    *m_buf;
+    BufferPool::Buffer          m_buf;
 
     Result::Vector              m_results;
 
 
-    static unsigned DecrementBitrate( unsigned rate )
-    {
-        return 30000000 / (30000000 / rate + 1);
-    }
-
-
     void run_test( const BitBabbler::Options &bbo )
     { //{{{
 
@@ -355,11 +353,11 @@ private:
 
         BitBabbler::Options     bbo = m_options.bboptions;
 
-        m_buf = new uint8_t[ m_options.block_size ];
+        m_buf.Reset( m_options.block_size );
 
         for( bbo.bitrate = m_options.bitrate_max;
              bbo.bitrate >= m_options.bitrate_min;
-             bbo.bitrate = DecrementBitrate( bbo.bitrate ) )
+             bbo.bitrate = BitBabbler::LowerBitrate( bbo.bitrate ) )
         {
 
             if( (m_options.bboptions.enable_mask & 0xf) == 0 )
@@ -439,17 +437,10 @@ public:
         : m_dev( dev )
         , m_options( options )
         , m_id( dev->GetSerial() )
-        , m_buf( NULL )
     {
         begin_tests();
     }
 
-    ~Test()
-    {
-        delete [] m_buf;
-    }
-
-
     void WaitForCompletion() const
     {
         pthread_join( m_threadid, NULL );
@@ -5,6 +5,7 @@
 
 #include <bit-babbler/client-socket.h>
 #include <bit-babbler/qa.h>
+#include <bit-babbler/stats-region.h>
 
 #include <bit-babbler/impl/log.h>
 
@@ -14,6 +15,7 @@
 
 using BitB::Json;
 using BitB::ClientSock;
+using BitB::StatsRegion;
 using BitB::QA::Ent8;
 using BitB::QA::Ent16;
 using BitB::StrToU;
@@ -22,6 +24,9 @@ using BitB::StrToScaledUL;
 using BitB::Error;
 using BitB::Log;
 using BitB::stringprintf;
+using BitB::beforefirst;
+using BitB::afterfirst;
+using BitB::timeprintf;
 using std::string;
 
 
@@ -42,8 +47,14 @@ static void usage()
     printf("      --last=n              Show only the last n bins\n");
     printf("  -r, --bit-runs            Report on runs of consecutive bits\n");
     printf("  -S, --stats               Report general QA statistics\n");
+    printf("  -p, --profile             Report the time spent in each processing stage\n");
+    printf("      --buffers             Report the use of the data buffer pool\n");
+    printf("      --contributions       Report what each source has added to its pool\n");
+    printf("      --correlation         Report whether the sources in each group are independent\n");
+    printf("      --shm-stats=path      Report from a shared memory stats file\n");
     printf("  -c, --control-socket=path The service socket to query\n");
     printf("  -V, --log-verbosity=n     Change the logging verbosity\n");
+    printf("      --reload              Make the service reload its configuration\n");
     printf("      --waitfor=dev:n:r:max Wait for a device to pass some number of bytes\n");
     printf("  -v, --verbose             Enable verbose output\n");
     printf("  -?, --help                Show this help message\n");
@@ -120,6 +131,149 @@ struct WaitFor
 }; //}}}
 
 
+static void ReportContribution( const string &id, const Json::Data::Handle &c )
+{ //{{{
+
+    double  ms = c["Seconds"]->As<double>() * 1000.0;
+
+    if( ms <= 0.0 )
+        ms = 1.0;
+
+    printf( "  %-16s %12.0f %12.0f %12.0f %10.1f %10.1f %6.1f %6.1f\n", id.c_str(),
+            c["Fresh"]->As<double>() / 1024.0,
+            c["Mixed"]->As<double>() / 1024.0,
+            c["Dropped"]->As<double>() / 1024.0,
+            c["FreshRate"]->As<double>() / 1024.0,
+            c["MixedRate"]->As<double>() / 1024.0,
+            c["IdleMS"]->As<double>() * 100.0 / ms,
+            c["SuspendedMS"]->As<double>() * 100.0 / ms );
+
+    // Only sources report this, and only a few of those will ever need it.
+    Json::Data::Handle  r = c->Get( "Recovered" );
+
+    if( r.IsNotNULL() )
+    {
+        unsigned    resync = r["Resync"]->As<unsigned>();
+        unsigned    reinit = r["Reinit"]->As<unsigned>();
+        unsigned    reset  = r["Reset"]->As<unsigned>();
+        unsigned    failed = r["Failed"]->As<unsigned>();
+
+        if( resync || reinit || reset || failed )
+            printf( "  %-16s recovered by %u resync, %u reinit, %u reset, %u failed\n",
+                    "", resync, reinit, reset, failed );
+    }
+
+} //}}}
+
+// Return a request for cmd, for only the given device if id is not empty.
+static string DeviceRequest( const char *cmd, const string &id )
+{ //{{{
+
+    if( id.empty() )
+        return stringprintf( "\"%s\"", cmd );
+
+    return stringprintf( "[\"%s\",1,\"%s\"]", cmd, Json::Escape( id ).c_str() );
+
+} //}}}
+
+// Return the reply to the cmd request from a batch of them.  The replies are
+// in the same order as the requests, so if the server couldn't handle it, this
+// will return the BadRequest reply with the error that it reported for it.
+static Json::Data::Handle FindReply( const ClientSock::RequestList &requests,
+                                     const ClientSock::ReplyList   &replies,
+                                     const char                    *cmd )
+{ //{{{
+
+    string  name = stringprintf( "\"%s\"", cmd );
+    size_t  n    = 0;
+
+    for( ClientSock::RequestList::const_iterator i = requests.begin(),
+                                                 e = requests.end();
+                                                 i != e && n < replies.size(); ++i, ++n )
+    {
+        if( *i == name || i->compare( 0, name.size() + 1, '[' + name ) == 0 )
+            return replies[n];
+    }
+
+    throw Error( _("No reply to %s request"), cmd );
+
+} //}}}
+
+static void ReportSharedStats( const string &path, const string &deviceid )
+{ //{{{
+
+    StatsRegion                 region( path );
+    StatsRegion::Layout         d;
+
+    if( ! region.Read( d ) )
+        throw Error( _("%s: no consistent snapshot, the writer appears to be stuck"),
+                                                                    path.c_str() );
+
+    const StatsRegion::Header  &h = d.header;
+    timeval                     t;
+
+    t.tv_sec  = time_t(h.updated_us / 1000000);
+    t.tv_usec = suseconds_t(h.updated_us % 1000000);
+
+    printf( "%s: %s pid %u, updated %s (every %ums)\n", path.c_str(),
+            h.pid ? "from" : "was from", h.pid,
+            timeprintf( "%F %T", t ).c_str(), h.interval_ms );
+
+    printf( "\n  %-16s %14s %14s %4s %4s %5s %4s %7s %7s %7s\n", "QA", "analysed", "passed",
+            "FIPS", "Ent8", "Ent16", "Bias", "H8", "Hmin8", "Hmin16" );
+
+    for( unsigned i = 0; i < h.num_qa; ++i )
+    {
+        const StatsRegion::QAEntry &q = d.qa[i];
+
+        if( ! deviceid.empty() && deviceid != q.id )
+            continue;
+
+        printf( "  %-16s %14llu %14llu %4s %4s %5s %4s", q.id,
+                (unsigned long long)q.bytes_analysed, (unsigned long long)q.bytes_passed,
+                q.flags & StatsRegion::QA_FIPS_OK  ? "ok" : "FAIL",
+                q.flags & StatsRegion::QA_ENT8_OK  ? "ok" : "FAIL",
+                q.flags & StatsRegion::QA_ENT16_OK ? "ok" : "FAIL",
+                q.flags & StatsRegion::QA_BIAS_OK  ? "ok" : "FAIL" );
+
+        if( q.flags & StatsRegion::QA_HAVE_ENT8 )
+            printf( " %7.4f %7.4f", q.ent8.entropy, q.ent8.minentropy );
+        else
+            printf( " %7s %7s", "-", "-" );
+
+        if( q.flags & StatsRegion::QA_HAVE_ENT16 )
+            printf( " %7.4f\n", q.ent16.minentropy );
+        else
+            printf( " %7s\n", "-" );
+    }
+
+    printf( "\n  %-16s %-8s %5s %9s %12s %12s %12s %6s %6s\n", "source", "pool", "group",
+            "bitrate", "fresh kB", "mixed kB", "dropped kB", "idle%", "susp%" );
+
+    for( unsigned i = 0; i < h.num_sources; ++i )
+    {
+        const StatsRegion::SourceEntry &s  = d.source[i];
+        double                          ms = s.age_ms ? double(s.age_ms) : 1.0;
+
+        if( ! deviceid.empty() && deviceid != s.id )
+            continue;
+
+        printf( "  %-16s %-8s %5u %9u %12.0f %12.0f %12.0f %6.1f %6.1f%s%s\n",
+                s.id, s.pool[0] ? s.pool : "-", s.group, s.bitrate,
+                double(s.fresh) / 1024.0, double(s.mixed) / 1024.0,
+                double(s.dropped) / 1024.0,
+                double(s.idle_ms) * 100.0 / ms, double(s.suspended_ms) * 100.0 / ms,
+                s.flags & StatsRegion::SOURCE_STANDBY ? " standby" : "",
+                s.flags & StatsRegion::SOURCE_OK ? "" : " FAILING" );
+
+        if( s.recover_resync || s.recover_reinit || s.recover_reset || s.recover_failed )
+            printf( "  %-16s recovered by %u resync, %u reinit, %u reset, %u failed\n",
+                    "", s.recover_resync, s.recover_reinit, s.recover_reset, s.recover_failed );
+    }
+
+} //}}}
+
+
 int main( int argc, char *argv[] )
 {
   try {
@@ -129,11 +283,17 @@ int main( int argc, char *argv[] )
     unsigned        opt_bin_freq    = 0;
     unsigned        opt_bit_runs    = 0;
     unsigned        opt_stats       = 0;
+    unsigned        opt_profile     = 0;
+    unsigned        opt_buffers     = 0;
+    unsigned        opt_contrib     = 0;
+    unsigned        opt_correlation = 0;
     unsigned        opt_first       = 65536;
     unsigned        opt_last        = 65536;
     unsigned        opt_log_level   = unsigned(-1);
+    bool            opt_reload      = false;
     string          opt_deviceid;
     string          opt_controlsock = SEEDD_CONTROL_SOCKET;
+    string          opt_shmstats;
     WaitFor::List   opt_wait;
 
     enum
@@ -143,6 +303,11 @@ int main( int argc, char *argv[] )
         FIRST_OPT,
         LAST_OPT,
         WAITFOR_OPT,
+        RELOAD_OPT,
+        BUFFERS_OPT,
+        CONTRIBUTIONS_OPT,
+        CORRELATION_OPT,
+        SHM_STATS_OPT,
         VERSION_OPT
     };
 
@@ -158,9 +323,15 @@ int main( int argc, char *argv[] )
         { "last",           required_argument,  NULL,      LAST_OPT },
         { "bit-runs",       no_argument,        NULL,      'r' },
         { "stats",          no_argument,        NULL,      'S' },
+        { "profile",        no_argument,        NULL,      'p' },
+        { "buffers",        no_argument,        NULL,      BUFFERS_OPT },
+        { "contributions",  no_argument,        NULL,      CONTRIBUTIONS_OPT },
+        { "correlation",    no_argument,        NULL,      CORRELATION_OPT },
+        { "shm-stats",      required_argument,  NULL,      SHM_STATS_OPT },
         { "control-socket", required_argument,  NULL,      'c' },
         { "log-verbosity",  required_argument,  NULL,      'V' },
         { "waitfor",        required_argument,  NULL,      WAITFOR_OPT },
+        { "reload",         no_argument,        NULL,      RELOAD_OPT },
         { "verbose",        no_argument,        NULL,      'v' },
         { "help",           no_argument,        NULL,      '?' },
         { "version",        no_argument,        NULL,      VERSION_OPT },
@@ -172,7 +343,7 @@ int main( int argc, char *argv[] )
     for(;;)
     { //{{{
 
-        int c = getopt_long( argc, argv, ":si:c:bBrSV:v?",
+        int c = getopt_long( argc, argv, ":si:c:bBrSpV:v?",
                              long_options, &opt_index );
         if( c == -1 )
             break;
@@ -226,6 +397,26 @@ int main( int argc, char *argv[] )
                 opt_stats = 1;
                 break;
 
+            case 'p':
+                opt_profile = 1;
+                break;
+
+            case BUFFERS_OPT:
+                opt_buffers = 1;
+                break;
+
+            case CONTRIBUTIONS_OPT:
+                opt_contrib = 1;
+                break;
+
+            case CORRELATION_OPT:
+                opt_correlation = 1;
+                break;
+
+            case SHM_STATS_OPT:
+                opt_shmstats = optarg;
+                break;
+
             case 'c':
                 opt_controlsock = optarg;
                 break;
@@ -238,6 +429,10 @@ int main( int argc, char *argv[] )
                 opt_wait.push_back( WaitFor(optarg) );
                 break;
 
+            case RELOAD_OPT:
+                opt_reload = true;
+                break;
+
             case 'v':
                 ++BitB::opt_verbose;
                 break;
@@ -265,6 +460,13 @@ int main( int argc, char *argv[] )
     } //}}}
 
 
+    // This doesn't need the control socket at all, which is the point of it.
+    if( ! opt_shmstats.empty() )
+    {
+        ReportSharedStats( opt_shmstats, opt_deviceid );
+        return EXIT_SUCCESS;
+    }
+
     ClientSock      client( opt_controlsock );
 
 
@@ -289,25 +491,37 @@ int main( int argc, char *argv[] )
     } //}}}
 
 
-    if( opt_scan )
+    if( opt_reload )
     { //{{{
 
-        client.SendRequest( "\"GetIDs\"" );
-
+        client.SendRequest( "[\"Reload\",0]" );
         Json::Handle    json = client.Read();
 
         Log<4>("read reply: %s\n", json->JSONStr().c_str() );
 
-        if( json[0]->String() == "GetIDs" )
+        if( json[0]->String() == "Reload" )
         {
-            Json::Data::Handle  ids  = json[2];
-            size_t              n    = ids->GetArraySize();
+            Json::Data::Handle  r = json[2];
+            Json::Data::Handle  e = r->Get( "Error" );
 
-            printf( P_("Have %zu active device:\n",
-                       "Have %zu active devices:\n", n), n );
+            if( e != NULL )
+                throw Error( _("Reload failed: %s"), e->String().c_str() );
 
-            for( size_t i = 0; i < n; ++i )
-                printf( _("  Device ID: %s\n"), ids[i]->String().c_str() );
+            const char *what[] = { "Changed", "RestartRequired", "Failed" };
+            const char *desc[] = { _("Changed"), _("Needs restart"), _("Failed") };
+
+            for( size_t i = 0; i < sizeof(what) / sizeof(*what); ++i )
+            {
+                Json::Data::Handle  l = r[what[i]];
+                size_t              n = l->GetArraySize();
+
+                printf( "%s:", desc[i] );
+
+                for( size_t j = 0; j < n; ++j )
+                    printf( " %s", l[j]->String().c_str() );
+
+                printf( n ? "\n" : _(" nothing\n") );
+            }
 
         } else {
 
@@ -377,15 +591,67 @@ int main( int argc, char *argv[] )
     } //}}}
 
 
+    // Everything else only queries the current state, so ask for all of it
+    // at once, with a single round trip to the control socket.
+    ClientSock::RequestList     queries;
+
+    if( opt_scan )
+        queries.push_back( "\"GetIDs\"" );
+
     if( opt_bin_freq )
+        queries.push_back( DeviceRequest( "GetRawData", opt_deviceid ) );
+
+    if( opt_bit_runs || opt_stats )
+        queries.push_back( DeviceRequest( "ReportStats", opt_deviceid ) );
+
+    if( opt_profile )
+        queries.push_back( DeviceRequest( "GetProfile", opt_deviceid ) );
+
+    if( opt_buffers )
+        queries.push_back( "\"GetBufferStats\"" );
+
+    if( opt_contrib )
+        queries.push_back( "\"GetContributions\"" );
+
+    if( opt_correlation )
+        queries.push_back( "\"GetCorrelation\"" );
+
+    ClientSock::ReplyList   replies;
+
+    if( ! queries.empty() )
+        replies = client.Batch( queries );
+
+
+    if( opt_scan )
     { //{{{
 
-        if( opt_deviceid.empty() )
-            client.SendRequest( "\"GetRawData\"" );
-        else
-            client.SendRequest( "[\"GetRawData\",1,\"" + opt_deviceid + "\"]" );
+        Json::Data::Handle  json = FindReply( queries, replies, "GetIDs" );
 
-        Json::Handle    json = client.Read();
+        Log<4>("read reply: %s\n", json->JSONStr().c_str() );
+
+        if( json[0]->String() == "GetIDs" )
+        {
+            Json::Data::Handle  ids  = json[2];
+            size_t              n    = ids->GetArraySize();
+
+            printf( P_("Have %zu active device:\n",
+                       "Have %zu active devices:\n", n), n );
+
+            for( size_t i = 0; i < n; ++i )
+                printf( _("  Device ID: %s\n"), ids[i]->String().c_str() );
+
+        } else {
+
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
+        }
+
+    } //}}}
+
+
+    if( opt_bin_freq )
+    { //{{{
+
+        Json::Data::Handle  json = FindReply( queries, replies, "GetRawData" );
 
         Log<4>("read reply: %s\n", json->JSONStr().c_str() );
 
@@ -458,7 +724,7 @@ int main( int argc, char *argv[] )
 
         } else {
 
-            Log<0>( "unrecognised reply\n" );
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
         }
 
     } //}}}
@@ -469,12 +735,7 @@ int main( int argc, char *argv[] )
 
         using BitB::QA::BitRuns;
 
-        if( opt_deviceid.empty() )
-            client.SendRequest( "\"ReportStats\"" );
-        else
-            client.SendRequest( "[\"ReportStats\",1,\"" + opt_deviceid + "\"]" );
-
-        Json::Handle    json = client.Read();
+        Json::Data::Handle  json = FindReply( queries, replies, "ReportStats" );
 
         Log<4>("read reply: %s\n", json->JSONStr().c_str() );
 
@@ -495,7 +756,7 @@ int main( int argc, char *argv[] )
 
         } else {
 
-            Log<0>( "unrecognised reply\n" );
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
         }
 
     } //}}}
@@ -504,12 +765,7 @@ int main( int argc, char *argv[] )
     if( opt_stats )
     { //{{{
 
-        if( opt_deviceid.empty() )
-            client.SendRequest( "\"ReportStats\"" );
-        else
-            client.SendRequest( "[\"ReportStats\",1,\"" + opt_deviceid + "\"]" );
-
-        Json::Handle    json = client.Read();
+        Json::Data::Handle  json = FindReply( queries, replies, "ReportStats" );
 
         Log<4>("read reply: %s\n", json->JSONStr().c_str() );
 
@@ -565,11 +821,256 @@ int main( int argc, char *argv[] )
                     printf( "Ent16 short %s\n", e16_short.ReportResults().c_str() );
                     printf( "Ent16 long %s\n", e16_long.ReportResults().c_str() );
                 }
+
+                Json::Data::Handle  bias = stats[*si]->Get("BitBias");
+
+                if( ! bias )
+                {
+                    printf( "BitBias: no results (yet)\n" );
+
+                } else {
+
+                    BitB::QA::BitBias::Data  b_short( bias["Short"] );
+                    BitB::QA::BitBias::Data  b_long( bias["Long"] );
+
+                    printf( "BitBias short %s\n", b_short.Report().c_str() );
+                    printf( "BitBias long %s\n", b_long.Report().c_str() );
+                }
             }
 
         } else {
 
-            Log<0>( "unrecognised reply\n" );
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
+        }
+
+    } //}}}
+
+
+    if( opt_profile )
+    { //{{{
+
+        Json::Data::Handle  json = FindReply( queries, replies, "GetProfile" );
+
+        Log<4>("read reply: %s\n", json->JSONStr().c_str() );
+
+        if( json[0]->String() == "GetProfile" )
+        {
+            Json::Data::Handle  profiles = json[2];
+            Json::MemberList    ids;
+
+            profiles->GetMembers( ids );
+
+            for( Json::MemberList::iterator i = ids.begin(), e = ids.end(); i != e; ++i )
+            {
+                Json::Data::Handle  p = profiles[*i];
+                Json::MemberList    stages;
+
+                p->GetMembers( stages );
+
+                printf( "\nthread: %s\n", i->c_str() );
+                printf( "  %-10s %14s %14s %12s %12s\n",
+                        "stage", "count", "total ms", "mean us", "max us" );
+
+                for( Json::MemberList::iterator si = stages.begin(),
+                                                se = stages.end(); si != se; ++si )
+                {
+                    unsigned long long  count = p[*si]["Count"]->As<unsigned long long>();
+                    unsigned long long  total = p[*si]["TotalNS"]->As<unsigned long long>();
+                    unsigned long long  max   = p[*si]["MaxNS"]->As<unsigned long long>();
+
+                    printf( "  %-10s %14llu %14.1f %12.1f %12.1f\n", si->c_str(), count,
+                            double(total) / 1e6, count ? double(total) / double(count) / 1e3 : 0.0,
+                            double(max) / 1e3 );
+                }
+            }
+
+        } else {
+
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
+        }
+
+    } //}}}
+
+
+    if( opt_buffers )
+    { //{{{
+
+        Json::Data::Handle  json = FindReply( queries, replies, "GetBufferStats" );
+
+        Log<4>("read reply: %s\n", json->JSONStr().c_str() );
+
+        if( json[0]->String() == "GetBufferStats" )
+        {
+            Json::Data::Handle  stats   = json[2];
+            Json::Data::Handle  classes = stats["Classes"];
+
+            printf( "\nalignment %zu, huge pages %s, %zu bytes in use, %zu bytes free\n",
+                    stats["Alignment"]->As<size_t>(),
+                    stats["HugePages"]->IsTrue() ? "enabled" : "disabled",
+                    stats["InUseBytes"]->As<size_t>(),
+                    stats["FreeBytes"]->As<size_t>() );
+
+            printf( "  %10s %14s %14s %8s %8s %8s\n",
+                    "size", "requests", "recycled", "in use", "peak", "free" );
+
+            for( size_t i = 0, n = classes->GetArraySize(); i < n; ++i )
+            {
+                Json::Data::Handle  c = classes[i];
+
+                printf( "  %10zu %14llu %14llu %8lu %8lu %8u\n",
+                        c["Size"]->As<size_t>(),
+                        c["Requests"]->As<unsigned long long>(),
+                        c["Recycled"]->As<unsigned long long>(),
+                        c["InUse"]->As<unsigned long>(),
+                        c["PeakInUse"]->As<unsigned long>(),
+                        c["Free"]->As<unsigned>() );
+            }
+
+        } else {
+
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
+        }
+
+    } //}}}
+
+
+    if( opt_contrib )
+    { //{{{
+
+        Json::Data::Handle  json = FindReply( queries, replies, "GetContributions" );
+
+        Log<4>("read reply: %s\n", json->JSONStr().c_str() );
+
+        if( json[0]->String() == "GetContributions" )
+        {
+            Json::Data::Handle  pools = json[2];
+            Json::MemberList    names;
+
+            pools->GetMembers( names );
+
+            for( Json::MemberList::iterator i = names.begin(), e = names.end(); i != e; ++i )
+            {
+                Json::Data::Handle  groups  = pools[*i]["Groups"];
+                Json::Data::Handle  sources = pools[*i]["Sources"];
+                Json::MemberList    gids;
+                Json::MemberList    sids;
+
+                groups->GetMembers( gids );
+                sources->GetMembers( sids );
+
+                printf( "\npool: %s\n", i->empty() ? "(default)" : i->c_str() );
+                printf( "  %-16s %12s %12s %12s %10s %10s %6s %6s\n", "source",
+                        "fresh kB", "mixed kB", "dropped kB",
+                        "fresh kB/s", "mixed kB/s", "idle%", "susp%" );
+
+                for( Json::MemberList::iterator gi = gids.begin(),
+                                                ge = gids.end(); gi != ge; ++gi )
+                {
+                    ReportContribution( "group " + *gi, groups[*gi] );
+
+                    for( Json::MemberList::iterator si = sids.begin(),
+                                                    se = sids.end(); si != se; ++si )
+                    {
+                        if( stringprintf("%u", sources[*si]["Group"]->As<unsigned>()) == *gi )
+                            ReportContribution( "  " + *si, sources[*si] );
+                    }
+                }
+            }
+
+        } else {
+
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
+        }
+
+    } //}}}
+
+
+    if( opt_correlation )
+    { //{{{
+
+        Json::Data::Handle  json = FindReply( queries, replies, "GetCorrelation" );
+
+        Log<4>("read reply: %s\n", json->JSONStr().c_str() );
+
+        if( json[0]->String() == "GetCorrelation" )
+        {
+            Json::Data::Handle  pools = json[2];
+            Json::MemberList    names;
+
+            pools->GetMembers( names );
+
+            for( Json::MemberList::iterator i = names.begin(), e = names.end(); i != e; ++i )
+            {
+                Json::Data::Handle  groups = pools[*i];
+                Json::MemberList    gids;
+
+                groups->GetMembers( gids );
+
+                printf( "\npool: %s\n", i->empty() ? "(default)" : i->c_str() );
+
+                if( gids.empty() )
+                    printf( "  No groups are monitoring their sources\n" );
+
+                for( Json::MemberList::iterator gi = gids.begin(),
+                                                ge = gids.end(); gi != ge; ++gi )
+                {
+                    Json::Data::Handle  sources = groups[*gi]["Sources"];
+                    Json::Data::Handle  mon     = groups[*gi]["Monitor"];
+                    Json::Data::Handle  pairs   = mon["Pairs"];
+                    Json::Data::Handle  dep     = mon["Dependent"];
+                    Json::MemberList    pids;
+
+                    pairs->GetMembers( pids );
+
+                    printf( "\n  group %s: %u sources, %s", gi->c_str(),
+                            mon["Members"]->As<unsigned>(),
+                            mon["Independent"]->IsTrue() ? "independent"
+                                                         : "not yet known to be independent" );
+
+                    if( mon["FoldReductionHint"]->As<unsigned>() )
+                        printf( ", folding might be reduced by up to %u (check QA)",
+                                mon["FoldReductionHint"]->As<unsigned>() );
+
+                    printf( "\n" );
+
+                    for( size_t n = 0; n < dep->GetArraySize(); ++n )
+                    {
+                        string      m  = stringprintf( "%u", dep[n]->As<unsigned>() );
+                        Json::Data::Handle  id = sources->Get( m );
+
+                        printf( "  %s is not independent of the other sources in this group\n",
+                                ! id ? ("member " + m).c_str() : id->String().c_str() );
+                    }
+
+                    printf( "  %-16s %-16s %10s %8s %10s %8s %10s %10s %s\n",
+                            "source", "source", "MBit", "agree", "chisq", "p", "corr",
+                            "windows", "failed" );
+
+                    for( Json::MemberList::iterator pi = pids.begin(),
+                                                    pe = pids.end(); pi != pe; ++pi )
+                    {
+                        Json::Data::Handle  p  = pairs[*pi];
+                        Json::Data::Handle  a  = sources->Get( beforefirst(':', *pi) );
+                        Json::Data::Handle  b  = sources->Get( afterfirst(':', *pi) );
+                        Json::Data::Handle  sh = p["Short"];
+                        Json::Data::Handle  lo = p["Long"];
+
+                        printf( "  %-16s %-16s %10.1f %8.6f %10.4f %8.4f % 10.6f %10zu %zu%s\n",
+                                ! a ? beforefirst(':', *pi).c_str() : a->String().c_str(),
+                                ! b ? afterfirst(':', *pi).c_str() : b->String().c_str(),
+                                lo["Bits"]->As<double>() / 1048576.0,
+                                lo["Agreement"]->As<double>(),
+                                sh["Chisq"]->As<double>(), sh["Chisq-p"]->As<double>(),
+                                lo["Corr"]->As<double>(),
+                                p["Tested"]->As<size_t>(), p["Failed"]->As<size_t>(),
+                                p["Dependent"]->IsTrue() ? "  DEPENDENT" : "" );
+                    }
+                }
+            }
+
+        } else {
+
+            Log<0>( "unrecognised reply: %s\n", json->JSONStr().c_str() );
         }
 
     } //}}}
@@ -0,0 +1,970 @@
+//  This file is distributed as part of the bit-babbler package.
+//  Copyright 2026,  Ron <ron@debian.org>
+
+#include "private_setup.h"
+
+#include <bit-babbler/client-socket.h>
+#include <bit-babbler/qa.h>
+
+#include <bit-babbler/impl/log.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <getopt.h>
+
+#include <vector>
+#include <algorithm>
+
+using BitB::ClientSock;
+using BitB::SockAddr;
+using BitB::GetMonotonicUS;
+using BitB::StrToU;
+using BitB::StrToScaledU;
+using BitB::Error;
+using BitB::SystemError;
+using BitB::Log;
+using BitB::LogErr;
+using BitB::stringprintf;
+using std::string;
+
+
+static void usage()
+{
+    printf("Usage: bbload [OPTION...] [-- seedd options]\n");
+    printf("\n");
+    printf("End to end load test of seedd with simulated consumers\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -s, --seedd=path          The seedd binary to test (default ./seedd)\n");
+    printf("  -e, --emulate=n           Number of emulated devices to read (default 1)\n");
+    printf("  -t, --time=sec            How long to run the test for (default 10)\n");
+    printf("  -u, --udp=n:bytes:ms      Add n UDP clients reading bytes each ms\n");
+    printf("  -k, --kernel=n:ms         Add n simulated kernel feeds\n");
+    printf("  -o, --stdout=bytes        Read blocks of output from seedd's stdout\n");
+    printf("  -c, --control=n:ms        Add n control socket pollers\n");
+    printf("      --port=n              The UDP port for seedd to use (default 56789)\n");
+    printf("      --threads=n           Threads to run the UDP clients in (default 4)\n");
+    printf("      --timeout=ms          Time to wait for a UDP reply (default 2000)\n");
+    printf("  -v, --verbose             Enable verbose output\n");
+    printf("  -?, --help                Show this help message\n");
+    printf("      --version             Print the program version\n");
+    printf("\n");
+    printf("Report bugs to support@bitbabbler.org\n");
+    printf("\n");
+}
+
+
+// The kinds of consumer that we can simulate.
+enum Consumer
+{
+    UDP,
+    KERNEL,
+    STDOUT,
+    CONTROL,
+    CONSUMER_TYPES
+};
+
+static const char *consumer_name[CONSUMER_TYPES] =
+{
+    "udp",
+    "kernel",
+    "stdout",
+    "control"
+};
+
+
+// Parse an argument of the form n:a:b, where only n is mandatory.
+static std::vector< unsigned > ParseCounts( const char *opt, const string &arg,
+                                            unsigned a, unsigned b = 0 )
+{ //{{{
+
+    std::vector< unsigned > v;
+
+    v.push_back( 0 );
+    v.push_back( a );
+    v.push_back( b );
+
+    try {
+        size_t  p = 0;
+
+        for( size_t i = 0; i < v.size(); ++i )
+        {
+            size_t  n = arg.find( ':', p );
+
+            if( n != p )
+                v[i] = StrToScaledU( arg.substr( p, n - p ) );
+
+            if( n == string::npos )
+                return v;
+
+            p = n + 1;
+        }
+    }
+    catch( const std::exception &e )
+    {
+        throw Error( _("Invalid --%s argument '%s': %s"), opt, arg.c_str(), e.what() );
+    }
+
+    throw Error( _("Invalid --%s argument '%s': too many fields"), opt, arg.c_str() );
+
+} //}}}
+
+
+// The throughput and latency measured for one kind of consumer.
+class Results
+{ //{{{
+private:
+
+    std::vector< uint32_t >     m_latency;  // in microseconds
+    unsigned long long          m_bytes;
+    unsigned long long          m_errors;
+
+
+    static double ms( const std::vector< uint32_t > &v, double p )
+    {
+        return v[ std::min( v.size() - 1, size_t( double(v.size()) * p ) ) ] / 1000.0;
+    }
+
+
+public:
+
+    Results()
+        : m_bytes( 0 )
+        , m_errors( 0 )
+    {}
+
+
+    void Add( uint64_t us, size_t bytes )
+    {
+        m_latency.push_back( uint32_t( std::min( us, uint64_t(0xffffffff) ) ) );
+        m_bytes += bytes;
+    }
+
+    void Error()
+    {
+        ++m_errors;
+    }
+
+    void Merge( const Results &r )
+    {
+        m_latency.insert( m_latency.end(), r.m_latency.begin(), r.m_latency.end() );
+        m_bytes  += r.m_bytes;
+        m_errors += r.m_errors;
+    }
+
+
+    string Report( const char *name, unsigned clients, double seconds )
+    { //{{{
+
+        if( m_latency.empty() )
+            return stringprintf( "%-8s %7u %10u %8llu %10s %9s %9s %9s\n",
+                                 name, clients, 0, m_errors, "-", "-", "-", "-" );
+
+        std::sort( m_latency.begin(), m_latency.end() );
+
+        return stringprintf( "%-8s %7u %10zu %8llu %10.3f %9.3f %9.3f %9.3f\n",
+                             name, clients, m_latency.size(), m_errors,
+                             double(m_bytes) / seconds / 1e6,
+                             ms( m_latency, 0.5 ), ms( m_latency, 0.99 ),
+                             ms( m_latency, 0.999 ) );
+    } //}}}
+
+}; //}}}
+
+
+// A thread which runs some number of UDP clients (or simulated kernel feeds).
+//{{{
+// Each client has its own socket, so seedd sees each of them as a separate
+// peer, and they are all polled from this one thread, so that thousands of
+// them can be simulated without needing thousands of threads to do it.
+//}}}
+class UDPClients
+{ //{{{
+private:
+
+    struct Client
+    { //{{{
+
+        int         fd;
+        Consumer    type;
+        uint16_t    bytes;
+        uint64_t    interval;   // in microseconds
+        uint64_t    next;       // time to send the next request
+        uint64_t    sent;       // time the pending request was sent, or 0
+
+    }; //}}}
+
+    typedef std::vector< Client >   ClientList;
+
+
+    ClientList      m_clients;
+    uint64_t        m_end;
+    uint64_t        m_timeout;
+    pthread_t       m_thread;
+
+    Results         m_results[2];
+
+
+    void run()
+    { //{{{
+
+        std::vector< pollfd >   pfd;
+        std::vector< size_t >   pending;
+        uint8_t                 buf[65536];
+
+        for(;;)
+        {
+            uint64_t    now  = GetMonotonicUS();
+            uint64_t    wake = now + 10000;
+
+            if( now >= m_end )
+                return;
+
+            pfd.clear();
+            pending.clear();
+
+            for( size_t i = 0; i < m_clients.size(); ++i )
+            {
+                Client &c = m_clients[i];
+
+                if( c.sent && now - c.sent > m_timeout )
+                {
+                    Log<3>( "UDP client %d: timed out\n", c.fd );
+                    m_results[c.type].Error();
+                    c.sent = 0;
+                    c.next = now;
+                }
+
+                if( ! c.sent && c.next <= now )
+                {
+                    uint16_t    req = htons( c.bytes );
+
+                    // Drop any reply to a request which we already gave up on.
+                    while( recv( c.fd, buf, sizeof(buf), MSG_DONTWAIT ) > 0 ) {}
+
+                    if( send( c.fd, &req, sizeof(req), 0 ) != sizeof(req) )
+                    {
+                        LogErr<3>( "UDP client %d: send failed", c.fd );
+                        m_results[c.type].Error();
+                        c.next = now + c.interval + 1000;
+                        continue;
+                    }
+
+                    c.sent = now;
+                }
+
+                if( c.sent )
+                {
+                    pollfd  p = { c.fd, POLLIN, 0 };
+
+                    pfd.push_back( p );
+                    pending.push_back( i );
+                }
+                else if( c.next < wake )
+                    wake = c.next;
+            }
+
+            int r = poll( pfd.empty() ? NULL : &pfd[0], pfd.size(),
+                          int( (std::max( wake, now + 1000 ) - now) / 1000 ) );
+
+            if( r < 0 )
+            {
+                if( errno == EINTR )
+                    continue;
+
+                throw SystemError( _("UDPClients: poll failed") );
+            }
+
+            now = GetMonotonicUS();
+
+            for( size_t i = 0; r > 0 && i < pfd.size(); ++i )
+            {
+                if( ! pfd[i].revents )
+                    continue;
+
+                Client &c = m_clients[ pending[i] ];
+                ssize_t n = recv( c.fd, buf, sizeof(buf), MSG_DONTWAIT );
+
+                --r;
+
+                if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+                    continue;
+
+                if( n != c.bytes )
+                {
+                    Log<3>( "UDP client %d: got %zd of %u bytes\n", c.fd, n, c.bytes );
+                    m_results[c.type].Error();
+                }
+                else
+                    m_results[c.type].Add( now - c.sent, size_t(n) );
+
+                c.next = c.sent + c.interval;
+                c.sent = 0;
+            }
+        }
+
+    } //}}}
+
+    static void *thread( void *p )
+    { //{{{
+
+        UDPClients *u = static_cast<UDPClients*>( p );
+
+        BitB::SetThreadName( "UDP clients" );
+
+        try {
+            u->run();
+        }
+        BB_CATCH_STD( 0, _("uncaught UDPClients exception") )
+
+        return NULL;
+
+    } //}}}
+
+
+public:
+
+    UDPClients( uint64_t end, unsigned timeout_ms )
+        : m_end( end )
+        , m_timeout( uint64_t(timeout_ms) * 1000 )
+    {}
+
+    ~UDPClients()
+    {
+        for( ClientList::iterator i = m_clients.begin(), e = m_clients.end(); i != e; ++i )
+            close( i->fd );
+    }
+
+
+    void AddClient( SockAddr &sa, Consumer type, unsigned bytes, unsigned interval_ms )
+    { //{{{
+
+        Client  c;
+
+        c.fd = socket( sa.addr.any.sa_family, SOCK_DGRAM, 0 );
+
+        if( c.fd < 0 )
+            throw SystemError( _("UDPClients: failed to create socket") );
+
+        if( connect( c.fd, &sa.addr.any, sa.addr_len ) < 0 )
+        {
+            close( c.fd );
+            throw SystemError( _("UDPClients: failed to connect to %s"), sa.AddrStr().c_str() );
+        }
+
+        c.type      = type;
+        c.bytes     = uint16_t( bytes );
+        c.interval  = uint64_t(interval_ms) * 1000;
+        c.next      = 0;
+        c.sent      = 0;
+
+        m_clients.push_back( c );
+
+    } //}}}
+
+    void Start()
+    { //{{{
+
+        int ret = pthread_create( &m_thread, NULL, thread, this );
+
+        if( ret )
+            throw SystemError( ret, _("UDPClients: failed to create thread") );
+
+    } //}}}
+
+    void Join( Results results[CONSUMER_TYPES] )
+    {
+        pthread_join( m_thread, NULL );
+
+        results[UDP].Merge( m_results[UDP] );
+        results[KERNEL].Merge( m_results[KERNEL] );
+    }
+
+}; //}}}
+
+
+// A thread which polls the control socket, like a monitoring client would.
+class ControlPoller
+{ //{{{
+private:
+
+    string          m_path;
+    uint64_t        m_end;
+    uint64_t        m_interval;
+    pthread_t       m_thread;
+
+    Results         m_results;
+
+
+    void run()
+    { //{{{
+
+        ClientSock  client( m_path, 1024 * 1024 );
+
+        for( uint64_t next = GetMonotonicUS(); next < m_end; next += m_interval )
+        {
+            uint64_t    start = GetMonotonicUS();
+
+            if( next > start )
+            {
+                usleep( useconds_t(next - start) );
+                start = GetMonotonicUS();
+            }
+
+            client.SendRequest( "\"ReportStats\"" );
+
+            BitB::Json::Handle  json = client.Read();
+
+            if( json[0]->String() == "ReportStats" )
+                m_results.Add( GetMonotonicUS() - start, json->JSONStr().size() );
+            else
+                m_results.Error();
+        }
+
+    } //}}}
+
+    static void *thread( void *p )
+    { //{{{
+
+        ControlPoller  *c = static_cast<ControlPoller*>( p );
+
+        BitB::SetThreadName( "control poller" );
+
+        try {
+            c->run();
+        }
+        catch( const std::exception &e )
+        {
+            Log<1>( "ControlPoller: %s\n", e.what() );
+            c->m_results.Error();
+        }
+
+        return NULL;
+
+    } //}}}
+
+
+public:
+
+    ControlPoller( const string &path, uint64_t end, unsigned interval_ms )
+        : m_path( path )
+        , m_end( end )
+        , m_interval( uint64_t(interval_ms) * 1000 )
+    {
+        int ret = pthread_create( &m_thread, NULL, thread, this );
+
+        if( ret )
+            throw SystemError( ret, _("ControlPoller: failed to create thread") );
+    }
+
+    void Join( Results &results )
+    {
+        pthread_join( m_thread, NULL );
+        results.Merge( m_results );
+    }
+
+}; //}}}
+
+
+// A thread which reads blocks from seedd's stdout until the test ends.
+class StdoutReader
+{ //{{{
+private:
+
+    int             m_fd;
+    size_t          m_block;
+    uint64_t        m_end;
+    pthread_t       m_thread;
+
+    Results         m_results;
+
+
+    void run()
+    { //{{{
+
+        std::vector< uint8_t >  buf( m_block );
+
+        for(;;)
+        {
+            uint64_t    start = GetMonotonicUS();
+
+            if( start >= m_end )
+                return;
+
+            for( size_t c = 0; c < m_block; )
+            {
+                ssize_t n = read( m_fd, &buf[c], m_block - c );
+
+                if( n < 0 )
+                {
+                    if( errno == EINTR )
+                        continue;
+
+                    throw SystemError( _("StdoutReader: read failed") );
+                }
+
+                if( n == 0 )
+                    return;
+
+                c += size_t(n);
+            }
+
+            m_results.Add( GetMonotonicUS() - start, m_block );
+        }
+
+    } //}}}
+
+    static void *thread( void *p )
+    { //{{{
+
+        StdoutReader   *s = static_cast<StdoutReader*>( p );
+
+        BitB::SetThreadName( "stdout reader" );
+
+        try {
+            s->run();
+        }
+        BB_CATCH_STD( 0, _("uncaught StdoutReader exception") )
+
+        return NULL;
+
+    } //}}}
+
+
+public:
+
+    StdoutReader( int fd, size_t block, uint64_t end )
+        : m_fd( fd )
+        , m_block( block )
+        , m_end( end )
+    {
+        int ret = pthread_create( &m_thread, NULL, thread, this );
+
+        if( ret )
+            throw SystemError( ret, _("StdoutReader: failed to create thread") );
+    }
+
+    void Join( Results &results )
+    {
+        pthread_join( m_thread, NULL );
+        results.Merge( m_results );
+    }
+
+}; //}}}
+
+
+// Start seedd with the given arguments, returning its pid.  If stdout_fd is
+// not NULL, it is set to the read end of a pipe from the stdout of seedd.
+static pid_t StartSeedd( const std::vector< string > &args, int *stdout_fd )
+{ //{{{
+
+    int     fd[2];
+
+    if( stdout_fd && pipe( fd ) )
+        throw SystemError( _("Failed to create pipe for seedd stdout") );
+
+    pid_t   pid = fork();
+
+    if( pid < 0 )
+        throw SystemError( _("Failed to fork seedd") );
+
+    if( pid == 0 )
+    {
+        std::vector< char* >    argv;
+
+        for( size_t i = 0; i < args.size(); ++i )
+            argv.push_back( const_cast<char*>( args[i].c_str() ) );
+
+        argv.push_back( NULL );
+
+        if( stdout_fd )
+        {
+            dup2( fd[1], STDOUT_FILENO );
+            close( fd[0] );
+            close( fd[1] );
+        }
+
+        execv( argv[0], &argv[0] );
+
+        LogErr<0>( "Failed to exec %s", argv[0] );
+        _exit( EXIT_FAILURE );
+    }
+
+    if( stdout_fd )
+    {
+        close( fd[1] );
+        *stdout_fd = fd[0];
+    }
+
+    return pid;
+
+} //}}}
+
+// Wait until the control socket is accepting connections, which seedd
+// only creates after its UDP sockets are ready for clients too.  If it
+// exits before then, pid is set to -1 since it has already been reaped.
+static void WaitForSeedd( pid_t &pid, const string &ctl )
+{ //{{{
+
+    for( unsigned i = 0; i < 100; ++i )
+    {
+        int status;
+
+        if( waitpid( pid, &status, WNOHANG ) == pid )
+        {
+            pid = -1;
+            throw Error( _("seedd exited before it was ready (status %d)"), status );
+        }
+
+        try {
+            ClientSock  client( ctl, 1024 );
+            return;
+        }
+        catch( const std::exception &e )
+        {
+            Log<4>( "Waiting for seedd: %s\n", e.what() );
+        }
+
+        usleep( 100000 );
+    }
+
+    throw Error( _("Timed out waiting for seedd to start") );
+
+} //}}}
+
+
+// The seedd under test, and the temporary directory for its control socket.
+// Both are cleaned up when this is destroyed, whichever way we leave main().
+class Seedd
+{ //{{{
+private:
+
+    string      m_dir;
+    string      m_ctl;
+    pid_t       m_pid;
+    int         m_stdout_fd;
+
+
+public:
+
+    Seedd()
+        : m_pid( -1 )
+        , m_stdout_fd( -1 )
+    {
+        char    dir[] = "/tmp/bbload.XXXXXX";
+
+        if( ! mkdtemp( dir ) )
+            throw SystemError( _("Failed to create temporary directory") );
+
+        m_dir = dir;
+        m_ctl = m_dir + "/control";
+    }
+
+    ~Seedd()
+    {
+        Stop();
+        unlink( m_ctl.c_str() );
+        rmdir( m_dir.c_str() );
+    }
+
+
+    const string &ControlSocket() const
+    {
+        return m_ctl;
+    }
+
+    // The read end of the pipe from its stdout, or -1 if not captured.
+    int GetStdoutFD() const
+    {
+        return m_stdout_fd;
+    }
+
+    // Start seedd and wait until it is ready for clients.
+    void Start( const std::vector< string > &args, bool capture_stdout )
+    {
+        m_pid = StartSeedd( args, capture_stdout ? &m_stdout_fd : NULL );
+        WaitForSeedd( m_pid, m_ctl );
+    }
+
+    void Stop()
+    {
+        if( m_pid > 0 )
+        {
+            int status;
+
+            kill( m_pid, SIGTERM );
+            waitpid( m_pid, &status, 0 );
+            m_pid = -1;
+        }
+
+        if( m_stdout_fd >= 0 )
+        {
+            close( m_stdout_fd );
+            m_stdout_fd = -1;
+        }
+    }
+
+}; //}}}
+
+
+int main( int argc, char *argv[] )
+{
+  try {
+
+    string          opt_seedd       = "./seedd";
+    unsigned        opt_emulate     = 1;
+    unsigned        opt_time        = 10;
+    unsigned        opt_udp         = 0;
+    unsigned        opt_udp_bytes   = 32;
+    unsigned        opt_udp_ms      = 0;
+    unsigned        opt_kernel      = 0;
+    unsigned        opt_kernel_ms   = 1000;
+    unsigned        opt_stdout      = 0;
+    unsigned        opt_control     = 0;
+    unsigned        opt_control_ms  = 100;
+    unsigned        opt_port        = 56789;
+    unsigned        opt_threads     = 4;
+    unsigned        opt_timeout     = 2000;
+
+    enum
+    {
+        PORT_OPT,
+        THREADS_OPT,
+        TIMEOUT_OPT,
+        VERSION_OPT
+    };
+
+    struct option long_options[] =
+    {
+        { "seedd",          required_argument,  NULL,      's' },
+        { "emulate",        required_argument,  NULL,      'e' },
+        { "time",           required_argument,  NULL,      't' },
+        { "udp",            required_argument,  NULL,      'u' },
+        { "kernel",         required_argument,  NULL,      'k' },
+        { "stdout",         required_argument,  NULL,      'o' },
+        { "control",        required_argument,  NULL,      'c' },
+        { "port",           required_argument,  NULL,      PORT_OPT },
+        { "threads",        required_argument,  NULL,      THREADS_OPT },
+        { "timeout",        required_argument,  NULL,      TIMEOUT_OPT },
+        { "verbose",        no_argument,        NULL,      'v' },
+        { "help",           no_argument,        NULL,      '?' },
+        { "version",        no_argument,        NULL,      VERSION_OPT },
+        { 0, 0, 0, 0 }
+    };
+
+    int opt_index = 0;
+
+    for(;;)
+    { //{{{
+
+        int c = getopt_long( argc, argv, ":s:e:t:u:k:o:c:v?",
+                             long_options, &opt_index );
+        if( c == -1 )
+            break;
+
+        switch(c)
+        {
+            case 's':
+                opt_seedd = optarg;
+                break;
+
+            case 'e':
+                opt_emulate = StrToU( optarg, 10 );
+                break;
+
+            case 't':
+                opt_time = StrToU( optarg, 10 );
+                break;
+
+            case 'u':
+            {
+                std::vector< unsigned > v = ParseCounts( "udp", optarg, 32, 0 );
+
+                opt_udp         = v[0];
+                opt_udp_bytes   = v[1];
+                opt_udp_ms      = v[2];
+
+                if( opt_udp_bytes < 1 || opt_udp_bytes > 32768 )
+                    throw Error( _("UDP request size must be from 1 to 32768 bytes") );
+                break;
+            }
+
+            case 'k':
+            {
+                std::vector< unsigned > v = ParseCounts( "kernel", optarg, 1000 );
+
+                opt_kernel      = v[0];
+                opt_kernel_ms   = v[1];
+                break;
+            }
+
+            case 'o':
+                opt_stdout = StrToScaledU( optarg, 1024 );
+
+                if( opt_stdout < 1 )
+                    throw Error( _("The stdout block size must be at least 1 byte") );
+                break;
+
+            case 'c':
+            {
+                std::vector< unsigned > v = ParseCounts( "control", optarg, 100 );
+
+                opt_control     = v[0];
+                opt_control_ms  = v[1];
+                break;
+            }
+
+            case PORT_OPT:
+                opt_port = StrToU( optarg, 10 );
+                break;
+
+            case THREADS_OPT:
+                opt_threads = std::max( 1u, StrToU( optarg, 10 ) );
+                break;
+
+            case TIMEOUT_OPT:
+                opt_timeout = StrToU( optarg, 10 );
+                break;
+
+            case 'v':
+                ++BitB::opt_verbose;
+                break;
+
+            case '?':
+                if( optopt != '?' && optopt != 0 )
+                {
+                    fprintf(stderr, "%s: invalid option -- '%c', try --help\n",
+                                                            argv[0], optopt);
+                    return EXIT_FAILURE;
+                }
+                usage();
+                return EXIT_SUCCESS;
+
+            case ':':
+                fprintf(stderr, "%s: missing argument for '%s', try --help\n",
+                                                    argv[0], argv[optind - 1] );
+                return EXIT_FAILURE;
+
+            case VERSION_OPT:
+                printf("bbload " PACKAGE_VERSION "\n");
+                return EXIT_SUCCESS;
+        }
+
+    } //}}}
+
+
+    // Simulating thousands of clients needs a socket for each of them.
+    rlimit  rl;
+
+    if( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur < rl.rlim_max )
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &rl );
+    }
+
+    signal( SIGPIPE, SIG_IGN );
+
+
+    Seedd                   seedd;
+    const string           &ctl     = seedd.ControlSocket();
+    const string            udp_out = stringprintf( "127.0.0.1:%u", opt_port );
+    std::vector< string >   args;
+
+    args.push_back( opt_seedd );
+    args.push_back( stringprintf( "--emulate=%u", opt_emulate ) );
+    args.push_back( "--control-socket=" + ctl );
+
+    if( opt_udp || opt_kernel )
+        args.push_back( "--udp-out=" + udp_out );
+
+    if( opt_stdout )
+        args.push_back( "--stdout" );
+
+    for( int i = optind; i < argc; ++i )
+        args.push_back( argv[i] );
+
+
+    seedd.Start( args, opt_stdout != 0 );
+
+
+    std::vector< UDPClients* >      udp;
+    std::vector< ControlPoller* >   pollers;
+    StdoutReader                   *reader = NULL;
+    Results                         results[CONSUMER_TYPES];
+    SockAddr                        sa( udp_out );
+
+    uint64_t    start = GetMonotonicUS();
+    uint64_t    end   = start + uint64_t(opt_time) * 1000000;
+
+    sa.GetAddrInfo( SOCK_DGRAM, 0 );
+
+    if( opt_udp || opt_kernel )
+    {
+        unsigned    n = std::min( opt_threads, opt_udp + opt_kernel );
+
+        for( unsigned i = 0; i < n; ++i )
+            udp.push_back( new UDPClients( end, opt_timeout ) );
+
+        // The kernel feed reads a FIPS block from the pool each time it wakes.
+        for( unsigned i = 0; i < opt_udp + opt_kernel; ++i )
+            udp[i % n]->AddClient( sa, i < opt_udp ? UDP : KERNEL,
+                                   i < opt_udp ? opt_udp_bytes
+                                               : unsigned(BitB::QA::FIPS::BUFFER_SIZE),
+                                   i < opt_udp ? opt_udp_ms : opt_kernel_ms );
+        for( unsigned i = 0; i < n; ++i )
+            udp[i]->Start();
+    }
+
+    for( unsigned i = 0; i < opt_control; ++i )
+        pollers.push_back( new ControlPoller( ctl, end, opt_control_ms ) );
+
+    if( opt_stdout )
+        reader = new StdoutReader( seedd.GetStdoutFD(), opt_stdout, end );
+
+
+    for( size_t i = 0; i < udp.size(); ++i )
+    {
+        udp[i]->Join( results );
+        delete udp[i];
+    }
+
+    for( size_t i = 0; i < pollers.size(); ++i )
+    {
+        pollers[i]->Join( results[CONTROL] );
+        delete pollers[i];
+    }
+
+    if( reader )
+    {
+        reader->Join( results[STDOUT] );
+        delete reader;
+    }
+
+    double  seconds = double(GetMonotonicUS() - start) / 1e6;
+
+    seedd.Stop();
+
+
+    const unsigned  clients[CONSUMER_TYPES] =
+    {
+        opt_udp, opt_kernel, opt_stdout ? 1u : 0u, opt_control
+    };
+
+    printf( "Load test of %.1f seconds with %u emulated device%s\n\n",
+            seconds, opt_emulate, opt_emulate == 1 ? "" : "s" );
+    printf( "%-8s %7s %10s %8s %10s %9s %9s %9s\n", "consumer", "clients",
+            "requests", "errors", "MB/s", "p50 ms", "p99 ms", "p999 ms" );
+
+    for( unsigned i = 0; i < CONSUMER_TYPES; ++i )
+        if( clients[i] )
+            printf( "%s", results[i].Report( consumer_name[i], clients[i], seconds ).c_str() );
+
+    return EXIT_SUCCESS;
+  }
+  BB_CATCH_ALL( 0, _("bbload fatal exception") )
+
+  return EXIT_FAILURE;
+}
+
+// vi:sts=4:sw=4:et:foldmethod=marker
@@ -11,20 +11,36 @@
 #include <bit-babbler/socket-source.h>
 #include <bit-babbler/secret-sink.h>
 #include <bit-babbler/control-socket.h>
+#include <bit-babbler/stats-publisher.h>
 #include <bit-babbler/signals.h>
+#include <bit-babbler/simulation.h>
 
 #include <bit-babbler/impl/health-monitor.h>
+#include <bit-babbler/impl/stage-profile.h>
+#include <bit-babbler/impl/buffer-pool.h>
+#include <bit-babbler/impl/secret-source.h>
 #include <bit-babbler/impl/log.h>
 
 #include <getopt.h>
+#include <limits.h>
 
 
 using BitB::BitBabbler;
+using BitB::Conditioner;
 using BitB::Pool;
+using BitB::RemoteSource;
+using BitB::DRBG;
+using BitB::DRBGWriter;
 using BitB::SocketSource;
+using BitB::SockAddr;
 using BitB::ControlSock;
 using BitB::CreateControlSocket;
+using BitB::StatsPublisher;
 using BitB::SecretSink;
+using BitB::Simulation;
+using BitB::SimSource;
+using BitB::VirtualClock;
+using BitB::SocketReader;
 using BitB::StrToU;
 using BitB::StrToScaledU;
 using BitB::StrToScaledUL;
@@ -56,27 +72,45 @@ static void usage()
     printf("  -c, --control-socket=path Where to create the control socket\n");
     printf("      --socket-group=grp    Grant group access to the control socket\n");
     printf("      --ip-freebind         Allow sockets to be bound to dynamic interfaces\n");
+    printf("      --shm-stats=path      Publish statistics in a shared memory file\n");
+    printf("      --shm-stats-interval=ms  Time between shared memory updates\n");
     printf("  -P, --pool-size=n         Size of the entropy pool\n");
     printf("      --kernel-device=path  Where to feed entropy to the OS kernel\n");
     printf("      --kernel-refill=sec   Max time in seconds before OS pool refresh\n");
+    printf("      --kernel-credit-margin=percent  Entropy margin for kernel credit\n");
+    printf("      --usb-bus-budget=n    Max bytes/sec to read from each USB bus at once\n");
+    printf("      --huge-pages          Back large data buffers with huge pages\n");
     printf("  -G, --group-size=g:n      Size of a single pool group\n");
-    printf("      --watch=path:ms:bs:n  Monitor an external device\n");
+    printf("      --group-monitor=g     Check the sources in group g are independent\n");
+    printf("      --named-pool=name:n   Add a separate pool of size n\n");
+    printf("      --remote=proto:host:port  Add entropy from a remote seedd\n");
+    printf("      --drbg-udp-out=host:port  Provide a UDP socket for DRBG output\n");
+    printf("      --drbg-stdout         Send DRBG output to stdout instead of entropy\n");
+    printf("      --drbg-reseed=n:sec   Max bytes and seconds between DRBG reseeding\n");
+    printf("      --watch=path:ms:bs:n  Monitor an external device or socket\n");
     printf("      --gen-conf            Output a config file using the options passed\n");
+    printf("      --simulate=trace      Evaluate the options with modelled devices\n");
+    printf("      --emulate=n           Add n emulated devices (for testing only)\n");
     printf("  -v, --verbose             Enable verbose output\n");
     printf("  -?, --help                Show this help message\n");
     printf("      --version             Print the program version\n");
     printf("\n");
     printf("Per device options:\n");
     printf("  -r, --bitrate=Hz          Set the bitrate (in bits per second)\n");
+    printf("      --auto-bitrate=min:max  Adjust the bitrate from measured entropy\n");
     printf("      --latency=ms          Override the USB latency timer\n");
     printf("  -f, --fold=n              Set the amount of entropy folding\n");
+    printf("      --auto-fold=min:max   Adjust the folding from measured entropy\n");
+    printf("      --condition=in:out    Condition with SHA-256 instead of folding\n");
     printf("  -g, --group=n             The pool group to add the device to\n");
+    printf("      --pool=name           The named pool to add the device to\n");
     printf("      --enable-mask=mask    Select a subset of the generators\n");
     printf("      --idle-sleep=init:max Tune the rate of pool refresh when idle\n");
     printf("      --suspend-after=ms    Set the threshold for USB autosuspend\n");
     printf("      --low-power           Convenience preset for idle and suspend\n");
     printf("      --limit-max-xfer      Limit the transfer chunk size to 16kB\n");
     printf("      --no-qa               Don't drop blocks that fail QA checking\n");
+    printf("      --standby             Only use the device if others in its group fail\n");
     printf("\n");
     printf("Report bugs to support@bitbabbler.org\n");
     printf("\n");
@@ -108,6 +142,24 @@ static void WriteCompletion( void *p )
 #endif
 
 
+// A separately named pool, and the outputs which will be drawn from it.
+struct NamedPool
+{ //{{{
+
+    typedef std::list< NamedPool >  List;
+
+    Pool::Options   pool;
+    std::string     udp_out;
+    bool            kernel;
+
+
+    NamedPool()
+        : kernel( false )
+    {}
+
+}; //}}}
+
+
 // Configuration options, imported from file(s) and/or the command line.
 class Config : public BitB::IniData
 { //{{{
@@ -202,6 +254,8 @@ private:
                         ->AddTest( "control-socket",    Validator::OptionWithValue )
                         ->AddTest( "socket-group",      Validator::OptionWithValue )
                         ->AddTest( "ip-freebind",       Validator::OptionWithoutValue )
+                        ->AddTest( "shm-stats",         Validator::OptionWithValue )
+                        ->AddTest( "shm-stats-interval", UnsignedValue )
                         ->AddTest( "verbose",           UnsignedValue );
 
             m_validator->Section( "Service", Validator::SectionNameEquals, service_opts );
@@ -212,32 +266,64 @@ private:
 
             pool_opts->AddTest( "size",             ScaledUnsignedValue )
                      ->AddTest( "kernel-device",    Validator::OptionWithValue )
-                     ->AddTest( "kernel-refill",    UnsignedBase10Value );
+                     ->AddTest( "kernel-refill",    UnsignedBase10Value )
+                     ->AddTest( "kernel-credit-margin", UnsignedBase10Value )
+                     ->AddTest( "usb-bus-budget",   ScaledUnsignedValue )
+                     ->AddTest( "huge-pages",       Validator::OptionWithoutValue );
 
             m_validator->Section( "Pool", Validator::SectionNameEquals, pool_opts );
 
 
+            // [Pool:] section options
+            Validator::OptionList::Handle   named_pool_opts = new Validator::OptionList;
+
+            named_pool_opts->AddTest( "size",           ScaledUnsignedValue )
+                           ->AddTest( "kernel",         Validator::OptionWithoutValue )
+                           ->AddTest( "kernel-device",  Validator::OptionWithValue )
+                           ->AddTest( "kernel-refill",  UnsignedBase10Value )
+                           ->AddTest( "kernel-credit-margin", UnsignedBase10Value )
+                           ->AddTest( "udp-out",        Validator::OptionWithValue );
+
+            m_validator->Section( "Pool:", Validator::SectionNamePrefix, named_pool_opts );
+
+
             // [PoolGroup:] section options
             Validator::OptionList::Handle   poolgroup_opts = new Validator::OptionList;
 
-            poolgroup_opts->AddTest( "size",        ScaledUnsignedValue );
+            poolgroup_opts->AddTest( "size",        ScaledUnsignedValue )
+                          ->AddTest( "monitor",     Validator::OptionWithoutValue );
 
             m_validator->Section( "PoolGroup:", Validator::SectionNamePrefix, poolgroup_opts );
 
 
+            // [DRBG] section options
+            Validator::OptionList::Handle   drbg_opts = new Validator::OptionList;
+
+            drbg_opts->AddTest( "udp-out",          Validator::OptionWithValue )
+                     ->AddTest( "reseed-bytes",     ScaledUnsignedValue )
+                     ->AddTest( "reseed-time",      UnsignedBase10Value );
+
+            m_validator->Section( "DRBG", Validator::SectionNameEquals, drbg_opts );
+
+
             // [Devices] and [Device:] section options
             Validator::OptionList::Handle   device_opts = new Validator::OptionList;
 
             device_opts->AddTest( "bitrate",        ScaledFloatValue )
+                       ->AddTest( "auto-bitrate",   Validator::OptionWithValue )
                        ->AddTest( "latency",        UnsignedBase10Value )
                        ->AddTest( "fold",           UnsignedBase10Value )
+                       ->AddTest( "auto-fold",      Validator::OptionWithValue )
+                       ->AddTest( "condition",      Validator::OptionWithValue )
                        ->AddTest( "group",          UnsignedBase10Value )
+                       ->AddTest( "pool",           Validator::OptionWithValue )
                        ->AddTest( "enable-mask",    UnsignedValue )
                        ->AddTest( "idle-sleep",     Validator::OptionWithValue )
                        ->AddTest( "suspend-after",  ScaledUnsignedValue )
                        ->AddTest( "low-power",      Validator::OptionWithoutValue )
                        ->AddTest( "limit-max-xfer", Validator::OptionWithoutValue )
-                       ->AddTest( "no-qa",          Validator::OptionWithoutValue );
+                       ->AddTest( "no-qa",          Validator::OptionWithoutValue )
+                       ->AddTest( "standby",        Validator::OptionWithoutValue );
 
             m_validator->Section( "Devices", Validator::SectionNameEquals, device_opts );
             m_validator->Section( "Device:", Validator::SectionNamePrefix, device_opts );
@@ -252,6 +338,19 @@ private:
                       ->AddTest( "max-bytes",   ScaledUnsignedValue );
 
             m_validator->Section( "Watch:", Validator::SectionNamePrefix, watch_opts );
+
+
+            // [Remote:] section options
+            Validator::OptionList::Handle   remote_opts = new Validator::OptionList;
+
+            remote_opts->AddTest( "address",    Validator::OptionWithValue )
+                       ->AddTest( "group",      UnsignedBase10Value )
+                       ->AddTest( "pool",       Validator::OptionWithValue )
+                       ->AddTest( "prefetch",   UnsignedBase10Value )
+                       ->AddTest( "rate",       ScaledUnsignedValue )
+                       ->AddTest( "no-qa",      Validator::OptionWithoutValue );
+
+            m_validator->Section( "Remote:", Validator::SectionNamePrefix, remote_opts );
         }
 
         m_validator->Validate( *this );
@@ -286,6 +385,19 @@ private:
 
     } //}}}
 
+    // The kernel-credit-margin is a percentage of the measured entropy.
+    static unsigned credit_margin( const std::string &value )
+    { //{{{
+
+        unsigned    m = StrToU( value, 10 );
+
+        if( m > 100 )
+            throw Error( _("the margin must be from 0 to 100 percent") );
+
+        return m;
+
+    } //}}}
+
     // Implementation detail for extracting the per-device options from either
     // the global [Devices] section or an individual [Device:] definition (with
     // the global [Devices] options used as defaults for it unless overridden).
@@ -307,6 +419,10 @@ private:
             if( s->HasOption( opt ) )
                 bbo.bitrate = unsigned(StrToScaledD( s->GetOption(opt) ));
 
+            opt = "auto-bitrate";
+            if( s->HasOption( opt ) )
+                bbo.SetAutoBitrate( s->GetOption(opt) );
+
             opt = "latency";
             if( s->HasOption( opt ) )
                 bbo.latency = StrToU( s->GetOption(opt), 10 );
@@ -315,10 +431,22 @@ private:
             if( s->HasOption( opt ) )
                 bbo.fold = StrToU( s->GetOption(opt), 10 );
 
+            opt = "auto-fold";
+            if( s->HasOption( opt ) )
+                bbo.SetAutoFold( s->GetOption(opt) );
+
+            opt = "condition";
+            if( s->HasOption( opt ) )
+                bbo.condition = Conditioner::Ratio( s->GetOption(opt) );
+
             opt = "group";
             if( s->HasOption( opt ) )
                 bbo.group = StrToU( s->GetOption(opt), 10 );
 
+            opt = "pool";
+            if( s->HasOption( opt ) )
+                bbo.pool = s->GetOption(opt);
+
             opt = "enable-mask";
             if( s->HasOption( opt ) )
                 bbo.enable_mask = StrToU( s->GetOption(opt) );
@@ -338,6 +466,10 @@ private:
             if( s->HasOption( opt ) )
                 bbo.no_qa = true;
 
+            opt = "standby";
+            if( s->HasOption( opt ) )
+                bbo.standby = true;
+
             opt = "limit-max-xfer";
             if( s->HasOption( opt ) )
                 bbo.chunksize = 16384;
@@ -357,6 +489,60 @@ private:
     } //}}}
 
 
+    // Throw if a section assigns its sources to a pool which isn't defined.
+    void check_pool_name( const Section::Handle &s ) const
+    { //{{{
+
+        if( ! s->HasOption("pool") )
+            return;
+
+        std::string     name = s->GetOption("pool");
+
+        if( ! HasSection( "Pool:" + name ) )
+            throw Error( _("[%s] option 'pool': no [Pool:%s] section is defined"),
+                                            s->GetName().c_str(), name.c_str() );
+    } //}}}
+
+
+    // Return the next unused number for a section with the given prefix.
+    unsigned next_section_number( const std::string &prefix ) const
+    { //{{{
+
+        const Sections  &s    = GetSections( prefix );
+        unsigned         next = 0;
+
+        // If there are numbered sections, find the current largest number.
+        // If someone really uses a number larger than will fit in unsigned int,
+        // and mixes a config file with command line options, they'll get what
+        // it is that they did to themselves.  But unless they really have > 4G
+        // sections set, we will still probably find a safe number to use here
+        // even with some truncated value(s) in the mix.
+        //
+        // The alternative would be to just iterate next from 0 until we
+        // find the first value which isn't a collision, but this way is probably
+        // nicer since it orders all command line sections after any defined with
+        // numeric identifiers in the config file.
+        for( Sections::const_iterator i = s.begin(), e = s.end(); i != e; ++i )
+        {
+            try {
+                unsigned isnum = StrToU( i->first );
+
+                if( isnum >= next )
+                    next = isnum + 1;
+            }
+            catch( const std::exception& )
+            {
+                // It's not an error for section identifiers to not be a number,
+                // we just don't take those into account when generating one
+                // for a section specified on the command line.
+            }
+        }
+
+        return next;
+
+    } //}}}
+
+
 public:
 
     // We only need a trivial default constructor at present.
@@ -422,6 +608,14 @@ public:
                     p.kernel_refill_time = StrToU( s->GetOption(opt), 10 );
                 else
                     check_pool_low_power_option( p );
+
+                opt = "kernel-credit-margin";
+                if( s->HasOption( opt ) )
+                    p.kernel_credit_margin = credit_margin( s->GetOption(opt) );
+
+                opt = "usb-bus-budget";
+                if( s->HasOption( opt ) )
+                    p.usb_bus_budget = StrToScaledUL( s->GetOption(opt), 1024 );
             }
             else
             {
@@ -439,6 +633,77 @@ public:
 
     } //}}}
 
+    // Export the list of separately named pools, and the outputs for them.
+    // This will also check that every device or remote source which is to
+    // be added to a named pool refers to one which exists.
+    NamedPool::List GetNamedPoolOptions() const
+    { //{{{
+
+        const Sections     &s = GetSections("Pool:");
+        NamedPool::List     l;
+
+        for( Sections::const_iterator i = s.begin(),
+                                      e = s.end(); i != e; ++i )
+        {
+            NamedPool       np;
+            std::string     opt;
+
+            try {
+                if( i->first.empty() )
+                    throw Error( _("the pool name must not be empty") );
+
+                np.pool.name = i->first;
+
+                opt = "size";
+                if( i->second->HasOption( opt ) )
+                    np.pool.pool_size = StrToScaledUL( i->second->GetOption(opt), 1024 );
+
+                opt = "kernel-device";
+                if( i->second->HasOption( opt ) )
+                    np.pool.kernel_device = i->second->GetOption(opt);
+
+                opt = "kernel-refill";
+                if( i->second->HasOption( opt ) )
+                    np.pool.kernel_refill_time = StrToU( i->second->GetOption(opt), 10 );
+
+                opt = "kernel-credit-margin";
+                if( i->second->HasOption( opt ) )
+                    np.pool.kernel_credit_margin = credit_margin( i->second->GetOption(opt) );
+
+                opt = "kernel";
+                if( i->second->HasOption( opt ) )
+                    np.kernel = true;
+
+                opt = "udp-out";
+                if( i->second->HasOption( opt ) )
+                    np.udp_out = i->second->GetOption(opt);
+
+                l.push_back( np );
+            }
+            catch( const std::exception &e )
+            {
+                throw Error( _("Failed to apply [Pool:%s] option '%s': %s"),
+                                    i->first.c_str(), opt.c_str(), e.what() );
+            }
+        }
+
+        if( HasSection("Devices") )
+            check_pool_name( GetSection("Devices") );
+
+        const Sections     &d = GetSections("Device:");
+
+        for( Sections::const_iterator i = d.begin(), e = d.end(); i != e; ++i )
+            check_pool_name( i->second );
+
+        const Sections     &r = GetSections("Remote:");
+
+        for( Sections::const_iterator i = r.begin(), e = r.end(); i != e; ++i )
+            check_pool_name( i->second );
+
+        return l;
+
+    } //}}}
+
     // Export a list of defined entropy Pool groups.
     Pool::Group::Options::List GetPoolGroupOptions() const
     { //{{{
@@ -449,8 +714,13 @@ public:
         for( Sections::const_iterator i = s.begin(),
                                       e = s.end(); i != e; ++i )
         {
-            std::string     opt = i->first + ':' + GetOption(i->second, "size");
+            // A group which only sets the monitor option has the size of its pool.
+            std::string     size = HasOption(i->second, "size") ? GetOption(i->second, "size")
+                                                                : std::string("0");
+            std::string     opt  = i->first + ':' + size;
+
             g.push_back( Pool::Group::Options( opt.c_str() ) );
+            g.back().monitor = HasOption(i->second, "monitor");
         }
 
         return g;
@@ -458,6 +728,57 @@ public:
     } //}}}
 
 
+    // Set the [DRBG] reseed options from a --drbg-reseed=bytes:sec argument.
+    // Either of them may be omitted to leave it unchanged.
+    void SetDRBGReseed( const std::string &arg )
+    { //{{{
+
+        std::string     bytes = beforefirst( ':', arg );
+        std::string     secs  = afterfirst( ':', arg );
+
+        if( ! bytes.empty() )
+            AddOrUpdateOption( "DRBG", "reseed-bytes", bytes );
+
+        if( ! secs.empty() )
+            AddOrUpdateOption( "DRBG", "reseed-time", secs );
+
+    } //}}}
+
+    // Export the configuration for DRBG output.
+    DRBG::Options GetDRBGOptions() const
+    { //{{{
+
+        DRBG::Options   d;
+        std::string     opt;
+
+        try {
+            if( HasSection("DRBG") )
+            {
+                Section::Handle     s = GetSection("DRBG");
+
+                opt = "reseed-bytes";
+                if( s->HasOption( opt ) )
+                    d.reseed_bytes = StrToScaledUL( s->GetOption(opt), 1024 );
+
+                opt = "reseed-time";
+                if( s->HasOption( opt ) )
+                    d.reseed_time = StrToU( s->GetOption(opt), 10 );
+
+                if( d.reseed_bytes < 1 )
+                    throw Error( _("reseed-bytes must be at least 1") );
+            }
+        }
+        catch( const std::exception &e )
+        {
+            throw Error( _("Failed to apply [DRBG] option '%s': %s"),
+                                                opt.c_str(), e.what() );
+        }
+
+        return d;
+
+    } //}}}
+
+
     // Add a [Device:] definition for a --device-id passed on the command line.
     // And remember the last device added that way so that any subsequent
     // per-device options on the command line will be applied to it too.
@@ -520,44 +841,13 @@ public:
 
         using std::string;
 
-        const Sections  &s          = GetSections("Watch:");
-        unsigned         next_watch = 0;
-
-        // If there are numbered Watch sections, find the current largest number.
-        // If someone really uses a number larger than will fit in unsigned int,
-        // and mixes a config file with command line watches, they'll get what
-        // it is that they did to themselves.  But unless they really have > 4G
-        // watches set, we will still probably find a safe number to use here
-        // even with some truncated value(s) in the mix.
-        //
-        // The alternative would be to just iterate next_watch from 0 until we
-        // find the first value which isn't a collision, but this way is probably
-        // nicer since it orders all command line watches after any defined with
-        // numeric identifiers in the config file.
-        for( Sections::const_iterator i = s.begin(), e = s.end(); i != e; ++i )
-        {
-            try {
-                unsigned isnum = StrToU( i->first );
-
-                if( isnum >= next_watch )
-                    next_watch = isnum + 1;
-            }
-            catch( const std::exception& )
-            {
-                // It's not an error for Watch identifiers to not be a number,
-                // we just don't take those into account when generating one
-                // for a watch specified on the command line.
-
-                //Log<0>( "AddWatch: '%s' is not a number\n", i->first.c_str() );
-            }
-        }
-
-        //Log<0>( "Next watch is %u\n", n );
+        unsigned    next_watch = next_section_number( "Watch:" );
 
 
         // Parse the options struct from a string of the form:
         // path:delay:block_size:total_bytes
         // where everything except the path portion is optional.
+        // The path may also be a udp:host:port or tcp:host:port address.
         //
         // This is similar to what is done in SecretSink::Options::ParseOptArg()
         // except we don't normalise the numeric values here, we just keep them
@@ -565,9 +855,14 @@ public:
         // They'll get converted to numeric types when actually used.
 
         Section::Handle sect = AddSection( stringprintf("Watch:%u", next_watch) );
-        size_t          n    = arg.find(':');
+        size_t          n    = SocketReader::SocketAddrLen( arg );
         size_t          n2;
 
+        if( n == 0 )
+            n = arg.find(':');
+        else if( n == arg.size() )
+            n = string::npos;
+
         if( n == string::npos )
         {
             AddOption( sect, "path", arg );
@@ -650,6 +945,100 @@ public:
     } //}}}
 
 
+    // Add a new [Remote:] definition for an address passed on the command line.
+    void AddRemote( const std::string &addr )
+    {
+        AddOption( AddSection( stringprintf("Remote:%u", next_section_number("Remote:")) ),
+                   "address", addr );
+    }
+
+    // Export a list of the Remote sources to draw entropy from.
+    RemoteSource::Options::List GetRemoteOptions() const
+    { //{{{
+
+        const Sections                     &s = GetSections("Remote:");
+        RemoteSource::Options::List   r;
+
+        for( Sections::const_iterator i = s.begin(),
+                                      e = s.end(); i != e; ++i )
+        {
+            std::string     opt;
+
+            try {
+                RemoteSource::Options     rso;
+
+                opt = "address";
+                if( i->second->HasOption( opt ) )
+                    rso.addr = i->second->GetOption( opt );
+                else
+                    throw Error( _("No address defined for Remote") );
+
+                if( ! SocketReader::IsSocketAddr( rso.addr ) )
+                    throw Error( _("Remote address '%s' is not udp:host:port or tcp:host:port"),
+                                                                            rso.addr.c_str() );
+                opt = "group";
+                if( i->second->HasOption( opt ) )
+                    rso.group = StrToU( i->second->GetOption( opt ), 10 );
+
+                opt = "pool";
+                if( i->second->HasOption( opt ) )
+                    rso.pool = i->second->GetOption( opt );
+
+                opt = "prefetch";
+                if( i->second->HasOption( opt ) )
+                    rso.prefetch = StrToU( i->second->GetOption( opt ), 10 );
+
+                opt = "rate";
+                if( i->second->HasOption( opt ) )
+                    rso.rate = StrToScaledUL( i->second->GetOption( opt ) );
+
+                opt = "no-qa";
+                if( i->second->HasOption( opt ) )
+                    rso.no_qa = true;
+
+                r.push_back( rso );
+            }
+            catch( const std::exception &e )
+            {
+                throw Error( _("Failed to apply [Remote:%s] option '%s': %s"),
+                                    i->first.c_str(), opt.c_str(), e.what() );
+            }
+        }
+
+        return r;
+
+    } //}}}
+
+
+    // Return the options in all of the sections with names that begin with
+    // prefix, in a form where they can be compared with those of some other
+    // configuration to see if they were changed.
+    std::string SectionsStr( const std::string &prefix ) const
+    { //{{{
+
+        std::string     out;
+        Sections        s = GetSections( prefix );
+
+        for( Sections::iterator i = s.begin(), e = s.end(); i != e; ++i )
+            out.append( i->second->INIStr() + '\n' );
+
+        return out;
+
+    } //}}}
+
+    // Return the value of option in section, prefixed by '=' if it is set,
+    // so that an option with no value can be told apart from an unset one.
+    std::string OptionStr( const std::string &section, const std::string &option ) const
+    { //{{{
+
+        if( ! HasOption( section, option ) )
+            return std::string();
+
+        return '=' + GetOption( section, option );
+
+    } //}}}
+
+
     // Specialisation of IniData::INIStr() to output the expected sections in
     // a logical (for users) and deterministic (if using a hashed map) order.
     // This string may be saved and later passed to ImportFile() or Decode()
@@ -676,6 +1065,14 @@ public:
             s.erase( i );
         }
 
+        // Output the named Pool section(s)
+        ss = GetSections("Pool:");
+        for( i = ss.begin(), e = ss.end(); i != e; ++i )
+        {
+            out.append( i->second->INIStr() + '\n' );
+            s.erase( i->second->GetName() );
+        }
+
         // Output the PoolGroup section(s)
         ss = GetSections("PoolGroup:");
         for( i = ss.begin(), e = ss.end(); i != e; ++i )
@@ -684,6 +1081,14 @@ public:
             s.erase( i->second->GetName() );
         }
 
+        // Output the DRBG section
+        i = s.find("DRBG");
+        if( i != s.end() )
+        {
+            out.append( i->second->INIStr() + '\n' );
+            s.erase( i );
+        }
+
         // Output the Devices section
         i = s.find("Devices");
         if( i != s.end() )
@@ -700,6 +1105,14 @@ public:
             s.erase( i->second->GetName() );
         }
 
+        // Output the Remote section(s)
+        ss = GetSections("Remote:");
+        for( i = ss.begin(), e = ss.end(); i != e; ++i )
+        {
+            out.append( i->second->INIStr() + '\n' );
+            s.erase( i->second->GetName() );
+        }
+
         // Output the Watch section(s)
         ss = GetSections("Watch:");
         for( i = ss.begin(), e = ss.end(); i != e; ++i )
@@ -719,33 +1132,90 @@ public:
 }; //}}}
 
 
-int main( int argc, char *argv[] )
-{
-  try {
+// The options which were passed on the command line.
+struct CmdLine
+{ //{{{
 
-    Config                      conf;
-    unsigned                    opt_scan        = 0;
-    size_t                      opt_bytes       = 0;
-    unsigned                    opt_stdout      = 0;
-    int                         opt_v           = 0;
-    bool                        opt_genconf     = false;
+    Config          conf;
+    unsigned        scan;
+    size_t          bytes;
+    unsigned        to_stdout;
+    bool            drbg_stdout;
+    int             verbose;
+    bool            genconf;
+    const char     *simulate;
+    unsigned        emulate;
+
+    // The directory that relative config file paths are resolved against.
+    // We will have changed to / if we daemonised, so this must be captured
+    // before that for a reload to find the same files again.
+    std::string     cwd;
+
+
+    CmdLine()
+        : scan( 0 )
+        , bytes( 0 )
+        , to_stdout( 0 )
+        , drbg_stdout( false )
+        , verbose( 0 )
+        , genconf( false )
+        , simulate( NULL )
+        , emulate( 0 )
+    {}
+
+
+    std::string AbsolutePath( const char *path ) const
+    {
+        if( cwd.empty() || path[0] == '/' )
+            return path;
+
+        return cwd + '/' + path;
+    }
+
+}; //}}}
+
+
+// Parse the command line options (and any config files they name) into cmd.
+// This is also used to rebuild the configuration when we are asked to reload
+// it, so it may be called more than once with the same arguments.  Returns -1
+// if we should carry on running, else the status that we should exit with.
+static int ParseCmdLine( int argc, char *argv[], CmdLine &cmd )
+{ //{{{
 
     enum
     {
         SHELL_MR_OPT,
         FREEBIND_OPT,
         SOCKET_GROUP_OPT,
+        SHM_STATS_OPT,
+        SHM_STATS_INTERVAL_OPT,
         KERNEL_DEVICE_OPT,
         KERNEL_REFILL_TIME_OPT,
+        KERNEL_CREDIT_MARGIN_OPT,
+        USB_BUS_BUDGET_OPT,
+        HUGE_PAGES_OPT,
+        GROUP_MONITOR_OPT,
+        NAMED_POOL_OPT,
+        POOL_OPT,
+        AUTO_BITRATE_OPT,
         LATENCY_OPT,
+        AUTO_FOLD_OPT,
+        CONDITION_OPT,
         ENABLEMASK_OPT,
         IDLE_SLEEP_OPT,
         SUSPEND_AFTER_OPT,
         LOW_POWER_OPT,
         LIMIT_MAX_XFER,
         NOQA_OPT,
+        STANDBY_OPT,
+        REMOTE_OPT,
+        DRBG_UDP_OUT_OPT,
+        DRBG_STDOUT_OPT,
+        DRBG_RESEED_OPT,
         WATCH_OPT,
         GENERATE_CONFIG_OPT,
+        SIMULATE_OPT,
+        EMULATE_OPT,
         VERSION_OPT
     };
 
@@ -763,26 +1233,44 @@ int main( int argc, char *argv[] )
         { "udp-out",        required_argument,  NULL,      'u' },
         { "control-socket", required_argument,  NULL,      'c' },
         { "socket-group",   required_argument,  NULL,      SOCKET_GROUP_OPT },
+        { "shm-stats",      required_argument,  NULL,      SHM_STATS_OPT },
+        { "shm-stats-interval", required_argument, NULL,   SHM_STATS_INTERVAL_OPT },
 
         { "pool-size",      required_argument,  NULL,      'P' },
         { "kernel-device",  required_argument,  NULL,      KERNEL_DEVICE_OPT },
         { "kernel-refill",  required_argument,  NULL,      KERNEL_REFILL_TIME_OPT },
+        { "kernel-credit-margin", required_argument, NULL, KERNEL_CREDIT_MARGIN_OPT },
+        { "usb-bus-budget", required_argument,  NULL,      USB_BUS_BUDGET_OPT },
+        { "huge-pages",     no_argument,        NULL,      HUGE_PAGES_OPT },
         { "group-size",     required_argument,  NULL,      'G' },
+        { "group-monitor",  required_argument,  NULL,      GROUP_MONITOR_OPT },
+        { "named-pool",     required_argument,  NULL,      NAMED_POOL_OPT },
 
         { "bitrate",        required_argument,  NULL,      'r' },
+        { "auto-bitrate",   required_argument,  NULL,      AUTO_BITRATE_OPT },
         { "latency",        required_argument,  NULL,      LATENCY_OPT },
         { "fold",           required_argument,  NULL,      'f' },
+        { "auto-fold",      required_argument,  NULL,      AUTO_FOLD_OPT },
+        { "condition",      required_argument,  NULL,      CONDITION_OPT },
         { "group",          required_argument,  NULL,      'g' },
+        { "pool",           required_argument,  NULL,      POOL_OPT },
         { "enable-mask",    required_argument,  NULL,      ENABLEMASK_OPT },
         { "idle-sleep",     required_argument,  NULL,      IDLE_SLEEP_OPT },
         { "suspend-after",  required_argument,  NULL,      SUSPEND_AFTER_OPT },
         { "low-power",      no_argument,        NULL,      LOW_POWER_OPT },
         { "limit-max-xfer", no_argument,        NULL,      LIMIT_MAX_XFER },
         { "no-qa",          no_argument,        NULL,      NOQA_OPT },
+        { "standby",        no_argument,        NULL,      STANDBY_OPT },
 
+        { "remote",         required_argument,  NULL,      REMOTE_OPT },
+        { "drbg-udp-out",   required_argument,  NULL,      DRBG_UDP_OUT_OPT },
+        { "drbg-stdout",    no_argument,        NULL,      DRBG_STDOUT_OPT },
+        { "drbg-reseed",    required_argument,  NULL,      DRBG_RESEED_OPT },
         { "watch",          required_argument,  NULL,      WATCH_OPT },
 
         { "gen-conf",       no_argument,        NULL,      GENERATE_CONFIG_OPT },
+        { "simulate",       required_argument,  NULL,      SIMULATE_OPT },
+        { "emulate",        required_argument,  NULL,      EMULATE_OPT },
         { "verbose",        no_argument,        NULL,      'v' },
         { "help",           no_argument,        NULL,      '?' },
         { "version",        no_argument,        NULL,      VERSION_OPT },
@@ -791,6 +1279,15 @@ int main( int argc, char *argv[] )
 
     int opt_index = 0;
 
+    // Make sure getopt starts from the first argument again if this isn't
+    // the first time we've been called.
+   #ifdef __GLIBC__
+    optind   = 0;
+   #else
+    optreset = 1;
+    optind   = 1;
+   #endif
+
     for(;;)
     { //{{{
 
@@ -802,123 +1299,205 @@ int main( int argc, char *argv[] )
         switch(c)
         {
             case 's':
-                opt_scan = 1;
+                cmd.scan = 1;
                 break;
 
             case SHELL_MR_OPT:
-                opt_scan = 2;
+                cmd.scan = 2;
                 break;
 
             case 'C':
-                conf.ImportFile( optarg );
+                cmd.conf.ImportFile( cmd.AbsolutePath( optarg ).c_str() );
                 break;
 
             case 'i':
-                conf.AddDevice( optarg );
+                cmd.conf.AddDevice( optarg );
                 break;
 
             case 'b':
-                opt_bytes = StrToScaledUL( optarg, 1024 );
+                cmd.bytes = StrToScaledUL( optarg, 1024 );
                 break;
 
             case 'o':
-                opt_stdout = 1;
+                cmd.to_stdout = 1;
                 break;
 
             case 'd':
-                conf.AddOrUpdateOption( "Service", "daemon" );
+                cmd.conf.AddOrUpdateOption( "Service", "daemon" );
                 break;
 
             case 'k':
-                conf.AddOrUpdateOption( "Service", "kernel" );
+                cmd.conf.AddOrUpdateOption( "Service", "kernel" );
                 break;
 
             case FREEBIND_OPT:
-                conf.AddOrUpdateOption( "Service", "ip-freebind" );
+                cmd.conf.AddOrUpdateOption( "Service", "ip-freebind" );
                 break;
 
             case 'u':
-                conf.AddOrUpdateOption( "Service", "udp-out", optarg );
+                cmd.conf.AddOrUpdateOption( "Service", "udp-out", optarg );
                 break;
 
             case 'c':
-                conf.AddOrUpdateOption( "Service", "control-socket", optarg );
+                cmd.conf.AddOrUpdateOption( "Service", "control-socket", optarg );
                 break;
 
             case SOCKET_GROUP_OPT:
-                conf.AddOrUpdateOption( "Service", "socket-group", optarg );
+                cmd.conf.AddOrUpdateOption( "Service", "socket-group", optarg );
+                break;
+
+            case SHM_STATS_OPT:
+                cmd.conf.AddOrUpdateOption( "Service", "shm-stats", optarg );
+                break;
+
+            case SHM_STATS_INTERVAL_OPT:
+                cmd.conf.AddOrUpdateOption( "Service", "shm-stats-interval", optarg );
                 break;
 
             case 'P':
-                conf.AddOrUpdateOption( "Pool", "size", optarg );
+                cmd.conf.AddOrUpdateOption( "Pool", "size", optarg );
                 break;
 
             case KERNEL_DEVICE_OPT:
-                conf.AddOrUpdateOption( "Pool", "kernel-device", optarg );
+                cmd.conf.AddOrUpdateOption( "Pool", "kernel-device", optarg );
                 break;
 
             case KERNEL_REFILL_TIME_OPT:
-                conf.AddOrUpdateOption( "Pool", "kernel-refill", optarg );
+                cmd.conf.AddOrUpdateOption( "Pool", "kernel-refill", optarg );
+                break;
+
+            case KERNEL_CREDIT_MARGIN_OPT:
+                cmd.conf.AddOrUpdateOption( "Pool", "kernel-credit-margin", optarg );
+                break;
+
+            case USB_BUS_BUDGET_OPT:
+                cmd.conf.AddOrUpdateOption( "Pool", "usb-bus-budget", optarg );
+                break;
+
+            case HUGE_PAGES_OPT:
+                cmd.conf.AddOrUpdateOption( "Pool", "huge-pages" );
                 break;
 
             case 'G':
             {
                 std::string     s( optarg );
-                conf.AddOrUpdateOption( "PoolGroup:" + beforefirst(':', s),
+                cmd.conf.AddOrUpdateOption( "PoolGroup:" + beforefirst(':', s),
                                         "size", afterfirst(':', s) );
                 break;
             }
 
+            case GROUP_MONITOR_OPT:
+                cmd.conf.AddOrUpdateOption( std::string("PoolGroup:") + optarg, "monitor" );
+                break;
+
+            case NAMED_POOL_OPT:
+            {
+                std::string     s( optarg );
+                std::string     section = "Pool:" + beforefirst(':', s);
+                std::string     size    = afterfirst(':', s);
+
+                if( ! size.empty() )
+                    cmd.conf.AddOrUpdateOption( section, "size", size );
+                else if( ! cmd.conf.HasSection( section ) )
+                    cmd.conf.AddSection( section );
+                break;
+            }
+
             case 'r':
-                conf.SetDeviceOption( "bitrate", optarg );
+                cmd.conf.SetDeviceOption( "bitrate", optarg );
                 break;
 
             case LATENCY_OPT:
-                conf.SetDeviceOption( "latency", optarg );
+                cmd.conf.SetDeviceOption( "latency", optarg );
                 break;
 
             case 'f':
-                conf.SetDeviceOption( "fold", optarg );
+                cmd.conf.SetDeviceOption( "fold", optarg );
+                break;
+
+            case AUTO_BITRATE_OPT:
+                cmd.conf.SetDeviceOption( "auto-bitrate", optarg );
+                break;
+
+            case AUTO_FOLD_OPT:
+                cmd.conf.SetDeviceOption( "auto-fold", optarg );
+                break;
+
+            case CONDITION_OPT:
+                cmd.conf.SetDeviceOption( "condition", optarg );
                 break;
 
             case 'g':
-                conf.SetDeviceOption( "group", optarg );
+                cmd.conf.SetDeviceOption( "group", optarg );
+                break;
+
+            case POOL_OPT:
+                cmd.conf.SetDeviceOption( "pool", optarg );
                 break;
 
             case ENABLEMASK_OPT:
-                conf.SetDeviceOption( "enable-mask", optarg );
+                cmd.conf.SetDeviceOption( "enable-mask", optarg );
                 break;
 
             case IDLE_SLEEP_OPT:
-                conf.SetDeviceOption( "idle-sleep", optarg );
+                cmd.conf.SetDeviceOption( "idle-sleep", optarg );
                 break;
 
             case SUSPEND_AFTER_OPT:
-                conf.SetDeviceOption( "suspend-after", optarg );
+                cmd.conf.SetDeviceOption( "suspend-after", optarg );
                 break;
 
             case LOW_POWER_OPT:
-                conf.SetDeviceOption( "low-power" );
+                cmd.conf.SetDeviceOption( "low-power" );
                 break;
 
             case LIMIT_MAX_XFER:
-                conf.SetDeviceOption( "limit-max-xfer" );
+                cmd.conf.SetDeviceOption( "limit-max-xfer" );
                 break;
 
             case NOQA_OPT:
-                conf.SetDeviceOption( "no-qa" );
+                cmd.conf.SetDeviceOption( "no-qa" );
+                break;
+
+            case STANDBY_OPT:
+                cmd.conf.SetDeviceOption( "standby" );
+                break;
+
+            case REMOTE_OPT:
+                cmd.conf.AddRemote( optarg );
+                break;
+
+            case DRBG_UDP_OUT_OPT:
+                cmd.conf.AddOrUpdateOption( "DRBG", "udp-out", optarg );
+                break;
+
+            case DRBG_STDOUT_OPT:
+                cmd.drbg_stdout = true;
+                cmd.to_stdout   = 1;
+                break;
+
+            case DRBG_RESEED_OPT:
+                cmd.conf.SetDRBGReseed( optarg );
                 break;
 
             case WATCH_OPT:
-                conf.AddWatch( optarg );
+                cmd.conf.AddWatch( optarg );
                 break;
 
             case GENERATE_CONFIG_OPT:
-                opt_genconf = true;
+                cmd.genconf = true;
+                break;
+
+            case SIMULATE_OPT:
+                cmd.simulate = optarg;
+                break;
+
+            case EMULATE_OPT:
+                cmd.emulate = StrToU( optarg, 10 );
                 break;
 
             case 'v':
-                ++opt_v;
+                ++cmd.verbose;
                 break;
 
             case '?':
@@ -931,7 +1510,7 @@ int main( int argc, char *argv[] )
 
                 // If we're generating a config, don't dump the usage to stdout
                 // under any circumstances and do return an EXIT_FAILURE code.
-                if( opt_genconf )
+                if( cmd.genconf )
                 {
                     fprintf(stderr, "%s: invalid option used, not generating config\n",
                                                                             argv[0]);
@@ -953,13 +1532,399 @@ int main( int argc, char *argv[] )
 
     } //}}}
 
-
-    std::string     notify_socket = BitB::GetSystemdNotifySocket();
-
     // If we've been started by systemd in notify mode we need to stay in the
     // foreground regardless of what config options we may have been passed.
-    if( ! notify_socket.empty() )
-        conf.RemoveOption( "Service", "daemon" );
+    if( ! BitB::GetSystemdNotifySocket().empty() )
+        cmd.conf.RemoveOption( "Service", "daemon" );
+
+    return -1;
+
+} //}}}
+
+// Emulated devices output no entropy at all, so their output must never be
+// fed to the kernel, or served to anything but other processes on this host.
+static bool IsLocalOnly( const std::string &addr )
+{ //{{{
+
+    SockAddr    sa( addr );
+
+    sa.GetAddrInfo( SOCK_DGRAM, AI_ADDRCONFIG | AI_PASSIVE );
+    return sa.IsLoopback();
+
+} //}}}
+
+// Throw if the configuration would use emulated devices for any output
+// other than stdout, the control socket, or a loopback udp-out socket.
+static void CheckEmulatedOutputs( const CmdLine &cmd )
+{ //{{{
+
+    if( ! cmd.emulate )
+        return;
+
+    const Config   &conf = cmd.conf;
+
+    if( conf.HasOption("Service", "kernel") )
+        throw Error( _("--emulate can't be used with --kernel") );
+
+    if( conf.HasOption("Service", "udp-out")
+     && ! IsLocalOnly( conf.GetOption("Service", "udp-out") ) )
+        throw Error( _("--emulate can only be used with a loopback udp-out address") );
+
+    if( conf.HasOption("DRBG", "udp-out")
+     && ! IsLocalOnly( conf.GetOption("DRBG", "udp-out") ) )
+        throw Error( _("--emulate can only be used with a loopback DRBG udp-out address") );
+
+    NamedPool::List named = conf.GetNamedPoolOptions();
+
+    for( NamedPool::List::iterator i = named.begin(), e = named.end(); i != e; ++i )
+    {
+        if( i->kernel )
+            throw Error( _("--emulate can't be used with the kernel output of Pool '%s'"),
+                                                                i->pool.name.c_str() );
+        if( ! i->udp_out.empty() && ! IsLocalOnly( i->udp_out ) )
+            throw Error( _("--emulate can only be used with a loopback udp-out address"
+                           " for Pool '%s'"), i->pool.name.c_str() );
+    }
+
+} //}}}
+
+
+// The parts of the running configuration which can be changed without
+// needing to restart seedd, when it is asked to reload it with SIGHUP or
+// with a Reload request to its control socket.
+class LiveConfig
+{ //{{{
+private:
+
+    typedef std::map< std::string, std::string >    Snapshot;
+    typedef std::list< std::string >                StringList;
+
+    int                         m_argc;
+    char                      **m_argv;
+    std::string                 m_cwd;
+    bool                        m_verbose_override;
+
+    Pool::Handle                m_pool;
+    BitB::Devices              &m_devices;
+    SocketSource::Handle        m_ssrc;
+    SocketSource::Handle        m_drbg_ssrc;
+
+    Snapshot                    m_snapshot;
+    Pool::Group::Options::List  m_groups;
+
+    pthread_mutex_t             m_mutex;
+
+
+    // Capture the state of the options which can't be compared after they
+    // are extracted, or which can't be changed without restarting.
+    static Snapshot snapshot( const Config &conf )
+    { //{{{
+
+        Snapshot    s;
+        std::string freebind = conf.OptionStr( "Service", "ip-freebind" );
+
+        s["verbose"]        = conf.OptionStr( "Service", "verbose" );
+        s["udp-out"]        = conf.OptionStr( "Service", "udp-out" ) + freebind;
+        s["drbg-udp-out"]   = conf.SectionsStr( "DRBG" ) + freebind;
+
+        // Changing any of these requires a restart.
+        s["control-socket"] = conf.OptionStr( "Service", "control-socket" );
+        s["socket-group"]   = conf.OptionStr( "Service", "socket-group" );
+        s["shm-stats"]      = conf.OptionStr( "Service", "shm-stats" )
+                            + conf.OptionStr( "Service", "shm-stats-interval" );
+        s["daemon"]         = conf.OptionStr( "Service", "daemon" );
+        s["kernel"]         = conf.OptionStr( "Service", "kernel" );
+        s["kernel-device"]  = conf.OptionStr( "Pool", "kernel-device" );
+        s["huge-pages"]     = conf.OptionStr( "Pool", "huge-pages" );
+        s["remote"]         = conf.SectionsStr( "Remote:" );
+        s["named-pools"]    = conf.SectionsStr( "Pool:" );
+        s["watch"]          = conf.SectionsStr( "Watch:" );
+
+        return s;
+
+    } //}}}
+
+    bool changed( const Snapshot &s, const char *name ) const
+    {
+        return s.find( name )->second != m_snapshot.find( name )->second;
+    }
+
+    static std::string json_list( const StringList &l )
+    { //{{{
+
+        std::string     out( "[" );
+
+        for( StringList::const_iterator i = l.begin(), e = l.end(); i != e; ++i )
+        {
+            if( i != l.begin() )
+                out.append( 1, ',' );
+
+            out.append( '"' + BitB::Json::Escape( *i ) + '"' );
+        }
+
+        return out + ']';
+
+    } //}}}
+
+
+    // The old socket needs to be closed before we can bind the new one,
+    // since it's fairly likely that only some option other than the
+    // address it is bound to was changed.
+    void start_udp_out( const Config &conf )
+    { //{{{
+
+        m_ssrc = NULL;
+
+        if( conf.HasOption("Service", "udp-out") )
+            m_ssrc = new SocketSource( m_pool, conf.GetOption("Service", "udp-out"),
+                                               conf.HasOption("Service", "ip-freebind") );
+    } //}}}
+
+    void start_drbg_udp_out( const Config &conf )
+    { //{{{
+
+        m_drbg_ssrc = NULL;
+
+        if( conf.HasOption("DRBG", "udp-out") )
+            m_drbg_ssrc = new SocketSource( m_pool, conf.GetOption("DRBG", "udp-out"),
+                                                    conf.GetDRBGOptions(),
+                                                    conf.HasOption("Service", "ip-freebind") );
+    } //}}}
+
+
+public:
+
+    LiveConfig( int argc, char *argv[], const CmdLine &cmd,
+                const Pool::Handle &pool, BitB::Devices &devices )
+        : m_argc( argc )
+        , m_argv( argv )
+        , m_cwd( cmd.cwd )
+        , m_verbose_override( cmd.verbose != 0 )
+        , m_pool( pool )
+        , m_devices( devices )
+        , m_snapshot( snapshot( cmd.conf ) )
+        , m_groups( cmd.conf.GetPoolGroupOptions() )
+    { //{{{
+
+        start_udp_out( cmd.conf );
+        start_drbg_udp_out( cmd.conf );
+
+        pthread_mutex_init( &m_mutex, NULL );
+
+    } //}}}
+
+    ~LiveConfig()
+    {
+        pthread_mutex_destroy( &m_mutex );
+    }
+
+
+    // Read the configuration again and apply whatever was changed in it.
+    // This will throw without changing anything if the new configuration
+    // isn't valid.  Otherwise it returns a JSON object listing what was
+    // changed, what couldn't be changed without a restart, and what
+    // failed to be applied.
+    std::string Reload()
+    { //{{{
+
+        BitB::ScopedMutex   lock( &m_mutex );
+        CmdLine             cmd;
+
+        cmd.cwd = m_cwd;
+
+        if( ParseCmdLine( m_argc, m_argv, cmd ) != -1 )
+            throw Error( _("Reload: invalid command line options") );
+
+        CheckEmulatedOutputs( cmd );
+
+        const Config   &conf = cmd.conf;
+
+        Log<2>( "Reloading configuration:\n%s", conf.ConfigStr().c_str() );
+
+        // Extract everything we might use first, so that if any of it is
+        // invalid we can bail out before changing anything at all.
+        Pool::Options               pool_options    = conf.GetPoolOptions();
+        Pool::Group::Options::List  group_options   = conf.GetPoolGroupOptions();
+        BitBabbler::Options         default_options = conf.GetDefaultDeviceOptions();
+        BitBabbler::Options::List   device_options  = conf.GetDeviceOptions();
+        Snapshot                    snap            = snapshot( conf );
+
+        conf.GetNamedPoolOptions();
+        conf.GetDRBGOptions();
+        conf.GetRemoteOptions();
+        conf.GetWatchOptions();
+
+        StringList      done, restart, failed;
+
+
+        if( ! m_verbose_override && changed( snap, "verbose" ) )
+        {
+            BitB::opt_verbose = int(StrToU( conf.GetOption("Service", "verbose", "0") ));
+            done.push_back( "verbose" );
+        }
+
+        if( pool_options.pool_size != m_pool->GetSize() )
+        {
+            try {
+                m_pool->Resize( pool_options.pool_size );
+                done.push_back( "pool-size" );
+            }
+            BB_CATCH_ALL( 0, _("Reload: failed to resize pool"),
+                          failed.push_back( "pool-size" ); )
+        }
+
+        if( pool_options.kernel_refill_time != m_pool->GetKernelRefillTime() )
+        {
+            m_pool->SetKernelRefillTime( pool_options.kernel_refill_time );
+            done.push_back( "kernel-refill" );
+        }
+
+        if( pool_options.kernel_credit_margin != m_pool->GetKernelCreditMargin() )
+        {
+            m_pool->SetKernelCreditMargin( pool_options.kernel_credit_margin );
+            done.push_back( "kernel-credit-margin" );
+        }
+
+        if( pool_options.usb_bus_budget != m_pool->GetBusScheduler()->GetBudget() )
+        {
+            m_pool->GetBusScheduler()->SetBudget( pool_options.usb_bus_budget );
+            done.push_back( "usb-bus-budget" );
+        }
+
+        // New groups can be added, but existing ones can't be changed while
+        // they might have sources using them.
+        for( Pool::Group::Options::List::iterator i = group_options.begin(),
+                                                  e = group_options.end(); i != e; ++i )
+        {
+            std::string                             name = stringprintf( "group-size:%u",
+                                                                         i->groupid );
+            Pool::Group::Options::List::iterator    g    = m_groups.begin(),
+                                                    ge   = m_groups.end();
+
+            while( g != ge && g->groupid != i->groupid )
+                ++g;
+
+            if( g != ge )
+            {
+                if( g->size != i->size || g->monitor != i->monitor )
+                    restart.push_back( name );
+                continue;
+            }
+
+            try {
+                m_pool->AddGroup( i->groupid, i->size, i->monitor );
+                done.push_back( name );
+            }
+            BB_CATCH_ALL( 0, _("Reload: failed to add pool group"),
+                          restart.push_back( name ); )
+        }
+
+        for( Pool::Group::Options::List::iterator g = m_groups.begin(),
+                                                  ge = m_groups.end(); g != ge; ++g )
+        {
+            Pool::Group::Options::List::iterator    i = group_options.begin(),
+                                                    e = group_options.end();
+            while( i != e && i->groupid != g->groupid )
+                ++i;
+
+            if( i == e )
+                restart.push_back( stringprintf( "group-size:%u", g->groupid ) );
+        }
+
+        // This will only restart the sources for devices which have changed.
+        unsigned    ndev = m_devices.ReconfigureDevices( default_options, device_options );
+
+        if( ndev )
+            done.push_back( stringprintf( "devices:%u", ndev ) );
+
+        if( changed( snap, "udp-out" ) )
+        {
+            try {
+                start_udp_out( conf );
+                done.push_back( "udp-out" );
+            }
+            BB_CATCH_ALL( 0, _("Reload: failed to start udp-out"),
+                          failed.push_back( "udp-out" ); )
+        }
+
+        if( changed( snap, "drbg-udp-out" ) )
+        {
+            try {
+                start_drbg_udp_out( conf );
+                done.push_back( "drbg-udp-out" );
+            }
+            BB_CATCH_ALL( 0, _("Reload: failed to start DRBG udp-out"),
+                          failed.push_back( "drbg-udp-out" ); )
+        }
+
+        for( Snapshot::iterator i = snap.begin(), e = snap.end(); i != e; ++i )
+        {
+            if( i->first == "verbose" || i->first == "udp-out" || i->first == "drbg-udp-out" )
+                continue;
+
+            if( changed( snap, i->first.c_str() ) )
+                restart.push_back( i->first );
+        }
+
+        m_snapshot = snap;
+        m_groups   = group_options;
+
+
+        for( StringList::iterator i = done.begin(), e = done.end(); i != e; ++i )
+            Log<1>( _("Reload: applied new %s\n"), i->c_str() );
+
+        for( StringList::iterator i = restart.begin(), e = restart.end(); i != e; ++i )
+            Log<0>( _("Reload: changing %s requires a restart\n"), i->c_str() );
+
+        Log<0>( _("Reloaded configuration: %zu changes applied, %zu need a restart, "
+                  "%zu failed\n"), done.size(), restart.size(), failed.size() );
+
+        return "{\"Changed\":"         + json_list( done )
+             + ",\"RestartRequired\":" + json_list( restart )
+             + ",\"Failed\":"          + json_list( failed ) + '}';
+
+    } //}}}
+
+    static std::string ReloadHandler( void *p )
+    {
+        return static_cast<LiveConfig*>( p )->Reload();
+    }
+
+}; //}}}
+
+
+int main( int argc, char *argv[] )
+{
+  try {
+
+    CmdLine     cmd;
+
+   #if EM_PLATFORM_POSIX
+    {
+        char    cwd[PATH_MAX];
+
+        if( getcwd( cwd, sizeof(cwd) ) )
+            cmd.cwd = cwd;
+    }
+   #endif
+
+    int         ret = ParseCmdLine( argc, argv, cmd );
+
+    if( ret != -1 )
+        return ret;
+
+    Config                     &conf            = cmd.conf;
+    unsigned                    opt_scan        = cmd.scan;
+    size_t                      opt_bytes       = cmd.bytes;
+    unsigned                    opt_stdout      = cmd.to_stdout;
+    bool                        opt_drbg_stdout = cmd.drbg_stdout;
+    int                         opt_v           = cmd.verbose;
+    bool                        opt_genconf     = cmd.genconf;
+    const char                 *opt_simulate    = cmd.simulate;
+    unsigned                    opt_emulate     = cmd.emulate;
+
+
+    std::string     notify_socket = BitB::GetSystemdNotifySocket();
 
 
     // Just output a configuration file (based on the options passed) and exit.
@@ -1002,15 +1967,31 @@ int main( int argc, char *argv[] )
 
     Log<2>( "Using configuration:\n%s", conf.ConfigStr().c_str() );
 
+    CheckEmulatedOutputs( cmd );
+
     // Extract and (initially) sanity check these before going to
     // the background if we're going to be running this as a daemon.
     Pool::Options               pool_options    = conf.GetPoolOptions();
     Pool::Group::Options::List  group_options   = conf.GetPoolGroupOptions();
+    NamedPool::List             named_options   = conf.GetNamedPoolOptions();
     SecretSink::Options::List   watch_options   = conf.GetWatchOptions();
+    RemoteSource::Options::List remote_options  = conf.GetRemoteOptions();
+    DRBG::Options               drbg_options    = conf.GetDRBGOptions();
     BitBabbler::Options         default_options = conf.GetDefaultDeviceOptions();
     BitBabbler::Options::List   device_options  = conf.GetDeviceOptions();
 
 
+    // Run the pool with modelled devices against a virtual clock and exit.
+    if( opt_simulate )
+    {
+        Simulation  sim( opt_simulate );
+
+        printf( "%s", sim.Run( pool_options, group_options,
+                               default_options, device_options ).c_str() );
+        return EXIT_SUCCESS;
+    }
+
+
    #if EM_PLATFORM_POSIX
 
     if( conf.HasOption("Service", "daemon") && ! opt_scan )
@@ -1051,40 +2032,90 @@ int main( int argc, char *argv[] )
         fprintf(stderr, "seedd: unknown device scan option %u\n", opt_scan );
         return EXIT_FAILURE;
     }
-    else if( d.GetNumDevices() == 0 && ! d.HasHotplugSupport() )
+    else if( d.GetNumDevices() == 0 && ! d.HasHotplugSupport() && remote_options.empty()
+                                                               && ! opt_emulate )
     {
         // If we don't have hotplug support, and we don't have any devices now,
         // then there's no point waiting around, because none will appear later.
+        // Unless we're only here to draw on the devices of some other host.
         fprintf( stderr, _("seedd: No devices found, and no hotplug support.  Aborting.\n") );
         return EXIT_FAILURE;
     }
 
 
+    BitB::BufferPool::UseHugePages( conf.HasOption("Pool", "huge-pages") );
+
     pthread_t       main_thread = pthread_self();
     Pool::Handle    pool        = new Pool( pool_options );
 
     for( Pool::Group::Options::List::iterator i = group_options.begin(),
                                               e = group_options.end(); i != e; ++i )
-        pool->AddGroup( i->groupid, i->size );
+        pool->AddGroup( i->groupid, i->size, i->monitor );
+
+    // Each named pool runs independently of the default one and all others,
+    // with its own sources and outputs, and its own QA for what it outputs.
+    Pool::Map                           named_pools;
+    std::list< SocketSource::Handle >   named_ssrc;
+
+    for( NamedPool::List::iterator i = named_options.begin(),
+                                   e = named_options.end(); i != e; ++i )
+    {
+        // Every pool reading from the same USB buses has to share their budget.
+        i->pool.bus_scheduler = pool->GetBusScheduler();
+
+        Pool::Handle    p = new Pool( i->pool );
+
+        named_pools[i->pool.name] = p;
+        d.AddNamedPool( i->pool.name, p );
+    }
 
     d.AddDevicesToPool( pool, default_options, device_options );
 
+    // Emulated devices behave like a real one with the default options would,
+    // in real time, for testing seedd on machines which have no devices.
+    if( opt_emulate )
+        Log<0>( _("WARNING: %u emulated devices, this output has NO entropy\n"), opt_emulate );
 
-    SocketSource::Handle    ssrc;
+    for( unsigned i = 0; i < opt_emulate; ++i )
+        pool->AddSource( default_options.group,
+                         new SimSource( VirtualClock::Handle(), i, default_options, 0 ) );
 
-    if( conf.HasOption("Service", "udp-out") )
+    for( RemoteSource::Options::List::iterator i = remote_options.begin(),
+                                               e = remote_options.end(); i != e; ++i )
     {
-        opt_bytes = 0;
-        ssrc = new SocketSource( pool, conf.GetOption("Service", "udp-out"),
-                                       conf.HasOption("Service", "ip-freebind") );
+        if( i->pool.empty() )
+            pool->AddSource( i->group, new RemoteSource( *i ) );
+        else
+            named_pools[i->pool]->AddSource( i->group, new RemoteSource( *i ) );
+    }
+
+    for( NamedPool::List::iterator i = named_options.begin(),
+                                   e = named_options.end(); i != e; ++i )
+    {
+        const Pool::Handle &p = named_pools[i->pool.name];
+
+        if( ! i->udp_out.empty() )
+            named_ssrc.push_back( new SocketSource( p, i->udp_out,
+                                        conf.HasOption("Service", "ip-freebind") ) );
+        if( i->kernel )
+            p->FeedKernelEntropyAsync();
     }
 
+
+    // This will create the udp-out sockets, if they are configured.
+    LiveConfig  live( argc, argv, cmd, pool, d );
+
+    if( conf.HasOption("Service", "udp-out") || conf.HasOption("DRBG", "udp-out") )
+        opt_bytes = 0;
+
     if( conf.HasOption("Service", "kernel") )
     {
         opt_bytes = 0;
         pool->FeedKernelEntropyAsync();
     }
 
+    DRBGWriter::Handle  drbg_writer;
+
     if( opt_stdout || opt_bytes )
     {
         if( opt_bytes && ! conf.HasOption("Service", "control-socket") )
@@ -1093,7 +2124,11 @@ int main( int argc, char *argv[] )
        #if EM_PLATFORM_MSW
         setmode( STDOUT_FILENO, O_BINARY );
        #endif
-        pool->WriteToFDAsync( STDOUT_FILENO, opt_bytes, WriteCompletion, &main_thread );
+        if( opt_drbg_stdout )
+            drbg_writer = new DRBGWriter( pool, drbg_options, STDOUT_FILENO, opt_bytes,
+                                                            WriteCompletion, &main_thread );
+        else
+            pool->WriteToFDAsync( STDOUT_FILENO, opt_bytes, WriteCompletion, &main_thread );
     }
 
     SecretSink::List    watch_sinks;
@@ -1108,6 +2143,17 @@ int main( int argc, char *argv[] )
                                                    conf.GetOption( "Service", "socket-group",
                                                                    std::string() ),
                                                    conf.HasOption( "Service", "ip-freebind" ) );
+    if( ctl != NULL )
+        ctl->SetReloadHandler( LiveConfig::ReloadHandler, &live );
+
+    StatsPublisher::Handle  shm_stats;
+
+    if( conf.HasOption( "Service", "shm-stats" ) )
+        shm_stats = new StatsPublisher( conf.GetOption( "Service", "shm-stats" ),
+                                        BitB::GetGID( conf.GetOption( "Service", "socket-group",
+                                                                      std::string() ) ),
+                                        StrToU( conf.GetOption( "Service", "shm-stats-interval",
+                                                                "0" ), 10 ) );
 
 
     // If we've been started by systemd in notify mode, then notify it ...
@@ -1119,10 +2165,27 @@ int main( int argc, char *argv[] )
     int sig;
 
     wait_for_the_signal:
-    sig = BitB::SigWait( SIGINT, SIGQUIT, SIGTERM, SIGABRT, SIGTSTP, SIGRTMIN, SIGUSR1 );
+    sig = BitB::SigWait( SIGINT, SIGQUIT, SIGTERM, SIGABRT, SIGTSTP, SIGRTMIN, SIGUSR1,
+                         SIGHUP );
 
     switch( sig )
     {
+        case SIGHUP:
+            Log<0>( _("Reloading configuration on signal %d (%s)\n"), sig, strsignal(sig) );
+
+            if( ! notify_socket.empty() )
+                BitB::SystemdNotify( "RELOADING=1", notify_socket );
+
+            try {
+                live.Reload();
+            }
+            BB_CATCH_STD( 0, _("Failed to reload configuration") )
+
+            if( ! notify_socket.empty() )
+                BitB::SystemdNotify( "READY=1", notify_socket );
+
+            goto wait_for_the_signal;
+
         case SIGTSTP:
             Log<0>( _("Stopped by signal %d (%s)\n"), sig, strsignal(sig) );
             raise( SIGSTOP );